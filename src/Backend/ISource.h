@@ -24,6 +24,7 @@
 #define ISOURCE_HPP
 
 #include <stdint.h>
+#include <vector>
 
 namespace Backend
 {
@@ -52,6 +53,17 @@ namespace Backend
             virtual unsigned int    nbAudioTracks() const = 0;
             virtual const uint8_t*  snapshot() const = 0;
             virtual int64_t         nbFrames() const = 0;
+            /**
+             * @brief scanKeyframes Find the positions the decoding can resume from after a seek.
+             *                      This method will block until the source was scanned.
+             * @param keyframes     Filled with the keyframe times in milliseconds, by ascending order.
+             * @param scannedLength Set to the time up to which keyframes were looked for, in
+             *                      milliseconds. This is the length of the source if the scan
+             *                      completed.
+             * @return              false if no keyframe could be found.
+             */
+            virtual bool            scanKeyframes( std::vector<int64_t>& keyframes,
+                                                   int64_t& scannedLength ) = 0;
     };
 
     class IMemorySource
@@ -60,6 +60,13 @@ namespace Backend
         typedef void (*MemoryInputUnlockCallback)( void *data, const char* cookie, size_t buffSize, void *buffer );
 
         virtual void    setName( const char* name ) = 0;
+        /**
+         * @brief setEventCallback  Change the receiver of the events. NULL drops them.
+         *
+         * This can be called at any time, and doesn't return while an event is
+         * being delivered to the previous receiver.
+         */
+        virtual void    setEventCallback( ISourceRendererEventCb* callback ) = 0;
         /**
          * @brief start Initializes and launches playback.
          */
@@ -85,6 +92,11 @@ namespace Backend
         virtual void    setOutputHeight( unsigned int height ) = 0;
         virtual void    setOutputFps( float fps ) = 0;
         virtual void    setOutputVideoBitrate( unsigned int vBitrate ) = 0;
+        /**
+         * @brief setOutputKeyframeInterval Ask the video encoder for a keyframe every interval frames.
+         *                                  1 outputs intra frames only. 0 leaves the encoder default.
+         */
+        virtual void    setOutputKeyframeInterval( unsigned int interval ) = 0;
 
         // Audio output
         virtual void    setOutputAudioCodec( const char* fourCC ) = 0;
@@ -97,9 +109,29 @@ namespace Backend
         virtual void    setPosition( float position ) = 0;
 
         // For video output to memory:
+        // Once started, calling this again only changes the data and callbacks the buffers are sent to.
+        // It then waits for the buffer in progress to be returned to the previous ones.
         virtual void enableVideoOutputToMemory( void* data, VideoOutputLockCallback lock, VideoOutputUnlockCallback unlock, bool timeSync ) = 0;
         // For audio output to memory:
         virtual void enableAudioOutputToMemory( void* data, AudioOutputLockCallback lock, AudioOutputUnlockCallback unlock, bool timeSync ) = 0;
+        /**
+         * @brief setMemoryOutputBlocking   Let the memory output callbacks block until the receiver has room.
+         *
+         * The receiver then paces the decoding, instead of pausing the renderer when it
+         * has enough buffers: the renderer doesn't follow its clock anymore, and timeSync
+         * is ignored. The receiver has to release a blocked callback before stopping or
+         * pausing the renderer.
+         * This has to be called before enabling the output to memory.
+         */
+        virtual void setMemoryOutputBlocking( bool blocking ) = 0;
+        /**
+         * @brief disableOutputToMemory Stop sending the buffers to the memory output callbacks.
+         *
+         * This waits for the callbacks in progress to return, so the caller must not
+         * hold any lock they may need. The buffers decoded afterward are dropped,
+         * until an output to memory gets enabled again.
+         */
+        virtual void disableOutputToMemory() = 0;
 
         // For memory input:
         virtual void enableMemoryInput( void* data, MemoryInputLockCallback lockCallback,
@@ -26,9 +26,17 @@
 #include "VLCVmemRenderer.h"
 #include "Tools/VlmcDebug.h"
 
+#include <algorithm>
+
 using namespace Backend;
 using namespace Backend::VLC;
 
+/**
+ *  The shortest interval at which a source gets probed for keyframes, in milliseconds.
+ *  Past the first keyframes, the probes follow the interval between them.
+ */
+static const int64_t    MinKeyframeScanStep = 1000;
+
 VLCSource::VLCSource( VLCBackend* backend, const QString& path )
     : m_backend( backend )
     , m_width( 0 )
@@ -206,3 +214,76 @@ VLCSource::nbFrames() const
     return m_nbFrames;
 }
 
+bool
+VLCSource::scanKeyframes( std::vector<int64_t>& keyframes, int64_t& scannedLength )
+{
+    keyframes.clear();
+    scannedLength = 0;
+    if ( hasVideo() == false || m_length <= 0 )
+        return false;
+
+    VmemRenderer*           renderer = new VmemRenderer( m_backend, this, NULL );
+    LibVLCpp::MediaPlayer*  mediaPlayer = renderer->mediaPlayer();
+    // libvlc doesn't tell which frames are keyframes, but when seeking this way,
+    // the decoding resumes from the keyframe preceding the requested time, which
+    // then becomes the current time.
+    renderer->setOption( ":input-fast-seek" );
+    {
+        EventWaiter ew( mediaPlayer, true );
+        ew.add( libvlc_MediaPlayerPlaying );
+        renderer->start();
+        if ( ew.wait( 3000 ) != EventWaiter::Success )
+        {
+            delete renderer;
+            return false;
+        }
+    }
+    {
+        EventWaiter ew( mediaPlayer, true );
+        ew.add( libvlc_MediaPlayerPaused );
+        renderer->playPause();
+        if ( ew.wait( 3000 ) != EventWaiter::Success )
+        {
+            delete renderer;
+            return false;
+        }
+    }
+    // The decoding can always start from the beginning. From there, we aim where the
+    // next keyframe should be, going by the interval between the previous ones.
+    int64_t     last = 0;
+    int64_t     step = MinKeyframeScanStep;
+    int64_t     target = step;
+    int         nbSeeks = 0;
+    while ( target < m_length )
+    {
+        {
+            EventWaiter ew( mediaPlayer, true );
+            ew.add( libvlc_MediaPlayerTimeChanged );
+            renderer->setTime( target );
+            ++nbSeeks;
+            // What was found so far stays good, the rest will be seeked to directly.
+            if ( ew.wait( 3000 ) != EventWaiter::Success )
+                break ;
+        }
+        scannedLength = target;
+        const int64_t   time = mediaPlayer->getTime();
+        // Some demuxers resume after the requested time, which tells us nothing.
+        if ( time > last && time <= target )
+        {
+            step = std::max( time - last, MinKeyframeScanStep );
+            keyframes.push_back( time );
+            last = time;
+            // Aim a bit past it, as we land on the keyframe preceding the target.
+            target = time + step + step / 4;
+        }
+        else
+            // There's no keyframe up to there, or we missed it.
+            target += step;
+    }
+    delete renderer;
+    if ( target >= m_length )
+        scannedLength = m_length;
+    vlmcDebug() << "Found" << (int)keyframes.size() << "keyframes in" << m_media->mrl()
+                << "up to" << scannedLength << "ms, in" << nbSeeks << "seeks";
+    return keyframes.empty() == false;
+}
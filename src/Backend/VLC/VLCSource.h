@@ -54,6 +54,8 @@ public:
     virtual unsigned int        nbAudioTracks() const;
     const uint8_t*              snapshot() const;
     virtual int64_t             nbFrames() const;
+    virtual bool                scanKeyframes( std::vector<int64_t>& keyframes,
+                                               int64_t& scannedLength );
 
     // Below this point are backend internal methods:
     LibVLCpp::Media*            media();
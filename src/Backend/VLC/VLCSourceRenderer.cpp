@@ -22,6 +22,7 @@
 
 #include <cstdio>
 
+#include <QFileInfo>
 #include <QString>
 #include <QStringBuilder>
 
@@ -38,11 +39,22 @@ VLCSourceRenderer::VLCSourceRenderer( VLCBackend* backendInstance, VLCSource *so
     : m_backend( backendInstance )
     , m_modes( Playback )
     , m_callback( callback )
+    , m_outputBlocking( false )
     , m_outputWidth( 0 )
     , m_outputHeight( 0 )
     , m_outputVideoBitrate( 0 )
     , m_outputFps( .0f )
+    , m_outputKeyframeInterval( 0 )
     , m_outputAudioBitrate( 0 )
+    , m_outputData( NULL )
+    , m_videoLock( NULL )
+    , m_videoUnlock( NULL )
+    , m_audioLock( NULL )
+    , m_audioUnlock( NULL )
+    , m_pendingOutputs( 0 )
+    , m_pendingData( NULL )
+    , m_pendingVideoUnlock( NULL )
+    , m_pendingAudioUnlock( NULL )
 {
     m_media = new LibVLCpp::Media( backendInstance->vlcInstance(), source->media()->mrl() );
     initMediaPlayer();
@@ -51,13 +63,24 @@ VLCSourceRenderer::VLCSourceRenderer( VLCBackend* backendInstance, VLCSource *so
 VLCSourceRenderer::VLCSourceRenderer( VLCBackend* backendInstance, const VLCMemorySource *source, ISourceRendererEventCb *callback )
     : m_backend( backendInstance )
     , m_callback( callback )
+    , m_outputBlocking( false )
+    , m_outputKeyframeInterval( 0 )
+    , m_outputData( NULL )
+    , m_videoLock( NULL )
+    , m_videoUnlock( NULL )
+    , m_audioLock( NULL )
+    , m_audioUnlock( NULL )
+    , m_pendingOutputs( 0 )
+    , m_pendingData( NULL )
+    , m_pendingVideoUnlock( NULL )
+    , m_pendingAudioUnlock( NULL )
 {
     char        videoString[512];
     char        inputSlave[256];
     char        audioParameters[256];
 
     sprintf( videoString, "imem://width=%i:height=%i:dar=%s:fps=%f/1:cookie=0:codec=%s:cat=2:caching=0",
-             source->width(), source->height(), qPrintable( source->aspectRatio() ), source->fps(), "RV32" );
+             source->width(), source->height(), qPrintable( source->aspectRatio() ), source->fps(), "I420" );
     sprintf( audioParameters, "cookie=1:cat=1:codec=f32l:samplerate=%u:channels=%u:caching=0",
                 source->sampleRate(), source->numberChannels() );
     strcpy( inputSlave, ":input-slave=imem://" );
@@ -90,6 +113,13 @@ VLCSourceRenderer::setName(const char *name)
     m_name = name;
 }
 
+void
+VLCSourceRenderer::setEventCallback( ISourceRendererEventCb *callback )
+{
+    QMutexLocker    lock( &m_callbackLock );
+    m_callback = callback;
+}
+
 void
 VLCSourceRenderer::setupStreamOutput()
 {
@@ -116,6 +146,8 @@ VLCSourceRenderer::setupStreamOutput()
             transcodeStr += ",width=" + QString::number( m_outputWidth );
         if ( m_outputHeight > 0 )
             transcodeStr += ",height=" + QString::number( m_outputHeight );
+        if ( m_outputKeyframeInterval > 0 )
+            transcodeStr += ",venc=avcodec{keyint=" + QString::number( m_outputKeyframeInterval ) + '}';
     }
     if ( m_modes.testFlag( AudioSmem ) || m_modes.testFlag( FileOutput ) )
     {
@@ -144,7 +176,16 @@ VLCSourceRenderer::setupFileOutput()
     if ( m_modes.testFlag( FileOutput ) == false )
         return QString();
     Q_ASSERT( m_outputFileName.isNull() == false );
-    QString soutConfig = ":standard{access=file,mux=ps,dst=\"";
+    //Anything we don't know is muxed as MPEG-PS.
+    const QString   extension = QFileInfo( m_outputFileName ).suffix().toLower();
+    const char*     mux = "ps";
+    if ( extension == "mkv" )
+        mux = "mkv";
+    else if ( extension == "mp4" || extension == "mov" )
+        mux = "mp4";
+    else if ( extension == "ts" )
+        mux = "ts";
+    QString soutConfig = QString( ":standard{access=file,mux=" ) + mux + ",dst=\"";
     soutConfig += m_outputFileName;
     soutConfig += "\"}";
     return soutConfig;
@@ -272,6 +313,12 @@ VLCSourceRenderer::setOutputVideoBitrate(unsigned int vBitrate)
     m_outputVideoBitrate = vBitrate;
 }
 
+void
+VLCSourceRenderer::setOutputKeyframeInterval( unsigned int interval )
+{
+    m_outputKeyframeInterval = interval;
+}
+
 void
 VLCSourceRenderer::setOutputAudioCodec(const char *fourCC)
 {
@@ -299,17 +346,30 @@ VLCSourceRenderer::setOutputAudioBitrate(unsigned int aBitrate)
 void
 VLCSourceRenderer::enableVideoOutputToMemory( void *data, VideoOutputLockCallback lock, VideoOutputUnlockCallback unlock, bool timeSync )
 {
+    {
+        QMutexLocker    locker( &m_outputLock );
+        m_outputData = data;
+        m_videoLock = lock;
+        m_videoUnlock = unlock;
+        // The buffer being filled still belongs to the previous target.
+        while ( m_pendingOutputs > 0 && m_pendingData != data )
+            m_outputDoneCond.wait( &m_outputLock );
+    }
+    // Once started, the stream output chain is set, and only the target changes.
+    if ( m_media == NULL )
+        return ;
     m_modes |= VideoSmem;
     m_smemChain = ":smem{";
-    if ( timeSync == true )
+    //With time-sync, the input is paced by smem, hence by the blocking callbacks.
+    if ( timeSync == true || m_outputBlocking == true )
         m_smemChain += "time-sync";
     else
         m_smemChain += "no-time-sync";
-    m_smemChain += ",video-data=" % QString::number( reinterpret_cast<intptr_t>( data ) )
+    m_smemChain += ",video-data=" % QString::number( reinterpret_cast<intptr_t>( this ) )
             % ",video-prerender-callback="
-            % QString::number( reinterpret_cast<intptr_t>( lock ) )
+            % QString::number( reinterpret_cast<intptr_t>( &videoLockCallback ) )
             % ",video-postrender-callback="
-            % QString::number( reinterpret_cast<intptr_t>( unlock ) )
+            % QString::number( reinterpret_cast<intptr_t>( &videoUnlockCallback ) )
             % '}';
     setOption( ":no-audio" );
     setOption( ":no-sout-audio" );
@@ -318,22 +378,141 @@ VLCSourceRenderer::enableVideoOutputToMemory( void *data, VideoOutputLockCallbac
 void
 VLCSourceRenderer::enableAudioOutputToMemory(void *data, AudioOutputLockCallback lock, AudioOutputUnlockCallback unlock, bool timeSync)
 {
+    {
+        QMutexLocker    locker( &m_outputLock );
+        m_outputData = data;
+        m_audioLock = lock;
+        m_audioUnlock = unlock;
+        // The buffer being filled still belongs to the previous target.
+        while ( m_pendingOutputs > 0 && m_pendingData != data )
+            m_outputDoneCond.wait( &m_outputLock );
+    }
+    // Once started, the stream output chain is set, and only the target changes.
+    if ( m_media == NULL )
+        return ;
     m_modes |= AudioSmem;
     m_smemChain = ":smem{";
-    if ( timeSync == true )
+    //With time-sync, the input is paced by smem, hence by the blocking callbacks.
+    if ( timeSync == true || m_outputBlocking == true )
         m_smemChain += "time-sync";
     else
         m_smemChain += "no-time-sync";
-    m_smemChain += ",audio-data=" % QString::number( reinterpret_cast<intptr_t>( data ) )
+    m_smemChain += ",audio-data=" % QString::number( reinterpret_cast<intptr_t>( this ) )
             % ",audio-prerender-callback="
-            % QString::number( reinterpret_cast<intptr_t>( lock ) )
+            % QString::number( reinterpret_cast<intptr_t>( &audioLockCallback ) )
             % ",audio-postrender-callback="
-            % QString::number( reinterpret_cast<intptr_t>( unlock ) )
+            % QString::number( reinterpret_cast<intptr_t>( &audioUnlockCallback ) )
             % '}';
     setOption( ":no-video" );
     setOption( ":no-sout-video" );
 }
 
+void
+VLCSourceRenderer::setMemoryOutputBlocking( bool blocking )
+{
+    m_outputBlocking = blocking;
+}
+
+void
+VLCSourceRenderer::disableOutputToMemory()
+{
+    QMutexLocker    lock( &m_outputLock );
+    m_outputData = NULL;
+    m_videoLock = NULL;
+    m_videoUnlock = NULL;
+    m_audioLock = NULL;
+    m_audioUnlock = NULL;
+    while ( m_pendingOutputs > 0 )
+        m_outputDoneCond.wait( &m_outputLock );
+}
+
+uint8_t*
+VLCSourceRenderer::discardBuffer( size_t size )
+{
+    if ( (size_t)m_discardBuffer.size() < size )
+        m_discardBuffer.resize( size );
+    return reinterpret_cast<uint8_t*>( m_discardBuffer.data() );
+}
+
+void
+VLCSourceRenderer::outputDone()
+{
+    QMutexLocker    lock( &m_outputLock );
+    if ( --m_pendingOutputs == 0 )
+        m_outputDoneCond.wakeAll();
+}
+
+void
+VLCSourceRenderer::videoLockCallback( void *data, uint8_t **p_buffer, size_t size )
+{
+    VLCSourceRenderer*  self = reinterpret_cast<VLCSourceRenderer*>( data );
+
+    self->m_outputLock.lock();
+    VideoOutputLockCallback     lock = self->m_videoLock;
+    if ( lock == NULL )
+    {
+        self->m_pendingVideoUnlock = NULL;
+        self->m_outputLock.unlock();
+        *p_buffer = self->discardBuffer( size );
+        return ;
+    }
+    self->m_pendingData = self->m_outputData;
+    self->m_pendingVideoUnlock = self->m_videoUnlock;
+    ++self->m_pendingOutputs;
+    self->m_outputLock.unlock();
+    lock( self->m_pendingData, p_buffer, size );
+}
+
+void
+VLCSourceRenderer::videoUnlockCallback( void *data, uint8_t *buffer, int width, int height,
+                                        int bpp, size_t size, int64_t pts )
+{
+    VLCSourceRenderer*  self = reinterpret_cast<VLCSourceRenderer*>( data );
+
+    // The target can't change while a buffer is pending, so we can't miss the unlock.
+    if ( self->m_pendingVideoUnlock == NULL )
+        return ;
+    self->m_pendingVideoUnlock( self->m_pendingData, buffer, width, height, bpp, size, pts );
+    self->m_pendingVideoUnlock = NULL;
+    self->outputDone();
+}
+
+void
+VLCSourceRenderer::audioLockCallback( void *data, uint8_t **p_buffer, size_t size )
+{
+    VLCSourceRenderer*  self = reinterpret_cast<VLCSourceRenderer*>( data );
+
+    self->m_outputLock.lock();
+    AudioOutputLockCallback     lock = self->m_audioLock;
+    if ( lock == NULL )
+    {
+        self->m_pendingAudioUnlock = NULL;
+        self->m_outputLock.unlock();
+        *p_buffer = self->discardBuffer( size );
+        return ;
+    }
+    self->m_pendingData = self->m_outputData;
+    self->m_pendingAudioUnlock = self->m_audioUnlock;
+    ++self->m_pendingOutputs;
+    self->m_outputLock.unlock();
+    lock( self->m_pendingData, p_buffer, size );
+}
+
+void
+VLCSourceRenderer::audioUnlockCallback( void *data, uint8_t *buffer, unsigned int channels,
+                                        unsigned int rate, unsigned int nb_samples,
+                                        unsigned int bits_per_sample, size_t size, int64_t pts )
+{
+    VLCSourceRenderer*  self = reinterpret_cast<VLCSourceRenderer*>( data );
+
+    if ( self->m_pendingAudioUnlock == NULL )
+        return ;
+    self->m_pendingAudioUnlock( self->m_pendingData, buffer, channels, rate, nb_samples,
+                                bits_per_sample, size, pts );
+    self->m_pendingAudioUnlock = NULL;
+    self->outputDone();
+}
+
 void
 VLCSourceRenderer::enableMemoryInput( void *data, MemoryInputLockCallback lockCallback, MemoryInputUnlockCallback unlockCallback )
 {
@@ -365,6 +544,8 @@ VLCSourceRenderer::eventsCallback( const libvlc_event_t* event, void* data )
         vlmcDebug() << self->m_name << "Event received:" << self->m_mediaPlayer->eventName( event->type );
     }
 
+    // Don't let the receiver change while it's being called.
+    QMutexLocker    lock( &self->m_callbackLock );
     if ( self->m_callback == NULL )
         return;
     switch ( event->type )
@@ -23,8 +23,11 @@
 #ifndef VLCRENDERER_H
 #define VLCRENDERER_H
 
+#include <QByteArray>
 #include <QFlags>
+#include <QMutex>
 #include <QString>
+#include <QWaitCondition>
 
 #include "Backend/ISourceRenderer.h"
 
@@ -57,6 +60,7 @@ public:
     virtual ~VLCSourceRenderer();
 
     virtual void    setName( const char* name );
+    virtual void    setEventCallback( ISourceRendererEventCb* callback );
     virtual void    start();
     virtual void    stop();
     virtual void    playPause();
@@ -77,6 +81,7 @@ public:
     virtual void    setOutputHeight( unsigned int height );
     virtual void    setOutputFps( float fps );
     virtual void    setOutputVideoBitrate( unsigned int vBitrate );
+    virtual void    setOutputKeyframeInterval( unsigned int interval );
 
     // Audio output:
     virtual void    setOutputAudioCodec( const char* fourCC );
@@ -91,6 +96,8 @@ public:
     virtual void    enableVideoOutputToMemory( void* data, VideoOutputLockCallback lock, VideoOutputUnlockCallback unlock, bool timeSync );
     virtual void    enableAudioOutputToMemory( void* data, AudioOutputLockCallback lock,
                                                AudioOutputUnlockCallback unlock, bool timeSync );
+    virtual void    setMemoryOutputBlocking( bool blocking );
+    virtual void    disableOutputToMemory();
 
     // Below is stuff which is not accessible through IRenderer
     virtual void    setOption( const QString& option );
@@ -100,6 +107,20 @@ private:
     void            setupStreamOutput();
     QString         setupFileOutput();
     static void     eventsCallback( const libvlc_event_t* event, void* data );
+    /**
+     * smem calls these, which forward to the current output callbacks. This allows
+     * the output to be redirected once the stream output chain is set up.
+     */
+    static void     videoLockCallback( void* data, uint8_t** p_buffer, size_t size );
+    static void     videoUnlockCallback( void* data, uint8_t* buffer, int width, int height,
+                                         int bpp, size_t size, int64_t pts );
+    static void     audioLockCallback( void* data, uint8_t** p_buffer, size_t size );
+    static void     audioUnlockCallback( void* data, uint8_t* buffer, unsigned int channels,
+                                         unsigned int rate, unsigned int nb_samples,
+                                         unsigned int bits_per_sample, size_t size, int64_t pts );
+    /// \returns    A buffer for smem to decode to when nobody wants it.
+    uint8_t*        discardBuffer( size_t size );
+    void            outputDone();
 
 protected:
     VLCBackend*                 m_backend;
@@ -109,8 +130,10 @@ protected:
     LibVLCpp::Media*            m_media;
     LibVLCpp::MediaPlayer*      m_mediaPlayer;
     ISourceRendererEventCb*     m_callback;
+    QMutex                      m_callbackLock;
     QString                     m_outputFileName;
     QString                     m_smemChain;
+    bool                        m_outputBlocking;
 
     // Video output settings
     QString                     m_outputVideoFourCC;
@@ -118,12 +141,30 @@ protected:
     unsigned int                m_outputHeight;
     unsigned int                m_outputVideoBitrate;
     float                       m_outputFps;
+    unsigned int                m_outputKeyframeInterval;
 
     // Audio output settings
     unsigned int                m_outputAudioBitrate;
     unsigned int                m_outputNbChannels;
     unsigned int                m_outputSampleRate;
     QString                     m_outputAudioFourCC;
+
+private:
+    // Memory output targets, protected by m_outputLock
+    QMutex                      m_outputLock;
+    QWaitCondition              m_outputDoneCond;
+    void*                       m_outputData;
+    VideoOutputLockCallback     m_videoLock;
+    VideoOutputUnlockCallback   m_videoUnlock;
+    AudioOutputLockCallback     m_audioLock;
+    AudioOutputUnlockCallback   m_audioUnlock;
+    /// The number of buffers which were forwarded to a lock callback, and not to the unlock one yet.
+    int                         m_pendingOutputs;
+    /// Where the buffer being decoded goes. Only used by the smem thread.
+    void*                       m_pendingData;
+    VideoOutputUnlockCallback   m_pendingVideoUnlock;
+    AudioOutputUnlockCallback   m_pendingAudioUnlock;
+    QByteArray                  m_discardBuffer;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS( VLCSourceRenderer::Modes );
@@ -27,6 +27,7 @@
 #include "Project/Project.h"
 #include "Media/Clip.h"
 #include "Workflow/ClipHelper.h"
+#include "Workflow/MainWorkflow.h"
 #include "EffectsEngine/EffectHelper.h"
 #include "EffectsEngine/EffectInstance.h"
 #include "Workflow/TrackWorkflow.h"
@@ -64,14 +65,20 @@ void
 Commands::Generic::redo()
 {
     if ( m_valid == true )
+    {
         internalRedo();
+        Project::getInstance()->workflow()->notifyEdit();
+    }
 }
 
 void
 Commands::Generic::undo()
 {
     if ( m_valid == true )
+    {
         internalUndo();
+        Project::getInstance()->workflow()->notifyEdit();
+    }
 }
 
 Commands::Clip::Add::Add( ClipHelper* ch, TrackWorkflow* tw, qint64 pos ) :
@@ -20,14 +20,18 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 
+#include <QCryptographicHash>
 #include <QDomElement>
 #include <QReadWriteLock>
+#include <QStringList>
 
 #include "EffectsEngine/EffectUser.h"
 #include "EffectsEngine/EffectHelper.h"
 #include "EffectsEngine/EffectInstance.h"
+#include "EffectsEngine/EffectSettingValue.h"
 
 #include "Main/Core.h"
+#include "Workflow/FramePool.h"
 #include "Workflow/Types.h"
 #include "Tools/VlmcDebug.h"
 
@@ -86,7 +90,8 @@ EffectUser::applyFilters( const Workflow::Frame* frame,
 
     quint32         *buff1 = NULL;
     quint32         *buff2 = NULL;
-    const quint32   *input = frame->buffer();
+    //Only convert the frame to RV32 if an effect actually needs it
+    const quint32   *input = NULL;
     bool            firstBuff = true;
 
     while ( it != ite )
@@ -100,7 +105,9 @@ EffectUser::applyFilters( const Workflow::Frame* frame,
             else
                 buff = &buff2;
             if ( *buff == NULL )
-                *buff = new quint32[frame->nbPixels()];
+                *buff = Workflow::FramePool::getInstance()->get( Workflow::Frame::Size( frame->width(), frame->height(), Workflow::RV32 ) );
+            if ( input == NULL )
+                input = frame->rgbaBuffer();
             EffectInstance      *effect = (*it)->effectInstance();
             effect->process( time, input, *buff );
             input = *buff;
@@ -112,12 +119,12 @@ EffectUser::applyFilters( const Workflow::Frame* frame,
     {
         if ( firstBuff == true )
         {
-            delete[] buff1;
+            Workflow::FramePool::getInstance()->release( buff1 );
             return buff2;
         }
         else
         {
-            delete[] buff2;
+            Workflow::FramePool::getInstance()->release( buff2 );
             return buff1;
         }
     }
@@ -224,6 +231,32 @@ EffectUser::saveFilters( QXmlStreamWriter &project ) const
     project.writeEndElement();
 }
 
+static void
+hashEffectList( QCryptographicHash &hash, const EffectsEngine::EffectList &effects )
+{
+    foreach ( EffectHelper* helper, effects )
+    {
+        EffectInstance* instance = helper->effectInstance();
+        hash.addData( QString( "effect %1 %2 %3" ).arg( instance->effect()->name() )
+                      .arg( helper->begin() ).arg( helper->end() ).toUtf8() );
+        //The parameters have to be hashed in the same order from one session to another.
+        QStringList     names = instance->params().keys();
+        names.sort();
+        foreach ( const QString& name, names )
+            hash.addData( QString( "param %1 %2" ).arg( name )
+                          .arg( instance->params()[name]->get().toString() ).toUtf8() );
+    }
+}
+
+void
+EffectUser::hashEffects( QCryptographicHash &hash ) const
+{
+    QReadLocker     lock( m_effectsLock );
+
+    hashEffectList( hash, m_filters );
+    hashEffectList( hash, m_mixers );
+}
+
 const EffectsEngine::EffectList&
 EffectUser::effects( Effect::Type type ) const
 {
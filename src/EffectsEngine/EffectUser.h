@@ -28,6 +28,7 @@
 
 #include "EffectsEngine/EffectsEngine.h"
 
+class   QCryptographicHash;
 class   QDomElement;
 class   QReadWriteLock;
 
@@ -60,6 +61,11 @@ class EffectUser : public QObject
         virtual Type                    effectType() const = 0;
         void                            loadEffects( const QDomElement &project );
         void                            saveFilters( QXmlStreamWriter &project ) const;
+        /**
+         *  \brief  Add the effects, their position and their parameters to a hash
+         *          of the timeline content.
+         */
+        void                            hashEffects( QCryptographicHash &hash ) const;
         bool                            contains( Effect::Type, const QUuid &uuid ) const;
 
     protected:
@@ -69,6 +75,10 @@ class EffectUser : public QObject
         void                            initMixers();
 
         //Filters:
+        /**
+         *  \returns   A buffer borrowed from the Workflow::FramePool, or NULL if no
+         *              filter was applied. The caller owns the returned reference.
+         */
         quint32                         *applyFilters( const Workflow::Frame *frame,
                                                        qint64 currentFrame, double time );
         //Mixers methods:
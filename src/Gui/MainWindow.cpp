@@ -41,6 +41,7 @@
 #include "EffectsEngine/EffectsEngine.h"
 #include "Backend/IBackend.h"
 #include "Workflow/MainWorkflow.h"
+#include "Renderer/ParallelFileRenderer.h"
 #include "Renderer/WorkflowFileRenderer.h"
 #include "Renderer/WorkflowRenderer.h"
 #include "Renderer/ClipRenderer.h"
@@ -75,6 +76,7 @@ MainWindow::MainWindow( Backend::IBackend* backend, QWidget *parent )
     : QMainWindow( parent )
     , m_backend( backend )
     , m_fileRenderer( NULL )
+    , m_parallelRenderer( NULL )
     , m_projectPreferences( NULL )
     , m_wizard( NULL )
 {
@@ -133,6 +135,7 @@ MainWindow::~MainWindow()
 {
     if ( m_fileRenderer )
         delete m_fileRenderer;
+    delete m_parallelRenderer;
     delete m_importController;
 }
 
@@ -580,13 +583,38 @@ MainWindow::renderVideo( const QString& outputFileName, quint32 width, quint32 h
 {
     if ( m_fileRenderer )
         delete m_fileRenderer;
-    m_fileRenderer = new WorkflowFileRenderer( m_backend, Project::getInstance()->workflow() );
-
-    WorkflowFileRendererDialog  *dialog = new WorkflowFileRendererDialog( m_fileRenderer, width, height );
+    m_fileRenderer = NULL;
+    delete m_parallelRenderer;
+    m_parallelRenderer = NULL;
+
+    const quint32               nbSegments = VLMC_PROJECT_GET_UINT( "video/ExportSegments" );
+    WorkflowFileRendererDialog  *dialog;
+    //The settings dialog only lets the unsupported outputs through when publishing.
+    if ( nbSegments > 1 && ParallelFileRenderer::supportsOutput( outputFileName ) == true )
+    {
+        m_parallelRenderer = new ParallelFileRenderer( m_backend, Project::getInstance()->workflow() );
+        dialog = new WorkflowFileRendererDialog( m_parallelRenderer, width, height );
+    }
+    else
+    {
+        m_fileRenderer = new WorkflowFileRenderer( m_backend, Project::getInstance()->workflow() );
+        dialog = new WorkflowFileRendererDialog( m_fileRenderer, width, height );
+    }
     dialog->setModal( true );
     dialog->setOutputFileName( outputFileName );
 
-    m_fileRenderer->run( outputFileName, width, height, fps, vbitrate, abitrate );
+    if ( m_parallelRenderer != NULL )
+    {
+        if ( m_parallelRenderer->run( outputFileName, nbSegments, width, height, fps,
+                                      vbitrate, abitrate ) == false )
+        {
+            QMessageBox::warning( this, tr( "VLMC Renderer" ), tr( "The render couldn't be started." ) );
+            delete dialog;
+            return false;
+        }
+    }
+    else
+        m_fileRenderer->run( outputFileName, width, height, fps, vbitrate, abitrate );
 
     if ( dialog->exec() == QDialog::Rejected )
     {
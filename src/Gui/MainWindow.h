@@ -42,6 +42,7 @@ class   Project;
 class   ProjectWizard;
 class   SettingsDialog;
 class   Timeline;
+class   ParallelFileRenderer;
 class   WorkflowFileRenderer;
 class   WorkflowRenderer;
 
@@ -131,6 +132,7 @@ private:
     PreviewWidget*          m_clipPreview;
     PreviewWidget*          m_projectPreview;
     WorkflowFileRenderer*   m_fileRenderer;
+    ParallelFileRenderer*   m_parallelRenderer;
     SettingsDialog*         m_globalPreferences;
     SettingsDialog*         m_DefaultProjectPreferences;
     SettingsDialog*         m_projectPreferences;
@@ -26,13 +26,17 @@
 #include "Project/Project.h"
 #include "vlmc.h"
 #include "Workflow/MainWorkflow.h"
+#include "Renderer/ParallelFileRenderer.h"
 #include "Renderer/WorkflowFileRenderer.h"
 
+#include <QStringList>
+
 WorkflowFileRendererDialog::WorkflowFileRendererDialog( WorkflowFileRenderer* renderer,
                                                         quint32 width, quint32 height ) :
         m_width( width ),
         m_height( height ),
-        m_renderer( renderer )
+        m_renderer( renderer ),
+        m_parallelRenderer( NULL )
 {
     m_ui.setupUi( this );
     connect( m_ui.cancelButton, SIGNAL( clicked() ), this, SLOT( cancel() ) );
@@ -43,6 +47,26 @@ WorkflowFileRendererDialog::WorkflowFileRendererDialog( WorkflowFileRenderer* re
              Qt::QueuedConnection );
 }
 
+WorkflowFileRendererDialog::WorkflowFileRendererDialog( ParallelFileRenderer* renderer,
+                                                        quint32 width, quint32 height ) :
+        m_width( width ),
+        m_height( height ),
+        m_renderer( NULL ),
+        m_parallelRenderer( renderer )
+{
+    m_ui.setupUi( this );
+    connect( m_ui.cancelButton, SIGNAL( clicked() ), this, SLOT( cancel() ) );
+    connect( m_parallelRenderer, SIGNAL( renderComplete() ), this, SLOT( accept() ) );
+    connect( m_parallelRenderer, SIGNAL( renderFailed() ), this, SLOT( reject() ) );
+    connect( m_parallelRenderer, SIGNAL( segmentProgress( quint32, qint64, qint64 ) ),
+             this, SLOT( segmentProgress( quint32, qint64, qint64 ) ) );
+    connect( m_parallelRenderer, SIGNAL( frameChanged( qint64 ) ),
+             this, SLOT( frameChanged( qint64 ) ) );
+    connect( m_parallelRenderer, SIGNAL( imageUpdated( const uchar* ) ),
+             this, SLOT( updatePreview( const uchar* ) ),
+             Qt::QueuedConnection );
+}
+
 void
 WorkflowFileRendererDialog::setOutputFileName( const QString& outputFileName )
 {
@@ -72,15 +96,35 @@ WorkflowFileRendererDialog::frameChanged( qint64 frame )
 
     if ( frame <= totalFrames )
     {
-        m_ui.frameCounter->setText( tr("Rendering frame %1 / %2").arg(QString::number( frame ),
-                                        QString::number( totalFrames ) ) );
+        QString     text = tr("Rendering frame %1 / %2").arg(QString::number( frame ),
+                                                           QString::number( totalFrames ) );
+        if ( m_segmentProgress.isEmpty() == false )
+        {
+            QStringList     segments;
+            foreach ( int progress, m_segmentProgress )
+                segments << QString( "%1%" ).arg( progress );
+            text += " (" + segments.join( " " ) + ")";
+        }
+        m_ui.frameCounter->setText( text );
         setProgressBarValue( frame * 100 / totalFrames );
     }
 }
 
+void
+WorkflowFileRendererDialog::segmentProgress( quint32 segment, qint64 nbRendered, qint64 nbFrames )
+{
+    if ( m_segmentProgress.size() != (int)m_parallelRenderer->nbSegments() )
+        m_segmentProgress.fill( 0, m_parallelRenderer->nbSegments() );
+    if ( segment < (quint32)m_segmentProgress.size() && nbFrames > 0 )
+        m_segmentProgress[segment] = nbRendered * 100 / nbFrames;
+}
+
 void
 WorkflowFileRendererDialog::cancel()
 {
-    m_renderer->stop();
+    if ( m_renderer != NULL )
+        m_renderer->stop();
+    else
+        m_parallelRenderer->stop();
     close();
 }
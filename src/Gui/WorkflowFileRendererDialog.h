@@ -24,8 +24,10 @@
 #define WORKFLOWFILERENDERERDIALOG_H
 
 #include <QDialog>
+#include <QVector>
 #include "ui_WorkflowFileRendererDialog.h"
 
+class   ParallelFileRenderer;
 class   WorkflowFileRenderer;
 
 class   WorkflowFileRendererDialog : public QDialog
@@ -34,6 +36,7 @@ class   WorkflowFileRendererDialog : public QDialog
     Q_DISABLE_COPY( WorkflowFileRendererDialog );
 public:
     WorkflowFileRendererDialog( WorkflowFileRenderer* renderer, quint32 width, quint32 height );
+    WorkflowFileRendererDialog( ParallelFileRenderer* renderer, quint32 width, quint32 height );
     void    setOutputFileName( const QString& filename );
     void    setProgressBarValue( int val );
 
@@ -42,12 +45,16 @@ private:
     quint32                             m_width;
     quint32                             m_height;
     WorkflowFileRenderer                *m_renderer;
+    ParallelFileRenderer                *m_parallelRenderer;
+    /// The progress of each segment, in percent, when rendering in parallel.
+    QVector<int>                        m_segmentProgress;
 
 public slots:
     void    updatePreview( const uchar* buff );
 
 private slots:
     void    frameChanged( qint64 );
+    void    segmentProgress( quint32 segment, qint64 nbRendered, qint64 nbFrames );
     void    cancel();
 
     friend class    WorkflowFileRenderer;
@@ -28,6 +28,8 @@
 #include "EffectsEngine/Effect.h"
 #include "EffectsEngine/EffectInstance.h"
 #include "EffectsEngine/EffectSettingValue.h"
+#include "Project/Project.h"
+#include "Workflow/MainWorkflow.h"
 
 #include <QFormLayout>
 #include <QGroupBox>
@@ -98,4 +100,6 @@ EffectInstanceWidget::save()
 {
     foreach ( ISettingsCategoryWidget* val, m_settings )
         val->save();
+    //The frames rendered with the previous parameters are outdated.
+    Project::getInstance()->workflow()->notifyEdit();
 }
@@ -21,7 +21,9 @@
  *****************************************************************************/
 
 #include "Media/Media.h"
+#include "Project/Project.h"
 #include "RendererSettings.h"
+#include "Renderer/ParallelFileRenderer.h"
 #include "Settings/Settings.h"
 #include "ui_RendererSettings.h"
 
@@ -32,7 +34,8 @@
 #include <QMessageBox>
 #include <QSslSocket>
 
-RendererSettings::RendererSettings( bool shareOnInternet )
+RendererSettings::RendererSettings( bool shareOnInternet ) :
+    m_shareOnInternet( shareOnInternet )
 {
     m_ui.setupUi( this );
 
@@ -127,6 +130,23 @@ RendererSettings::accept()
         return;
     }
 
+    //The parts of a segmented export are joined by appending them. When publishing, the
+    //output isn't up to the user, and it gets exported in a single segment instead.
+    const quint32   nbSegments = VLMC_PROJECT_GET_UINT( "video/ExportSegments" );
+    if ( m_shareOnInternet == false && nbSegments > 1 &&
+         ParallelFileRenderer::supportsOutput( outputFileName() ) == false )
+    {
+        QMessageBox::warning( this, tr( "Invalid parameters" ),
+                              tr( "The export is split in %1 segments, which can only be joined "
+                                  "back in an MPEG-PS or MPEG-TS file. Please use one of these "
+                                  "extensions: %2, or set the export segments to 1 in the "
+                                  "project preferences." )
+                              .arg( nbSegments )
+                              .arg( ParallelFileRenderer::supportedExtensions().join( ", " ) ) );
+        m_ui.outputFileName->setFocus();
+        return;
+    }
+
     if ( fileInfo.isFile() )
     {
         QMessageBox::StandardButton b =
@@ -60,6 +60,7 @@ class   RendererSettings : public QDialog
 
     private:
         Ui::RendererSettings    m_ui;
+        bool                    m_shareOnInternet;
         void                    setPreset( quint32 width, quint32 height, double fps );
 };
 
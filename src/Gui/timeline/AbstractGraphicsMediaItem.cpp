@@ -30,6 +30,8 @@
 #include "Workflow/ClipHelper.h"
 #include "Commands/Commands.h"
 #include "Media/Media.h"
+#include "Project/Project.h"
+#include "Renderer/WorkflowRenderer.h"
 
 #include <QMenu>
 #include <QColorDialog>
@@ -96,6 +98,7 @@ AbstractGraphicsMediaItem::contextMenuEvent( QGraphicsSceneContextMenuEvent* eve
     menu.addSeparator();
 
     QAction* changeColorAction = menu.addAction( tr( "Set color" ) );
+    QAction* renderToCacheAction = menu.addAction( tr( "Render selection to cache" ) );
 
     QAction* selectedAction = menu.exec( event->screenPos() );
 
@@ -161,6 +164,20 @@ AbstractGraphicsMediaItem::contextMenuEvent( QGraphicsSceneContextMenuEvent* eve
         m_itemColor = QColorDialog::getColor( m_itemColor, tracksView() );
         update();
     }
+    else if ( selectedAction == renderToCacheAction )
+    {
+        qint64      begin = startPos();
+        qint64      end = startPos() + m_clipHelper->length() - 1;
+        foreach ( QGraphicsItem* i, scene()->selectedItems() )
+        {
+            AbstractGraphicsItem* item = dynamic_cast<AbstractGraphicsItem*>( i );
+            if ( item == NULL )
+                continue ;
+            begin = qMin( begin, item->startPos() );
+            end = qMax( end, item->startPos() + item->helper()->length() - 1 );
+        }
+        Project::getInstance()->workflowRenderer()->renderToCache( begin, end );
+    }
 
 }
 
@@ -30,6 +30,7 @@
 #include "Library.h"
 #include "Media/Clip.h"
 #include "Media/Media.h"
+#include "Media/Transcoder.h"
 #include "Metadata/MetaDataManager.h"
 #include "Project/Project.h"
 #include "Settings/Settings.h"
@@ -37,15 +38,26 @@
 #include "Project/Workspace.h"
 
 #include <QDomElement>
+#include <QFile>
 #include <QHash>
 #include <QUuid>
 
 Library::Library( Workspace *workspace )
     : m_cleanState( true )
     , m_workspace( workspace )
+    , m_proxyTranscoder( NULL )
+    , m_proxyMedia( NULL )
 {
 }
 
+Library::~Library()
+{
+    cancelProxy();
+    //Our clips get deleted after we are.
+    foreach ( Clip* clip, m_clips.values() )
+        clip->disconnect( this );
+}
+
 bool
 Library::load(const QDomDocument& doc )
 {
@@ -69,7 +81,19 @@ Library::load(const QDomDocument& doc )
             if ( m == NULL )
                 vlmcWarning() << "Failed to load media" << mrl << "when loading project.";
             else
+            {
+                m->loadKeyframes( media );
+                const QDomElement   proxy = media.firstChildElement( "proxy" );
+                if ( proxy.isNull() == false )
+                {
+                    const QString   proxyPath = m_workspace->toAbsolutePath( proxy.text() );
+                    if ( QFile::exists( proxyPath ) == true )
+                        m->setProxy( proxyPath );
+                    else
+                        vlmcWarning() << "Proxy" << proxyPath << "is missing, it will be generated again";
+                }
                 m_nbMediaToLoad.fetchAndAddAcquire( 1 );
+            }
         }
         media = media.nextSiblingElement();
     }
@@ -98,6 +122,9 @@ Library::save( QXmlStreamWriter& project )
         const Media* m = (*it)->getMedia();
         project.writeStartElement( "media" );
         project.writeAttribute( "mrl", m_workspace->toWorkspacePath( m ) );
+        m->saveKeyframes( project );
+        if ( m->hasProxy() == true )
+            project.writeTextElement( "proxy", m_workspace->toWorkspacePath( m->proxyPath() ) );
         project.writeEndElement();
         ++it;
     }
@@ -147,7 +174,19 @@ Library::addClip( Clip *clip )
 {
     bool    ret = MediaContainer::addClip( clip );
     if ( ret != false )
+    {
         setCleanState( false );
+        if ( clip->isRootClip() == true )
+        {
+            Media*  media = clip->getMedia();
+            connect( media, SIGNAL( metaDataComputed() ), this, SLOT( mediaAnalyzed() ), Qt::QueuedConnection );
+            connect( media, SIGNAL( keyframesComputed() ), this, SLOT( mediaAnalyzed() ), Qt::QueuedConnection );
+            //The media is deleted right after this, so this can't be queued.
+            connect( clip, SIGNAL( unloaded( Clip* ) ), this, SLOT( clipUnloaded( Clip* ) ), Qt::DirectConnection );
+            if ( media->source()->isParsed() == true )
+                checkProxy( media );
+        }
+    }
     return ret;
 }
 
@@ -166,3 +205,91 @@ Library::setCleanState( bool newState )
         emit cleanStateChanged( newState );
     }
 }
+
+void
+Library::checkProxy( Media* media )
+{
+    if ( VLMC_PROJECT_GET_BOOL( "video/UseProxies" ) == false || media->hasProxy() == true ||
+         m_proxyQueue.contains( media ) == true )
+        return ;
+    if ( media->needsProxy( VLMC_PROJECT_GET_UINT( "video/ProxyHeight" ) ) == false )
+        return ;
+    m_proxyQueue.enqueue( media );
+    if ( m_proxyTranscoder == NULL )
+        generateNextProxy();
+}
+
+void
+Library::generateNextProxy()
+{
+    while ( m_proxyQueue.isEmpty() == false )
+    {
+        Media*  media = m_proxyQueue.dequeue();
+        //The media may have been removed meanwhile.
+        if ( media == NULL || media->hasProxy() == true )
+            continue ;
+        m_proxyTranscoder = new Transcoder( media );
+        m_proxyTranscoder->setParent( this );
+        m_proxyMedia = media;
+        connect( m_proxyTranscoder, SIGNAL( done() ), this, SLOT( proxyGenerated() ) );
+        if ( m_proxyTranscoder->generateProxy( VLMC_PROJECT_GET_UINT( "video/ProxyHeight" ) ) == true )
+            return ;
+        //Without a workspace, none of them can be generated.
+        delete m_proxyTranscoder;
+        m_proxyTranscoder = NULL;
+        m_proxyMedia = NULL;
+        m_proxyQueue.clear();
+    }
+}
+
+void
+Library::cancelProxy()
+{
+    if ( m_proxyTranscoder == NULL )
+        return ;
+    m_proxyTranscoder->cancel();
+    delete m_proxyTranscoder;
+    m_proxyTranscoder = NULL;
+    m_proxyMedia = NULL;
+}
+
+void
+Library::mediaAnalyzed()
+{
+    Media*  media = qobject_cast<Media*>( sender() );
+    if ( media != NULL && media->source()->isParsed() == true )
+        checkProxy( media );
+}
+
+void
+Library::clipUnloaded( Clip* clip )
+{
+    //The transcoder still uses the media, stop it before the media gets deleted.
+    if ( m_proxyTranscoder == NULL || clip->getMedia() != m_proxyMedia )
+        return ;
+    cancelProxy();
+    generateNextProxy();
+}
+
+void
+Library::proxyGenerated()
+{
+    if ( m_proxyTranscoder == NULL )
+        return ;
+    //The proxy will be saved along with the project.
+    setCleanState( false );
+    //We're being called from it.
+    m_proxyTranscoder->deleteLater();
+    m_proxyTranscoder = NULL;
+    m_proxyMedia = NULL;
+    generateNextProxy();
+}
+
+void
+Library::useProxiesChanged( const QVariant& useProxies )
+{
+    if ( useProxies.toBool() == false )
+        return ;
+    foreach ( Clip* clip, m_clips.values() )
+        checkProxy( clip->getMedia() );
+}
@@ -34,6 +34,8 @@
 #include "Project/ILoadSave.h"
 
 #include <QObject>
+#include <QPointer>
+#include <QQueue>
 #include <QXmlStreamWriter>
 
 class   QDomElement;
@@ -41,6 +43,7 @@ class   QDomElement;
 class Clip;
 class Media;
 class ProjectManager;
+class Transcoder;
 class Workspace;
 
 /**
@@ -54,7 +57,7 @@ class Library : public MediaContainer, public ILoadSave
 
 public:
     Library(Workspace* workspace);
-    virtual ~Library(){}
+    virtual ~Library();
     virtual void    addMedia( Media* media );
     virtual Media   *addMedia( const QFileInfo &fileInfo );
     virtual bool    addClip( Clip *clip );
@@ -64,15 +67,32 @@ private:
     void            setCleanState( bool newState );
     virtual bool    load( const QDomDocument& project );
     virtual bool    save( QXmlStreamWriter& project );
+    /**
+     *  \brief  Queue the generation of a proxy for this media if it needs one.
+     */
+    void            checkProxy( Media* media );
+    void            generateNextProxy();
+    /**
+     *  \brief  Stop generating the current proxy, synchronously.
+     */
+    void            cancelProxy();
 
 private:
     QAtomicInt  m_nbMediaToLoad;
     bool        m_cleanState;
     Workspace*  m_workspace;
+    /// The proxies are generated one at a time, in the background.
+    QQueue<QPointer<Media> >    m_proxyQueue;
+    Transcoder*                 m_proxyTranscoder;
+    Media*                      m_proxyMedia;
 
 
 private slots:
     void    mediaLoaded( const Media* m );
+    void    mediaAnalyzed();
+    void    clipUnloaded( Clip* clip );
+    void    proxyGenerated();
+    void    useProxiesChanged( const QVariant& useProxies );
 
 signals:
     /**
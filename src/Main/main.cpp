@@ -32,9 +32,9 @@
 #include "Workflow/Types.h"
 #include "Renderer/ConsoleRenderer.h"
 #include "Project/Project.h"
-#include "Project/Project.h"
 #include "Backend/IBackend.h"
 #include "Main/Core.h"
+#include "Tools/VlmcLogger.h"
 
 #include "Gui/MainWindow.h"
 #include "Gui/IntroDialog.h"
@@ -46,6 +46,7 @@
 #include <QFile>
 #include <QPalette>
 #include <QSettings>
+#include <QStringList>
 #include <QUuid>
 
 #ifdef Q_WS_X11
@@ -172,21 +173,37 @@ VLMCCoremain( int argc, char **argv )
 
     Backend::IBackend* backend;
     VLMCmainCommon( app, &backend );
+    //Keep stdout for the progress.
+    Core::getInstance()->logger()->setConsoleOutput( stderr );
 
-    /* Load a project file */
-    if ( app.arguments().count() < 3 )
+#ifndef WITH_GUI
+    QString     projectFileName;
+    QString     outputFileName;
+    const QStringList   args = app.arguments();
+    for ( int i = 1; i + 1 < args.count(); ++i )
     {
-        vlmcCritical() << "Usage: ./vlmc project.vlmc output_file";
-        return 1;
+        if ( args[i] == "--render" || args[i] == "-r" )
+            projectFileName = args[++i];
+        else if ( args[i] == "--output" || args[i] == "-o" )
+            outputFileName = args[++i];
+    }
+    if ( projectFileName.isEmpty() == true || outputFileName.isEmpty() == true )
+    {
+        vlmcCritical() << "Usage: vlmc --render project.vlmc --output output_file";
+        vlmcCritical() << "The output format is picked from its extension:"
+                       << ConsoleRenderer::supportedExtensions().join( ", " );
+        return ConsoleRenderer::InvalidArguments;
+    }
+    if ( ConsoleRenderer::isSupportedOutput( outputFileName ) == false )
+    {
+        vlmcCritical() << "Unsupported output format" << outputFileName << ", use one of:"
+                       << ConsoleRenderer::supportedExtensions().join( ", " );
+        return ConsoleRenderer::InvalidArguments;
     }
 
-
-#ifndef WITH_GUI
-    ConsoleRenderer renderer;
-    ProjectManager  *pm = Project::getInstance();
-
-    QCoreApplication::connect( pm, SIGNAL( projectLoaded() ), &renderer, SLOT( startRender() ) );
-    pm->loadProject( app.arguments()[1] );
+    ConsoleRenderer renderer( backend, outputFileName );
+    if ( renderer.render( projectFileName ) == false )
+        return ConsoleRenderer::ProjectLoadFailed;
 #endif
     return app.exec();
 }
@@ -43,8 +43,6 @@ int VLMCmain( int , char** );
     #ifdef WITH_CRASHHANDLER_GUI
         #include "Gui/widgets/CrashHandler.h"
     #endif
-#else
-    #include "ProjectManager.h"
 #endif
 
 void
@@ -26,7 +26,10 @@
   * It's used by the Library
   */
 
+#include <QDomElement>
+#include <QStringList>
 #include <QUrl>
+#include <QtAlgorithms>
 
 #include "Media.h"
 
@@ -55,10 +58,17 @@ const QString   Media::streamPrefix = "stream://";
 
 QPixmap*        Media::defaultSnapshot = NULL;
 
+/// Past this many pixels, a video is too heavy to be decoded along others.
+static const quint64    MaxDirectPixels = 1920 * 1088;
+/// Past this mean keyframe interval, in milliseconds, seeking gets too slow.
+static const qint64     MaxDirectKeyframeInterval = 1000;
+
 Media::Media(const QString &path )
     : m_source( NULL )
     , m_fileInfo( NULL )
     , m_baseClip( NULL )
+    , m_keyframesScannedLength( -1 )
+    , m_proxySource( NULL )
     , m_snapshotImage( NULL )
 {
     setFilePath( path );
@@ -67,6 +77,7 @@ Media::Media(const QString &path )
 Media::~Media()
 {
     delete m_source;
+    delete m_proxySource;
     delete m_fileInfo;
 }
 
@@ -111,6 +122,181 @@ Media::source() const
     return m_source;
 }
 
+void
+Media::LatencyStats::add( qint64 latency )
+{
+    if ( count == 0 )
+    {
+        average = latency;
+        deviation = latency / 2;
+    }
+    else
+    {
+        deviation = ( deviation * 3 + qAbs( latency - average ) ) / 4;
+        average = ( average * 3 + latency ) / 4;
+    }
+    ++count;
+}
+
+qint64
+Media::LatencyStats::estimate() const
+{
+    if ( count == 0 )
+        return -1;
+    return average + 2 * deviation;
+}
+
+void
+Media::addStartupLatency( qint64 latency )
+{
+    QMutexLocker    lock( &m_latencyLock );
+    m_startupLatency.add( latency );
+}
+
+void
+Media::addSeekLatency( qint64 latency )
+{
+    QMutexLocker    lock( &m_latencyLock );
+    m_seekLatency.add( latency );
+}
+
+qint64
+Media::startupLatency() const
+{
+    QMutexLocker    lock( &m_latencyLock );
+    return m_startupLatency.estimate();
+}
+
+qint64
+Media::seekLatency() const
+{
+    QMutexLocker    lock( &m_latencyLock );
+    return m_seekLatency.estimate();
+}
+
+void
+Media::setKeyframes( const QVector<qint64>& keyframes, qint64 scannedLength )
+{
+    {
+        QMutexLocker    lock( &m_keyframesLock );
+        m_keyframes = keyframes;
+        m_keyframesScannedLength = scannedLength;
+    }
+    emit keyframesComputed();
+}
+
+bool
+Media::hasKeyframes() const
+{
+    QMutexLocker    lock( &m_keyframesLock );
+    return m_keyframes.isEmpty() == false;
+}
+
+qint64
+Media::keyframeBefore( qint64 time ) const
+{
+    QMutexLocker    lock( &m_keyframesLock );
+    if ( m_keyframes.isEmpty() == true )
+        return -1;
+    //There may be a keyframe we don't know of in between.
+    if ( m_keyframesScannedLength >= 0 && time > m_keyframesScannedLength )
+        return -1;
+    QVector<qint64>::const_iterator     it = qUpperBound( m_keyframes.begin(), m_keyframes.end(), time );
+    //The decoding can always start from the beginning.
+    if ( it == m_keyframes.begin() )
+        return 0;
+    return *( it - 1 );
+}
+
+void
+Media::saveKeyframes( QXmlStreamWriter& project ) const
+{
+    QMutexLocker    lock( &m_keyframesLock );
+    if ( m_keyframes.isEmpty() == true )
+        return ;
+    QStringList     times;
+    foreach ( qint64 time, m_keyframes )
+        times << QString::number( time );
+    project.writeStartElement( "keyframes" );
+    if ( m_keyframesScannedLength >= 0 )
+        project.writeAttribute( "scannedLength", QString::number( m_keyframesScannedLength ) );
+    project.writeCharacters( times.join( " " ) );
+    project.writeEndElement();
+}
+
+void
+Media::loadKeyframes( const QDomElement& media )
+{
+    const QDomElement   keyframes = media.firstChildElement( "keyframes" );
+    if ( keyframes.isNull() == true )
+        return ;
+    QVector<qint64>     times;
+    bool                valid;
+    const qint64        scannedLength = keyframes.attribute( "scannedLength", "-1" ).toLongLong( &valid );
+    if ( valid == false )
+    {
+        vlmcWarning() << "Ignoring the invalid keyframes of" << m_mrl;
+        return ;
+    }
+    foreach ( const QString& time, keyframes.text().split( ' ', QString::SkipEmptyParts ) )
+    {
+        bool    ok;
+        qint64  value = time.toLongLong( &ok );
+        if ( ok == false || ( times.isEmpty() == false && value <= times.last() ) )
+        {
+            vlmcWarning() << "Ignoring the invalid keyframes of" << m_mrl;
+            return ;
+        }
+        times.append( value );
+    }
+    setKeyframes( times, scannedLength );
+}
+
+bool
+Media::needsProxy( quint32 proxyHeight ) const
+{
+    if ( m_fileType != Video || m_source->height() <= proxyHeight )
+        return false;
+    if ( (quint64)m_source->width() * m_source->height() > MaxDirectPixels )
+        return true;
+    QMutexLocker    lock( &m_keyframesLock );
+    if ( m_keyframes.size() < 2 )
+        return false;
+    const qint64    interval = ( m_keyframes.last() - m_keyframes.first() ) / ( m_keyframes.size() - 1 );
+    return interval > MaxDirectKeyframeInterval;
+}
+
+void
+Media::setProxy( const QString& path )
+{
+    Backend::ISource*   source = Backend::getBackend()->createSource( qPrintable( path ) );
+    QMutexLocker        lock( &m_proxyLock );
+    delete m_proxySource;
+    m_proxySource = source;
+    m_proxyPath = path;
+}
+
+bool
+Media::hasProxy() const
+{
+    QMutexLocker    lock( &m_proxyLock );
+    return m_proxySource != NULL;
+}
+
+QString
+Media::proxyPath() const
+{
+    QMutexLocker    lock( &m_proxyLock );
+    return m_proxyPath;
+}
+
+Backend::ISource*
+Media::proxySource()
+{
+    QMutexLocker    lock( &m_proxyLock );
+    return m_proxySource;
+}
+
 void
 Media::setBaseClip( Clip *clip )
 {
@@ -33,6 +33,8 @@
 #include <QString>
 #include <QObject>
 #include <QFileInfo>
+#include <QMutex>
+#include <QVector>
 #include <QXmlStreamWriter>
 
 #ifdef WITH_GUI
@@ -45,6 +47,7 @@ namespace Backend
     class   ISource;
 }
 class Clip;
+class QDomElement;
 
 /**
   * Represents a basic container for media informations.
@@ -100,6 +103,65 @@ public:
     // This has to be called from the GUI thread.
     QPixmap&                    snapshot();
 
+    /**
+     *  \brief  Record how long a renderer of this media took to output its
+     *          first frame, in microseconds.
+     */
+    void                        addStartupLatency( qint64 latency );
+    /**
+     *  \brief  Record how long a renderer of this media took to output a frame
+     *          after being asked to seek, in microseconds.
+     */
+    void                        addSeekLatency( qint64 latency );
+    /**
+     *  \returns    A pessimistic estimate of the startup latency, in microseconds,
+     *              or -1 if none was recorded yet.
+     */
+    qint64                      startupLatency() const;
+    qint64                      seekLatency() const;
+
+    /**
+     *  \brief  Set the times of the keyframes, in milliseconds, by ascending order.
+     *
+     *  \param  scannedLength   The time up to which the keyframes are known, in
+     *                          milliseconds, or -1 if they're known for the whole media.
+     */
+    void                        setKeyframes( const QVector<qint64>& keyframes,
+                                              qint64 scannedLength = -1 );
+    bool                        hasKeyframes() const;
+    /**
+     *  \returns    The time of the last keyframe up to time, in milliseconds,
+     *              or -1 if the keyframes aren't known up to time.
+     */
+    qint64                      keyframeBefore( qint64 time ) const;
+    void                        saveKeyframes( QXmlStreamWriter& project ) const;
+    /**
+     *  \brief  Restore the keyframes saved in the media element of a project.
+     */
+    void                        loadKeyframes( const QDomElement& media );
+
+    /**
+     *  \brief  Tells if this media is heavy enough to be previewed from a proxy.
+     *
+     *  This is the case of the videos taller than proxyHeight which are either
+     *  larger than 1080p, or only have a keyframe every now and then.
+     *  \warning    The metadata have to be computed.
+     */
+    bool                        needsProxy( quint32 proxyHeight ) const;
+    /**
+     *  \brief  Use the given file as a low resolution copy of this media.
+     *
+     *  The proxy is expected to be intra only, and to have the same duration
+     *  and frame rate as the original.
+     */
+    void                        setProxy( const QString& path );
+    bool                        hasProxy() const;
+    QString                     proxyPath() const;
+    /**
+     *  \returns    The source of the proxy, or NULL if there is none.
+     */
+    Backend::ISource*           proxySource();
+
 protected:
     Backend::ISource*           m_source;
     QString                     m_mrl;
@@ -108,12 +170,38 @@ protected:
     QString                     m_fileName;
     Clip*                       m_baseClip;
 
+    /**
+     *  Moving average and average deviation of a latency, both in microseconds.
+     */
+    struct  LatencyStats
+    {
+        LatencyStats() : average( 0 ), deviation( 0 ), count( 0 ) {}
+        void        add( qint64 latency );
+        qint64      estimate() const;
+
+        qint64      average;
+        qint64      deviation;
+        quint32     count;
+    };
+    mutable QMutex              m_latencyLock;
+    LatencyStats                m_startupLatency;
+    LatencyStats                m_seekLatency;
+    /// Computed in the background by the MetaDataManager, or loaded with the project.
+    QVector<qint64>             m_keyframes;
+    /// Where the keyframes stop being known, or -1 if they're known everywhere.
+    qint64                      m_keyframesScannedLength;
+    mutable QMutex              m_keyframesLock;
+    QString                     m_proxyPath;
+    Backend::ISource*           m_proxySource;
+    mutable QMutex              m_proxyLock;
+
     static QPixmap*             defaultSnapshot;
     QPixmap                     m_snapshot;
     QImage*                     m_snapshotImage;
 
 signals:
     void                        metaDataComputed();
+    void                        keyframesComputed();
     void                        snapshotAvailable();
 };
 
@@ -20,6 +20,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 
+#include <QCryptographicHash>
+#include <QFile>
 #include <QFileInfo>
 
 #include "Transcoder.h"
@@ -28,18 +30,29 @@
 #include "Backend/ISourceRenderer.h"
 #include "Media/Media.h"
 #include "Metadata/MetaDataManager.h"
-#include "Gui/widgets/NotificationZone.h"
 #include "Settings/Settings.h"
 #include "Tools/RendererEventWatcher.h"
+#include "Tools/VlmcDebug.h"
+
+#ifdef WITH_GUI
+# include "Gui/widgets/NotificationZone.h"
+#endif
+
+/// The proxies only have to be good enough for the preview.
+static const unsigned int   ProxyVideoBitrate = 2000;
+static const unsigned int   ProxyAudioBitrate = 128;
 
 Transcoder::Transcoder( Media* media )
     : m_media( media )
+    , m_proxy( false )
     , m_renderer( NULL )
 {
+#ifdef WITH_GUI
     connect( this, SIGNAL( notify( QString ) ),
              NotificationZone::getInstance(), SLOT( notify( QString ) ) );
     connect( this, SIGNAL( progress( float ) ),
              NotificationZone::getInstance(), SLOT( progressUpdated( float ) ) );
+#endif
     m_eventWatcher = new RendererEventWatcher;
 }
 
@@ -49,17 +62,38 @@ Transcoder::~Transcoder()
     delete m_eventWatcher;
 }
 
+QString
+Transcoder::destinationFile( const QString& suffix ) const
+{
+    QString             outputDir = VLMC_GET_STRING( "vlmc/Workspace" );
+
+    if ( outputDir.length() == 0 )
+        outputDir = m_media->fileInfo()->absolutePath();
+    return outputDir + '/' + m_media->fileInfo()->baseName() + suffix;
+}
+
+QString
+Transcoder::proxyFile() const
+{
+    const QString       workspace = VLMC_GET_STRING( "vlmc/Workspace" );
+
+    if ( workspace.isEmpty() == true )
+        return QString();
+    //Medias from different folders may have the same name.
+    const QByteArray    hash = QCryptographicHash::hash(
+                m_media->fileInfo()->absoluteFilePath().toUtf8(), QCryptographicHash::Sha1 );
+    return workspace + '/' + QString::fromLatin1( hash.toHex() ) + ".proxy.ps";
+}
+
 void
 Transcoder::transcodeToPs()
 {
-    QString             outputDir = VLMC_GET_STRING( "vlmc/Workspace" );
     Backend::ISource*   source = m_media->source();
     delete m_renderer;
     m_renderer = source->createRenderer( m_eventWatcher );
 
-    if ( outputDir.length() == 0 )
-        outputDir = m_media->fileInfo()->absolutePath();
-    m_destinationFile = outputDir + '/' + m_media->fileInfo()->baseName() + ".ps";
+    m_proxy = false;
+    m_destinationFile = destinationFile( ".ps" );
     m_renderer->setOutputFile( qPrintable( m_destinationFile ) );
     m_renderer->setName( qPrintable( QString( "Transcoder " ) + m_media->fileInfo()->baseName() ) );
     connect( m_eventWatcher, SIGNAL( positionChanged( float ) ), this, SIGNAL( progress( float ) ) );
@@ -68,9 +102,62 @@ Transcoder::transcodeToPs()
     m_renderer->start();
 }
 
+bool
+Transcoder::generateProxy( quint32 height )
+{
+    const QString       destination = proxyFile();
+    if ( destination.isEmpty() == true )
+    {
+        vlmcWarning() << "No workspace to generate the proxy of" << m_media->fileInfo()->absoluteFilePath() << "in";
+        return false;
+    }
+    Backend::ISource*   source = m_media->source();
+    delete m_renderer;
+    m_renderer = source->createRenderer( m_eventWatcher );
+
+    m_proxy = true;
+    m_destinationFile = destination;
+    m_renderer->setOutputFile( qPrintable( m_destinationFile ) );
+    m_renderer->setOutputVideoCodec( "mp2v" );
+    m_renderer->setOutputHeight( height );
+    m_renderer->setOutputVideoBitrate( ProxyVideoBitrate );
+    //Intra frames only, so that any frame can be seeked to right away.
+    m_renderer->setOutputKeyframeInterval( 1 );
+    m_renderer->setOutputAudioCodec( "mpga" );
+    m_renderer->setOutputAudioBitrate( ProxyAudioBitrate );
+    m_renderer->setName( qPrintable( QString( "Proxy " ) + m_media->fileInfo()->baseName() ) );
+    connect( m_eventWatcher, SIGNAL( positionChanged( float ) ), this, SIGNAL( progress( float ) ) );
+    connect( m_eventWatcher, SIGNAL( endReached() ), this, SLOT( transcodeFinished() ) );
+    emit notify( "Generating a proxy of " + m_media->fileInfo()->absoluteFilePath() );
+    m_renderer->start();
+    return true;
+}
+
+void
+Transcoder::cancel()
+{
+    if ( m_renderer == NULL )
+        return ;
+    m_eventWatcher->disconnect( this );
+    //This stops it.
+    delete m_renderer;
+    m_renderer = NULL;
+    QFile::remove( m_destinationFile );
+}
+
 void
 Transcoder::transcodeFinished()
 {
+    //An end of stream queued before we got cancelled.
+    if ( m_renderer == NULL )
+        return ;
+    if ( m_proxy == true )
+    {
+        m_media->setProxy( m_destinationFile );
+        emit done();
+        emit notify( m_media->fileInfo()->fileName() + ": Proxy generated" );
+        return ;
+    }
     m_media->setFilePath( m_destinationFile );
     MetaDataManager::getInstance()->computeMediaMetadata( m_media );
     emit done();
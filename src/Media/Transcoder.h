@@ -41,10 +41,32 @@ class Transcoder : public QObject
         explicit    Transcoder( Media *media );
         ~Transcoder();
         void        transcodeToPs();
+        /**
+         *  \brief  Generate a low resolution, intra only copy of the media, to be
+         *          used as its proxy once done.
+         *
+         *  The proxy goes to the workspace, named after the path of the media.
+         *
+         *  \param  height  The height of the proxy. The width follows the aspect ratio.
+         *  \returns    false if there's no workspace to put the proxy in.
+         */
+        bool        generateProxy( quint32 height );
+        /**
+         *  \brief  Stop transcoding, and remove what was transcoded so far.
+         *
+         *  done() won't be emitted anymore. This must be called before the media
+         *  gets deleted.
+         */
+        void        cancel();
+
+    private:
+        QString     destinationFile( const QString& suffix ) const;
+        QString     proxyFile() const;
 
     private:
         Media*                      m_media;
         QString                     m_destinationFile;
+        bool                        m_proxy;
         Backend::ISourceRenderer*   m_renderer;
         RendererEventWatcher*       m_eventWatcher;
 
@@ -21,18 +21,46 @@
  *****************************************************************************/
 
 #include <QMutexLocker>
+#include <QVector>
 
 #include "Backend/ISource.h"
 #include "Media/Media.h"
 #include "MetaDataManager.h"
+#include "Tools/VlmcDebug.h"
+
+class   MetaDataManager::KeyframeScanThread : public QThread
+{
+    public:
+        KeyframeScanThread( MetaDataManager* manager ) :
+            m_manager( manager )
+        {
+        }
+
+    protected:
+        virtual void    run()
+        {
+            m_manager->scanPendingKeyframes();
+        }
+
+    private:
+        MetaDataManager*    m_manager;
+};
 
 MetaDataManager::MetaDataManager()
     : m_computeInProgress( false )
+    , m_scanInProgress( false )
 {
+    m_scanThread = new KeyframeScanThread( this );
 }
 
 MetaDataManager::~MetaDataManager()
 {
+    {
+        QMutexLocker    lock( &m_computingMutex );
+        m_mediaToScan.clear();
+    }
+    m_scanThread->wait();
+    delete m_scanThread;
 }
 
 void
@@ -64,6 +92,62 @@ MetaDataManager::run()
         if ( targetSource->preparse() == false )
             emit failedToCompute( target );
         else
+        {
             target->onMetaDataComputed();
+            //The keyframes may have been loaded with the project.
+            if ( target->fileType() == Media::Video && target->hasKeyframes() == false )
+            {
+                QMutexLocker    lock( &m_computingMutex );
+                m_mediaToScan.enqueue( target );
+                if ( m_scanInProgress == false )
+                {
+                    m_scanInProgress = true;
+                    //The previous run may still be returning.
+                    m_scanThread->wait();
+                    m_scanThread->start();
+                }
+            }
+        }
+    }
+}
+
+void
+MetaDataManager::scanPendingKeyframes()
+{
+    while ( true )
+    {
+        Media*  target;
+        {
+            QMutexLocker    lock( &m_computingMutex );
+            if ( m_mediaToScan.isEmpty() == true )
+            {
+                m_scanInProgress = false;
+                return;
+            }
+            target = m_mediaToScan.dequeue();
+        }
+        //The media may have been removed meanwhile.
+        if ( target != NULL )
+            scanKeyframes( target );
+    }
+}
+
+void
+MetaDataManager::scanKeyframes( Media *media )
+{
+    if ( media->hasKeyframes() == true )
+        return ;
+    std::vector<int64_t>    keyframes;
+    int64_t                 scannedLength;
+    if ( media->source()->scanKeyframes( keyframes, scannedLength ) == false )
+    {
+        vlmcWarning() << "Failed to scan" << media->mrl() << "for keyframes";
+        return ;
     }
+    const bool              complete = scannedLength >= media->source()->length();
+    if ( complete == false )
+        vlmcWarning() << "Only scanned" << media->mrl() << "for keyframes up to" << scannedLength << "ms";
+    media->setKeyframes( QVector<qint64>::fromStdVector(
+                             std::vector<qint64>( keyframes.begin(), keyframes.end() ) ),
+                         complete == true ? -1 : scannedLength );
 }
@@ -26,6 +26,7 @@
 #include <QThread>
 #include <QQueue>
 #include <QMutex>
+#include <QPointer>
 
 #include "Tools/Singleton.hpp"
 
@@ -49,10 +50,24 @@ class MetaDataManager : public QThread, public Singleton<MetaDataManager>
     protected:
         virtual void            run();
 
+    private:
+        class                   KeyframeScanThread;
+
+        /// Run by the KeyframeScanThread, until m_mediaToScan is empty.
+        void                    scanPendingKeyframes();
+        void                    scanKeyframes( Media* media );
+
     private:
         QMutex                  m_computingMutex;
         QQueue<Media*>          m_mediaToCompute;
+        /**
+         *  Scanned for keyframes on their own thread, as this takes much longer
+         *  than computing the metadata of the media imported meanwhile.
+         */
+        QQueue<QPointer<Media> >    m_mediaToScan;
         bool                    m_computeInProgress;
+        bool                    m_scanInProgress;
+        KeyframeScanThread      *m_scanThread;
         LibVLCpp::MediaPlayer   *m_mediaPlayer;
         friend class            Singleton<MetaDataManager>;
 
@@ -34,6 +34,7 @@
 #include "RecentProjects.h"
 #include "Settings/Settings.h"
 #include "Workflow/MainWorkflow.h"
+#include "Workflow/RenderCache.h"
 
 #include "Tools/VlmcDebug.h"
 
@@ -45,6 +46,7 @@
 
 const QString   Project::unNamedProject = Project::tr( "Untitled Project" );
 const QString   Project::backupSuffix = "~";
+const QString   Project::renderCacheSuffix = ".rendercache";
 
 Project::Project()
     : m_projectFile( NULL )
@@ -118,9 +120,7 @@ Project::load( const QString& fileName )
     // Now let's start over with a clean state.
     self = getInstance();
     Core::getInstance()->onProjectLoaded( self );
-    self->loadProject( fileName );
-
-    return true;
+    return self->loadProject( fileName );
 }
 
 bool
@@ -168,6 +168,8 @@ Project::loadProject( const QString &fileName )
         m_projectFile = NULL;
         m_isClean = false;
     }
+    //Even when restoring a backup, the frames rendered for the project still apply.
+    m_workflow->renderCache()->open( fileName + Project::renderCacheSuffix );
 
     foreach (ILoadSave* listener, m_loadSave)
         if ( listener->load( doc ) == false )
@@ -185,6 +187,7 @@ Project::newProject( const QString &projectName, const QString& projectPath )
     m_projectName = projectName;
     //Current project file has already been delete/nulled by closeProject()
     m_projectFile = new QFile( projectPath + "/project.vlmc" );
+    m_workflow->renderCache()->open( m_projectFile->fileName() + Project::renderCacheSuffix );
     save();
     emit projectLoaded( projectName, m_projectFile->fileName() );
 }
@@ -196,6 +199,8 @@ Project::connectComponents()
              this, SLOT( libraryCleanChanged( bool ) ) );
     connect( m_undoStack, SIGNAL( cleanChanged( bool ) ), this, SLOT( cleanChanged( bool ) ) );
     connect( this, SIGNAL( projectSaved() ), m_undoStack, SLOT( setClean() ) );
+    connect( m_settings->value( "video/UseProxies" ), SIGNAL( changed( QVariant ) ),
+             m_library, SLOT( useProxiesChanged( QVariant ) ) );
     //We have to wait for the library to be loaded before loading the workflow
     //FIXME
     //connect( Project::getInstance()->library(), SIGNAL( projectLoaded() ), this, SLOT( loadWorkflow() ) );
@@ -293,6 +298,60 @@ Project::initSettings()
                              QT_TRANSLATE_NOOP( "PreferenceWidget", "Height resolution of the output video" ),
                              SettingValue::Clamped | SettingValue::EightMultiple );
     height->setLimits( 32, 2048 );
+    SettingValue    *frameBudget = m_settings->createVar( SettingValue::Int, "video/FrameMemoryBudget", 512,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Frame memory budget" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Maximum amount of memory, in MB, used to decode frames ahead" ),
+                             SettingValue::Clamped );
+    frameBudget->setLimits( 64, 16384 );
+    SettingValue    *preloadMargin = m_settings->createVar( SettingValue::Int, "video/PreloadMargin", 500,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Clip preload margin" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "How long, in ms, an upcoming clip should be ready before it is displayed" ),
+                             SettingValue::Clamped );
+    preloadMargin->setLimits( 0, 10000 );
+    SettingValue    *rendererPoolSize = m_settings->createVar( SettingValue::Int, "video/RendererPoolSize", 8,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Idle decoders" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "How many decoders of stopped clips are kept ready for reuse" ),
+                             SettingValue::Clamped );
+    rendererPoolSize->setLimits( 0, 64 );
+    SettingValue    *scrubCacheSize = m_settings->createVar( SettingValue::Int, "video/ScrubCacheSize", 256,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Scrub cache size" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "How much memory, in MB, the rendered frames may use to speed up the timeline navigation" ),
+                             SettingValue::Clamped );
+    scrubCacheSize->setLimits( 0, 4096 );
+    SettingValue    *renderCacheSize = m_settings->createVar( SettingValue::Int, "video/RenderCacheSize", 4096,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Render cache size" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "How much disk space, in MB, the ranges rendered to the cache may use" ),
+                             SettingValue::Clamped );
+    renderCacheSize->setLimits( 0, 65536 );
+    SettingValue    *renderAhead = m_settings->createVar( SettingValue::Int, "video/RenderAheadFrames", 8,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Frames composited ahead" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "How many frames are composited ahead of the one being played. 0 composites them as they are played" ),
+                             SettingValue::Clamped );
+    renderAhead->setLimits( 0, 64 );
+    SettingValue    *prerollFrames = m_settings->createVar( SettingValue::Int, "video/PrerollFrames", 4,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Preroll frames" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "How many frames each clip has to decode before a render or a preview starts" ),
+                             SettingValue::Clamped );
+    prerollFrames->setLimits( 1, 32 );
+    SettingValue    *prerollTimeout = m_settings->createVar( SettingValue::Int, "video/PrerollTimeout", 10000,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Preroll timeout" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "How long, in milliseconds, a render waits for the clips to be ready before starting anyway" ),
+                             SettingValue::Clamped );
+    prerollTimeout->setLimits( 100, 60000 );
+    SettingValue    *exportSegments = m_settings->createVar( SettingValue::Int, "video/ExportSegments", 1,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Export segments" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "How many parts of the timeline are exported at the same time, each on its own pipeline. Only used for MPEG-PS and MPEG-TS outputs" ),
+                             SettingValue::Clamped );
+    exportSegments->setLimits( 1, 64 );
+    m_settings->createVar( SettingValue::Bool, "video/UseProxies", false,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Use proxies" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Generate low resolution copies of the heavy medias, and preview them instead of the originals" ),
+                             SettingValue::Nothing );
+    SettingValue    *proxyHeight = m_settings->createVar( SettingValue::Int, "video/ProxyHeight", 360,
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Proxy height" ),
+                             QT_TRANSLATE_NOOP( "PreferenceWidget", "Height resolution of the generated proxies" ),
+                             SettingValue::Clamped | SettingValue::EightMultiple );
+    proxyHeight->setLimits( 144, 1080 );
     m_settings->createVar( SettingValue::String, "video/AspectRatio", "16/9",
                                 QT_TRANSLATE_NOOP("PreferenceWidget", "Video aspect ratio" ),
                                 QT_TRANSLATE_NOOP("PreferenceWidget", "The rendered video aspect ratio" ),
@@ -50,6 +50,7 @@ class Project : public QObject, public Singleton<Project>
     public:
         static const QString            unNamedProject;
         static const QString            backupSuffix;
+        static const QString            renderCacheSuffix;
 
     public:
         // Main entry point for loading a project
@@ -184,5 +184,12 @@ Workspace::toAbsolutePath( const QString& path )
 QString
 Workspace::toWorkspacePath(const Media *media)
 {
-    return media->fileInfo()->absoluteFilePath().replace( m_workspaceDir, Workspace::workspacePrefix );
+    return toWorkspacePath( media->fileInfo()->absoluteFilePath() );
+}
+
+QString
+Workspace::toWorkspacePath( const QString& path )
+{
+    QString res = path;
+    return res.replace( m_workspaceDir, Workspace::workspacePrefix );
 }
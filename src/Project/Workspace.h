@@ -48,6 +48,7 @@ class Workspace : public QObject, public ErrorHandler
         bool                        isInWorkspace( const Media *media );
         QString                     toAbsolutePath( const QString &path );
         QString                     toWorkspacePath( const Media* media );
+        QString                     toWorkspacePath( const QString& path );
 
         bool                        copyToWorkspace( Media* media );
     private:
@@ -31,7 +31,9 @@
 #include "Library/Library.h"
 #include "Media/Media.h"
 #include "Workflow/MainWorkflow.h"
-#include "Gui/preview/RenderWidget.h"
+#ifdef WITH_GUI
+# include "Gui/preview/RenderWidget.h"
+#endif
 #include "VLCMediaPlayer.h"
 #include "VLCMedia.h"
 
@@ -91,7 +93,10 @@ ClipRenderer::startPreview()
 
     delete m_sourceRenderer;
     m_sourceRenderer = m_selectedClip->getMedia()->source()->createRenderer( m_eventWatcher );
-    m_sourceRenderer->setOutputWidget( (void *) static_cast< RenderWidget* >( m_renderWidget )->id() );
+#ifdef WITH_GUI
+    if ( m_renderWidget != NULL )
+        m_sourceRenderer->setOutputWidget( (void *) static_cast< RenderWidget* >( m_renderWidget )->id() );
+#endif
 
     connect( m_eventWatcher, SIGNAL( stopped() ), this, SLOT( videoStopped() ) );
     connect( m_eventWatcher, SIGNAL( paused() ),  this, SIGNAL( paused() ) );
@@ -1,5 +1,5 @@
 /*****************************************************************************
- * ConsoleRenderer.h: Handle the "server" mode rendering
+ * ConsoleRenderer.cpp: Handle the "server" mode rendering
  *****************************************************************************
  * Copyright (C) 2008-2010 VideoLAN
  *
@@ -17,49 +17,189 @@
  *
  * You should have received a copy of the GNU General Public License
  * along with this program; if not, write to the Free Software
- * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 
 #include "ConsoleRenderer.h"
 
+#include "Library/Library.h"
+#include "Main/Core.h"
+#include "Project/Project.h"
+#include "Settings/Settings.h"
+#include "Tools/RendererEventWatcher.h"
+#include "Tools/VlmcDebug.h"
+#include "Workflow/MainWorkflow.h"
 #include "WorkflowFileRenderer.h"
-#include "SettingsManager.h"
 
 #include <QCoreApplication>
-#include <QStringList>
+#include <QFileInfo>
+#include <QTextStream>
 
-ConsoleRenderer::ConsoleRenderer(QObject *parent) :
-    QObject(parent)
+#include <cstdio>
+
+/// The progress is printed at most this often, in milliseconds.
+static const int        ReportInterval = 1000;
+static const quint32    VideoBitrate = 4000;
+static const quint32    AudioBitrate = 256;
+
+/// The containers VLCSourceRenderer knows the extension of.
+static const char*      SupportedExtensions[] = { "mkv", "mp4", "mov", "ts", "mpg", "mpeg", "ps" };
+
+static QString
+jsonString( const QString& str )
 {
-    m_renderer = new WorkflowFileRenderer;
-    m_renderer->initializeRenderer();
-    m_outputFileName = qApp->arguments()[2];
-    m_width = VLMC_PROJECT_GET_UINT( "video/VideoProjectWidth" );
-    m_height = VLMC_PROJECT_GET_UINT( "video/VideoProjectHeight" );
-    m_fps = VLMC_PROJECT_GET_DOUBLE( "video/VLMCOutputFPS" );
-    m_vbitrate = 4000;
-    m_abitrate = 256;
-    connect( m_renderer, SIGNAL( frameChanged( qint64 ) ),
-             this, SLOT( frameChanged( qint64 ) ) );
-    connect( m_renderer, SIGNAL( renderComplete() ), qApp, SLOT( quit() ) );
+    QString     ret = str;
+    ret.replace( '\\', "\\\\" ).replace( '"', "\\\"" ).replace( '\n', "\\n" );
+    return '"' + ret + '"';
 }
 
-void
-ConsoleRenderer::frameChanged( qint64 frame ) const
+ConsoleRenderer::ConsoleRenderer( Backend::IBackend* backend, const QString& outputFileName,
+                                  QObject *parent ) :
+    QObject( parent ),
+    m_backend( backend ),
+    m_renderer( NULL ),
+    m_outputFileName( outputFileName ),
+    m_length( 0 ),
+    m_lastReport( 0 ),
+    m_finished( false )
 {
-    static int      percent = 0;
-    int             newPercent;
+}
 
-    newPercent = frame * 100 / MainWorkflow::getInstance()->getLengthFrame();
-    if ( newPercent != percent )
+ConsoleRenderer::~ConsoleRenderer()
+{
+    delete m_renderer;
+}
+
+bool
+ConsoleRenderer::render( const QString& projectFileName )
+{
+    //The project is created from scratch when loading, so we have to catch the new
+    //library before it starts loading the medias.
+    connect( Core::getInstance(), SIGNAL( projectLoading( Project* ) ),
+             this, SLOT( projectLoading( Project* ) ), Qt::DirectConnection );
+    if ( Project::load( QFileInfo( projectFileName ).absoluteFilePath() ) == false )
     {
-        percent = newPercent;
-        qDebug().nospace() << percent << "%";
+        finish( ProjectLoadFailed, "Can't load project " + projectFileName );
+        return false;
     }
+    return true;
+}
+
+QStringList
+ConsoleRenderer::supportedExtensions()
+{
+    QStringList     ret;
+    for ( size_t i = 0; i < sizeof( SupportedExtensions ) / sizeof( SupportedExtensions[0] ); ++i )
+        ret << SupportedExtensions[i];
+    return ret;
+}
+
+bool
+ConsoleRenderer::isSupportedOutput( const QString& outputFileName )
+{
+    return supportedExtensions().contains( QFileInfo( outputFileName ).suffix().toLower() );
+}
+
+void
+ConsoleRenderer::projectLoading( Project* project )
+{
+    //Queued, as the library is loaded before the workflow.
+    connect( project->library(), SIGNAL( projectLoaded() ),
+             this, SLOT( startRender() ), Qt::QueuedConnection );
 }
 
 void
 ConsoleRenderer::startRender()
 {
-    m_renderer->run( m_outputFileName, m_width, m_height, m_fps, m_vbitrate, m_abitrate );
+    if ( m_renderer != NULL || m_finished == true )
+        return ;
+    MainWorkflow*   workflow = Project::getInstance()->workflow();
+    m_length = workflow->getLengthFrame();
+    if ( m_length <= 0 )
+    {
+        finish( NothingToRender, "There is nothing to render" );
+        return ;
+    }
+    m_renderer = new WorkflowFileRenderer( m_backend, workflow );
+    connect( m_renderer, SIGNAL( frameChanged( qint64 ) ),
+             this, SLOT( frameChanged( qint64 ) ) );
+    connect( m_renderer, SIGNAL( renderComplete() ), this, SLOT( renderComplete() ) );
+    connect( m_renderer->eventWatcher(), SIGNAL( errorEncountered() ),
+             this, SLOT( renderError() ) );
+
+    m_time.start();
+    m_lastReport = 0;
+    printProgress( "start", 0 );
+    m_renderer->run( m_outputFileName, VLMC_PROJECT_GET_UINT( "video/VideoProjectWidth" ),
+                     VLMC_PROJECT_GET_UINT( "video/VideoProjectHeight" ),
+                     VLMC_PROJECT_GET_DOUBLE( "video/VLMCOutputFPS" ),
+                     VideoBitrate, AudioBitrate );
+}
+
+void
+ConsoleRenderer::frameChanged( qint64 frame )
+{
+    if ( m_finished == true || m_time.elapsed() - m_lastReport < ReportInterval )
+        return ;
+    m_lastReport = m_time.elapsed();
+    printProgress( "progress", frame );
+}
+
+void
+ConsoleRenderer::renderComplete()
+{
+    if ( m_finished == true )
+        return ;
+    printProgress( "progress", m_length );
+    QFileInfo   output( m_outputFileName );
+    if ( output.exists() == false || output.size() == 0 )
+        finish( RenderFailed, "Nothing was written to " + m_outputFileName );
+    else
+        finish( Success, QString() );
+}
+
+void
+ConsoleRenderer::renderError()
+{
+    if ( m_finished == true )
+        return ;
+    m_renderer->stop();
+    finish( RenderFailed, "The renderer encountered an error" );
+}
+
+void
+ConsoleRenderer::printProgress( const char* event, qint64 frame )
+{
+    const int       elapsed = m_time.elapsed();
+    const double    fps = elapsed > 0 ? frame * 1000.0 / elapsed : 0.0;
+    const qint64    eta = fps > 0.0 ? qRound64( ( m_length - frame ) / fps ) : -1;
+    MainWorkflow*   workflow = Project::getInstance()->workflow();
+
+    QTextStream     out( stdout );
+    out << "{\"event\":\"" << event << "\",\"frame\":" << frame
+        << ",\"total\":" << m_length
+        << ",\"percent\":" << QString::number( m_length > 0 ? frame * 100.0 / m_length : 0.0, 'f', 1 )
+        << ",\"fps\":" << QString::number( fps, 'f', 2 )
+        << ",\"elapsed\":" << QString::number( elapsed / 1000.0, 'f', 1 )
+        << ",\"eta\":" << eta
+        << ",\"late\":" << workflow->nbLateFrames()
+        << ",\"dropped\":" << workflow->nbDroppedFrames() << "}\n";
+    out.flush();
+}
+
+void
+ConsoleRenderer::finish( ExitCode code, const QString& message )
+{
+    m_finished = true;
+    QTextStream     out( stdout );
+    out << "{\"event\":\"" << ( code == Success ? "complete" : "error" ) << "\",\"status\":" << code;
+    if ( message.isEmpty() == false )
+    {
+        vlmcCritical() << message;
+        out << ",\"message\":" << jsonString( message );
+    }
+    out << "}\n";
+    out.flush();
+    //When the project can't be loaded, the event loop isn't running yet, and
+    //the caller returns the status itself.
+    QCoreApplication::exit( code );
 }
@@ -17,38 +17,84 @@
  *
  * You should have received a copy of the GNU General Public License
  * along with this program; if not, write to the Free Software
- * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 
 #ifndef CONSOLERENDERER_H
 #define CONSOLERENDERER_H
 
+class   Project;
 class   WorkflowFileRenderer;
 
+namespace Backend
+{
+    class IBackend;
+}
+
 #include <QObject>
 #include <QString>
+#include <QStringList>
+#include <QTime>
 
+/**
+ *  \brief  Renders a project to a file without any GUI.
+ *
+ *  The progress is written to the standard output as JSON lines, one object
+ *  per line, so that it can be parsed by the scripts driving the render.
+ *  The logs go to the standard error.
+ */
 class ConsoleRenderer : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit ConsoleRenderer( QObject *parent = 0 );
+    /// The exit status of a render started from the command line.
+    enum    ExitCode
+    {
+        Success = 0,
+        InvalidArguments,
+        ProjectLoadFailed,
+        NothingToRender,
+        RenderFailed
+    };
 
-public slots:
-    void        startRender();
+    ConsoleRenderer( Backend::IBackend* backend, const QString& outputFileName,
+                     QObject *parent = 0 );
+    virtual ~ConsoleRenderer();
+
+    /**
+     *  \brief  Load the project, and render it once all its medias are loaded.
+     *
+     *  The application exits with one of the ExitCode once the render is over.
+     *  \returns    false if the project couldn't be loaded.
+     */
+    bool        render( const QString& projectFileName );
+
+    /**
+     *  \returns    The output file extensions, which the container is picked from.
+     */
+    static QStringList  supportedExtensions();
+    static bool         isSupportedOutput( const QString& outputFileName );
 
 private slots:
-    void        frameChanged( qint64 frame ) const;
+    void        projectLoading( Project* project );
+    void        startRender();
+    void        frameChanged( qint64 frame );
+    void        renderComplete();
+    void        renderError();
+
+private:
+    void        printProgress( const char* event, qint64 frame );
+    void        finish( ExitCode code, const QString& message );
 
 private:
+    Backend::IBackend*      m_backend;
     WorkflowFileRenderer    *m_renderer;
     QString                 m_outputFileName;
-    quint32                 m_width;
-    quint32                 m_height;
-    double                  m_fps;
-    quint32                 m_vbitrate;
-    quint32                 m_abitrate;
+    qint64                  m_length;
+    QTime                   m_time;
+    /// When the last progress line was written, in ms since the render started.
+    int                     m_lastReport;
+    bool                    m_finished;
 };
 
 #endif // CONSOLERENDERER_H
@@ -22,12 +22,15 @@
 
 #include "GenericRenderer.h"
 #include "VLCMediaPlayer.h"
-#include "preview/RenderWidget.h"
+#ifdef WITH_GUI
+# include "preview/RenderWidget.h"
+#endif
 #include <QtGlobal>
 
 GenericRenderer::GenericRenderer()
     : m_sourceRenderer( NULL )
     , m_paused( false )
+    , m_renderWidget( NULL )
 {
     m_eventWatcher = new RendererEventWatcher;
 }
@@ -44,10 +47,10 @@ GenericRenderer::setRenderWidget(QWidget *renderWidget)
 {
     m_renderWidget = renderWidget;
 }
+#endif
 
 RendererEventWatcher*
 GenericRenderer::eventWatcher()
 {
     return m_eventWatcher;
 }
-#endif
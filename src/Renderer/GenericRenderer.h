@@ -28,6 +28,8 @@
 #include <QObject>
 #ifdef WITH_GUI
 # include <QWidget>
+#else
+class   QWidget;
 #endif
 
 #include "EffectsEngine/EffectUser.h"
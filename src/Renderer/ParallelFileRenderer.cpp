@@ -0,0 +1,245 @@
+/*****************************************************************************
+ * ParallelFileRenderer.cpp: Output the workflow to a file, by segments
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "ParallelFileRenderer.h"
+
+#include "Tools/VlmcDebug.h"
+#include "Workflow/MainWorkflow.h"
+#include "WorkflowFileRenderer.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+/// The segments start on a keyframe, which the encoder is asked for this often.
+static const double     GopDuration = 2.0;
+static const qint64     CopyChunkSize = 1024 * 1024;
+/// The containers whose files can be joined by appending them.
+static const char*      JoinableExtensions[] = { "ps", "mpg", "mpeg", "ts" };
+
+ParallelFileRenderer::ParallelFileRenderer( Backend::IBackend* backend, MainWorkflow* workflow ) :
+        m_backend( backend ),
+        m_workflow( workflow )
+{
+}
+
+ParallelFileRenderer::~ParallelFileRenderer()
+{
+    stop();
+}
+
+bool
+ParallelFileRenderer::supportsOutput( const QString& outputFileName )
+{
+    return supportedExtensions().contains( QFileInfo( outputFileName ).suffix().toLower() );
+}
+
+QStringList
+ParallelFileRenderer::supportedExtensions()
+{
+    QStringList     ret;
+    for ( size_t i = 0; i < sizeof( JoinableExtensions ) / sizeof( JoinableExtensions[0] ); ++i )
+        ret << JoinableExtensions[i];
+    return ret;
+}
+
+bool
+ParallelFileRenderer::run( const QString& outputFileName, quint32 nbSegments,
+                           quint32 width, quint32 height, double fps,
+                           quint32 vbitrate, quint32 abitrate )
+{
+    stop();
+
+    const qint64    length = m_workflow->getLengthFrame();
+    const qint64    gopSize = qMax( qRound( fps * GopDuration ), 1 );
+    if ( length <= 0 || nbSegments == 0 )
+        return false;
+    if ( supportsOutput( outputFileName ) == false )
+    {
+        vlmcWarning() << "Can't render" << outputFileName << "by segments, use one of:"
+                      << supportedExtensions().join( ", " );
+        return false;
+    }
+    m_outputFileName = outputFileName;
+    //The parts keep the extension, so they get muxed like the output.
+    const QString   suffix = QFileInfo( outputFileName ).suffix();
+
+    qint64          begin = 0;
+    for ( quint32 i = 1; i <= nbSegments; ++i )
+    {
+        qint64      end = length * i / nbSegments;
+        if ( i < nbSegments )
+            end = end / gopSize * gopSize;
+        //Rounding may leave nothing to a segment, which is then merged into the next one.
+        if ( end <= begin )
+            continue ;
+        Segment     segment;
+        segment.workflow = m_workflow->clone();
+        if ( segment.workflow == NULL )
+        {
+            release();
+            return false;
+        }
+        segment.renderer = new WorkflowFileRenderer( m_backend, segment.workflow );
+        segment.fileName = QString( "%1.%2.part.%3" ).arg( outputFileName )
+                                                     .arg( m_segments.size() ).arg( suffix );
+        segment.begin = begin;
+        segment.end = end;
+        segment.nbRendered = 0;
+        segment.done = false;
+        m_segments.append( segment );
+        begin = end;
+    }
+    vlmcDebug() << "Rendering" << length << "frames in" << m_segments.size() << "segments";
+
+    for ( int i = 0; i < m_segments.size(); ++i )
+    {
+        WorkflowFileRenderer*   renderer = m_segments[i].renderer;
+        connect( renderer, SIGNAL( frameChanged( qint64 ) ),
+                 this, SLOT( segmentFrameChanged( qint64 ) ) );
+        connect( renderer, SIGNAL( renderComplete() ), this, SLOT( segmentComplete() ) );
+        connect( renderer, SIGNAL( imageUpdated( const uchar* ) ),
+                 this, SIGNAL( imageUpdated( const uchar* ) ) );
+        renderer->setKeyframeInterval( gopSize );
+        renderer->setRange( m_segments[i].begin, m_segments[i].end );
+        renderer->run( m_segments[i].fileName, width, height, fps, vbitrate, abitrate );
+    }
+    return true;
+}
+
+void
+ParallelFileRenderer::stop()
+{
+    if ( m_segments.isEmpty() == true )
+        return ;
+    for ( int i = 0; i < m_segments.size(); ++i )
+    {
+        if ( m_segments[i].done == false )
+            m_segments[i].renderer->stop();
+    }
+    release();
+}
+
+quint32
+ParallelFileRenderer::nbSegments() const
+{
+    return m_segments.size();
+}
+
+int
+ParallelFileRenderer::segmentIndex( QObject *renderer ) const
+{
+    for ( int i = 0; i < m_segments.size(); ++i )
+    {
+        if ( m_segments[i].renderer == renderer )
+            return i;
+    }
+    return -1;
+}
+
+bool
+ParallelFileRenderer::concatenate()
+{
+    QFile       output( m_outputFileName );
+    if ( output.open( QFile::WriteOnly | QFile::Truncate ) == false )
+    {
+        vlmcWarning() << "Can't open" << m_outputFileName << ':' << output.errorString();
+        return false;
+    }
+    foreach ( const Segment& segment, m_segments )
+    {
+        QFile   part( segment.fileName );
+        if ( part.open( QFile::ReadOnly ) == false )
+        {
+            vlmcWarning() << "Can't open" << segment.fileName << ':' << part.errorString();
+            return false;
+        }
+        while ( part.atEnd() == false )
+        {
+            const QByteArray    chunk = part.read( CopyChunkSize );
+            if ( chunk.isEmpty() == true || output.write( chunk ) != chunk.size() )
+            {
+                vlmcWarning() << "Can't append" << segment.fileName << "to"
+                              << m_outputFileName << ':' << output.errorString();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void
+ParallelFileRenderer::release()
+{
+    foreach ( const Segment& segment, m_segments )
+    {
+        //The renderer uses the workflow, so it goes first.
+        delete segment.renderer;
+        delete segment.workflow;
+        QFile::remove( segment.fileName );
+    }
+    m_segments.clear();
+}
+
+void
+ParallelFileRenderer::segmentFrameChanged( qint64 frame )
+{
+    const int   i = segmentIndex( sender() );
+    if ( i < 0 )
+        return ;
+    Segment&    segment = m_segments[i];
+    segment.nbRendered = qBound( (qint64)0, frame - segment.begin, segment.end - segment.begin );
+    emit segmentProgress( i, segment.nbRendered, segment.end - segment.begin );
+
+    qint64      total = 0;
+    foreach ( const Segment& s, m_segments )
+        total += s.nbRendered;
+    emit frameChanged( total );
+}
+
+void
+ParallelFileRenderer::segmentComplete()
+{
+    const int   i = segmentIndex( sender() );
+    if ( i < 0 )
+        return ;
+    m_segments[i].done = true;
+    m_segments[i].nbRendered = m_segments[i].end - m_segments[i].begin;
+    vlmcDebug() << "Segment" << i << "rendered";
+    foreach ( const Segment& segment, m_segments )
+    {
+        if ( segment.done == false )
+            return ;
+    }
+    const bool  success = concatenate();
+    //The renderers are still in their completion signal, so they can't be deleted now.
+    foreach ( const Segment& segment, m_segments )
+    {
+        segment.renderer->deleteLater();
+        segment.workflow->deleteLater();
+        QFile::remove( segment.fileName );
+    }
+    m_segments.clear();
+    if ( success == true )
+        emit renderComplete();
+    else
+        emit renderFailed();
+}
@@ -0,0 +1,126 @@
+/*****************************************************************************
+ * ParallelFileRenderer.h: Output the workflow to a file, by segments
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef PARALLELFILERENDERER_H
+#define PARALLELFILERENDERER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class   MainWorkflow;
+class   WorkflowFileRenderer;
+
+namespace Backend
+{
+    class IBackend;
+}
+
+/**
+ *  \brief  Renders the timeline to a file using several pipelines at once.
+ *
+ *  The timeline is split in segments, whose boundaries fall on the keyframes
+ *  of the encoder, so that each segment starts a new group of pictures.
+ *  Each segment is rendered by its own copy of the workflow and its own
+ *  WorkflowFileRenderer, to a temporary file next to the output.
+ *  The files are muxed like the output, and the pieces are concatenated
+ *  without being encoded again. This only works for the containers which can
+ *  be joined by appending them, see supportsOutput().
+ */
+class   ParallelFileRenderer : public QObject
+{
+    Q_OBJECT
+
+public:
+    ParallelFileRenderer( Backend::IBackend* backend, MainWorkflow* workflow );
+    virtual ~ParallelFileRenderer();
+
+    /**
+     *  \returns    true if the output can be rendered by segments.
+     *
+     *  Only the MPEG program and transport streams can be joined by appending
+     *  them. The other containers have an index, which would need to be muxed
+     *  again.
+     */
+    static bool                 supportsOutput( const QString& outputFileName );
+    /**
+     *  \returns    The extensions supportsOutput() accepts.
+     */
+    static QStringList          supportedExtensions();
+    /**
+     *  \brief  Start rendering the timeline in up to nbSegments segments.
+     *
+     *  \returns    false if the render couldn't start, or the output isn't supported.
+     */
+    bool                        run( const QString& outputFileName, quint32 nbSegments,
+                                     quint32 width, quint32 height, double fps,
+                                     quint32 vbitrate, quint32 abitrate );
+    /**
+     *  \brief  Cancel the render, and remove the temporary files.
+     */
+    void                        stop();
+    /**
+     *  \returns    The number of segments the current render uses.
+     */
+    quint32                     nbSegments() const;
+
+private:
+    struct  Segment
+    {
+        MainWorkflow*           workflow;
+        WorkflowFileRenderer*   renderer;
+        QString                 fileName;
+        qint64                  begin;
+        qint64                  end;
+        qint64                  nbRendered;
+        bool                    done;
+    };
+
+    int                         segmentIndex( QObject* renderer ) const;
+    bool                        concatenate();
+    void                        release();
+
+private:
+    Backend::IBackend*          m_backend;
+    MainWorkflow*               m_workflow;
+    QString                     m_outputFileName;
+    QVector<Segment>            m_segments;
+
+private slots:
+    void                        segmentFrameChanged( qint64 frame );
+    void                        segmentComplete();
+
+signals:
+    void                        imageUpdated( const uchar* image );
+    /**
+     *  \brief  The total number of frames rendered changed.
+     */
+    void                        frameChanged( qint64 nbRendered );
+    void                        segmentProgress( quint32 segment, qint64 nbRendered,
+                                                 qint64 nbFrames );
+    void                        renderComplete();
+    void                        renderFailed();
+};
+
+#endif // PARALLELFILERENDERER_H
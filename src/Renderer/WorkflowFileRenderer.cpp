@@ -31,6 +31,9 @@
 WorkflowFileRenderer::WorkflowFileRenderer( Backend::IBackend* backend, MainWorkflow* workflow )
     : WorkflowRenderer( backend, workflow )
     , m_renderVideoFrame( NULL )
+    , m_begin( 0 )
+    , m_end( -1 )
+    , m_keyframeInterval( 0 )
 {
 }
 
@@ -43,29 +46,50 @@ WorkflowFileRenderer::run( const QString& outputFileName, quint32 width,
                                        quint32 height, double fps, quint32 vbitrate,
                                        quint32 abitrate )
 {
-    m_mainWorkflow->setCurrentFrame( 0, Vlmc::Renderer );
+    m_mainWorkflow->setCurrentFrame( m_begin, Vlmc::Renderer );
 
     setupRenderer( width, height, fps );
     m_sourceRenderer->setOutputFile( qPrintable( outputFileName ) );
     m_sourceRenderer->setOutputAudioBitrate( abitrate );
     m_sourceRenderer->setOutputVideoBitrate( vbitrate );
+    if ( m_keyframeInterval > 0 )
+        m_sourceRenderer->setOutputKeyframeInterval( m_keyframeInterval );
 
-    connect( m_mainWorkflow, SIGNAL( mainWorkflowEndReached() ), this, SLOT( stop() ) );
+    connect( m_mainWorkflow, SIGNAL( mainWorkflowEndReached() ), this, SLOT( renderEnded() ) );
     connect( m_mainWorkflow, SIGNAL( frameChanged( qint64, Vlmc::FrameChangedReason ) ),
              this, SLOT( __frameChanged( qint64,Vlmc::FrameChangedReason ) ) );
-    connect( this, SIGNAL( endReached() ), this, SIGNAL( renderComplete() ) );
+    //A range ends before the timeline does.
+    connect( m_eventWatcher, SIGNAL( endReached() ), this, SLOT( renderEnded() ) );
 
     m_isRendering = true;
     m_stopping = false;
     m_paused = false;
-    m_pts = 0;
-    m_audioPts = 0;
+    m_pts = m_begin * 1000000 / fps;
+    m_audioPts = m_pts;
+    for ( unsigned int i = 0; i < Workflow::NbTrackType; ++i )
+        m_nbRendered[i] = 0;
 
     m_mainWorkflow->setFullSpeedRender( true );
+    //The proxies are only good enough for the preview.
+    m_mainWorkflow->setUseProxies( false );
     m_mainWorkflow->startRender( width, height, fps );
-    //Waiting for renderers to preload some frames:
-    SleepS( 1 );
-    m_sourceRenderer->start();
+    //Don't start encoding before the first clips are ready: the renderer is
+    //started by workflowPrerolled().
+    m_mainWorkflow->preroll( VLMC_PROJECT_GET_UINT( "video/PrerollFrames" ),
+                             VLMC_PROJECT_GET_UINT( "video/PrerollTimeout" ) );
+}
+
+void
+WorkflowFileRenderer::setRange( qint64 begin, qint64 end )
+{
+    m_begin = begin;
+    m_end = end;
+}
+
+void
+WorkflowFileRenderer::setKeyframeInterval( quint32 interval )
+{
+    m_keyframeInterval = interval;
 }
 
 float
@@ -78,9 +102,18 @@ int
 WorkflowFileRenderer::lock( void *datas, const char* cookie, int64_t *dts, int64_t *pts,
                             unsigned int *flags, size_t *bufferSize, const void **buffer )
 {
-    int         ret = WorkflowRenderer::lock( datas, cookie, dts, pts, flags, bufferSize, buffer );
     EsHandler*  handler = reinterpret_cast<EsHandler*>( datas );
     WorkflowFileRenderer* self = static_cast<WorkflowFileRenderer*>( handler->self );
+    const int   type = ( cookie != NULL && cookie[0] == AudioCookie ) ? Workflow::AudioTrack
+                                                                       : Workflow::VideoTrack;
+
+    //Past the end of the range, the stream is over.
+    if ( self->m_end >= 0 && self->m_nbRendered[type] >= self->m_end - self->m_begin )
+        return 1;
+    int         ret = WorkflowRenderer::lock( datas, cookie, dts, pts, flags, bufferSize, buffer );
+    if ( ret != 0 )
+        return ret;
+    ++self->m_nbRendered[type];
 
 #ifdef WITH_GUI
     if ( self->m_time.isValid() == false ||
@@ -102,6 +135,16 @@ WorkflowFileRenderer::__frameChanged( qint64 frame, Vlmc::FrameChangedReason )
     emit frameChanged( frame );
 }
 
+void
+WorkflowFileRenderer::renderEnded()
+{
+    //Both the workflow and the renderer may report the end.
+    if ( m_isRendering == false )
+        return ;
+    stop();
+    emit renderComplete();
+}
+
 Backend::ISourceRenderer::MemoryInputLockCallback
 WorkflowFileRenderer::getLockCallback()
 {
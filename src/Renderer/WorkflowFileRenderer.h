@@ -41,12 +41,32 @@ public:
     void                        run(const QString& outputFileName, quint32 width,
                                     quint32 height, double fps, quint32 vbitrate,
                                     quint32 abitrate);
+    /**
+     *  \brief  Only render the frames [begin, end[ of the timeline.
+     *
+     *  The timestamps still start at begin, so that the files rendered for
+     *  consecutive ranges follow each other.
+     *  This has to be called before run(). By default, the whole timeline is
+     *  rendered.
+     */
+    void                        setRange( qint64 begin, qint64 end );
+    /**
+     *  \brief  Ask the encoder for a keyframe every interval frames. 0, the
+     *          default, leaves the encoder default.
+     */
+    void                        setKeyframeInterval( quint32 interval );
     static int                  lock(void* datas, const char* cookie, int64_t *dts, int64_t *pts,
                                       unsigned int *flags, size_t *bufferSize, const void **buffer );
     virtual float               getFps() const;
 
 private:
     quint8                      *m_renderVideoFrame;
+    qint64                      m_begin;
+    /// -1 to render up to the end of the timeline.
+    qint64                      m_end;
+    quint32                     m_keyframeInterval;
+    /// The number of video and audio buffers handed to imem, indexed by Workflow::TrackType
+    qint64                      m_nbRendered[Workflow::NbTrackType];
 #ifdef WITH_GUI
     QTime                       m_time;
 #endif
@@ -58,6 +78,7 @@ protected:
 private slots:
     void                        __frameChanged( qint64 frame,
                                                 Vlmc::FrameChangedReason reason );
+    void                        renderEnded();
 
 signals:
     void                        imageUpdated( const uchar* image );
@@ -39,12 +39,22 @@
 #include "GenericRenderer.h"
 #include "Backend/IBackend.h"
 #include "Backend/ISource.h"
+#include "Workflow/FramePool.h"
 #include "Workflow/MainWorkflow.h"
-#include "Gui/preview/RenderWidget.h"
+#include "Workflow/PixelConverter.h"
+#include "Workflow/PreviewGovernor.h"
+#include "Workflow/RenderCache.h"
+#ifdef WITH_GUI
+# include "Gui/preview/RenderWidget.h"
+#endif
 #include "Settings/Settings.h"
 #include "Tools/VlmcDebug.h"
+#include "Tools/mdate.h"
 #include "Workflow/Types.h"
 
+/// The user waits for the preroll, so the preview gives up sooner than an export, in milliseconds.
+static const quint32    MaxPreviewPrerollTimeout = 1000;
+
 WorkflowRenderer::WorkflowRenderer( Backend::IBackend* backend, MainWorkflow* mainWorkflow )
     : m_mainWorkflow( mainWorkflow )
     , m_stopping( false )
@@ -54,8 +64,11 @@ WorkflowRenderer::WorkflowRenderer( Backend::IBackend* backend, MainWorkflow* ma
     , m_nbChannels( 2 )
     , m_rate( 48000 )
     , m_oldLength( 0 )
-    , m_effectFrame( NULL )
+    , m_cacheBegin( 0 )
+    , m_cacheEnd( -1 )
+    , m_governed( false )
 {
+    m_governor = new Workflow::PreviewGovernor;
     m_source = backend->createMemorySource();
     m_esHandler = new EsHandler;
     m_esHandler->self = this;
@@ -64,6 +77,7 @@ WorkflowRenderer::WorkflowRenderer( Backend::IBackend* backend, MainWorkflow* ma
              this, SIGNAL( frameChanged( qint64, Vlmc::FrameChangedReason ) ) );
     connect( m_mainWorkflow, SIGNAL( lengthChanged( qint64 ) ),
              this, SLOT(mainWorkflowLenghtChanged(qint64) ) );
+    connect( m_mainWorkflow, SIGNAL( prerolled( bool ) ), this, SLOT( workflowPrerolled() ) );
 }
 
 WorkflowRenderer::~WorkflowRenderer()
@@ -73,6 +87,7 @@ WorkflowRenderer::~WorkflowRenderer()
     delete m_esHandler;
     delete m_silencedAudioBuffer;
     delete m_source;
+    delete m_governor;
 }
 
 void
@@ -91,7 +106,11 @@ WorkflowRenderer::setupRenderer( quint32 width, quint32 height, double fps )
     m_sourceRenderer = m_source->createRenderer( m_eventWatcher );
     m_sourceRenderer->setName( "WorkflowRenderer" );
     m_sourceRenderer->enableMemoryInput( m_esHandler, getLockCallback(), getUnlockCallback() );
-    m_sourceRenderer->setOutputWidget( (void *) static_cast< RenderWidget* >( m_renderWidget )->id() );
+#ifdef WITH_GUI
+    //The file renderers have no widget to draw in.
+    if ( m_renderWidget != NULL )
+        m_sourceRenderer->setOutputWidget( (void *) static_cast< RenderWidget* >( m_renderWidget )->id() );
+#endif
 }
 
 int
@@ -127,17 +146,72 @@ WorkflowRenderer::lock( void *data, const char* cookie, int64_t *dts, int64_t *p
     return ret;
 }
 
+/**
+ *  Blow a frame rendered at a lower resolution up to the size of output, as packed I420.
+ */
+static void
+upscale( const Workflow::Frame *frame, Workflow::Frame *output )
+{
+    const size_t    size = Workflow::Frame::Size( output->width(), output->height(), Workflow::I420 );
+    output->reserve( size, Workflow::I420 );
+    output->setLayout( size );
+    output->ptsDiff = frame->ptsDiff;
+
+    const quint8    *src = frame->yuvBuffer();
+    quint8          *dst = output->plane( 0 );
+    quint32         srcWidth = frame->width();
+    quint32         srcHeight = frame->height();
+    quint32         dstWidth = output->width();
+    quint32         dstHeight = output->height();
+    for ( quint32 p = 0; p < 3; ++p )
+    {
+        if ( p == 1 )
+        {
+            srcWidth = ( srcWidth + 1 ) / 2;
+            srcHeight = ( srcHeight + 1 ) / 2;
+            dstWidth = ( dstWidth + 1 ) / 2;
+            dstHeight = ( dstHeight + 1 ) / 2;
+        }
+        Workflow::PixelConverter::ScalePlane( src, srcWidth, srcWidth, srcHeight,
+                                              dst, dstWidth, dstWidth, dstHeight );
+        src += srcWidth * srcHeight;
+        dst += dstWidth * dstHeight;
+    }
+}
+
 int
 WorkflowRenderer::lockVideo( void* data, int64_t *pts, size_t *bufferSize, const void **buffer )
 {
     EsHandler*              handler = reinterpret_cast<EsHandler*>( data );
     qint64                  ptsDiff = 0;
     const Workflow::Frame   *ret;
+    quint32                 *effectFrame;
+    Workflow::Frame         cached;
+    Workflow::Frame         upscaled;
+    const qint64            start = mdate();
+    const quint32           width = m_mainWorkflow->getOutputWidth();
+    const quint32           height = m_mainWorkflow->getOutputHeight();
 
     if ( m_stopping == true )
         return 1;
 
-    ret = static_cast<const Workflow::Frame*>( m_mainWorkflow->getOutput( Workflow::VideoTrack, m_paused ) );
+    //A range rendered to the cache doesn't need the workflow at all.
+    if ( m_mainWorkflow->renderCache()->fetch( m_mainWorkflow->getCurrentFrame(), width, height,
+                                               handler->fps, &cached ) == true )
+        ret = &cached;
+    else
+    {
+        ret = static_cast<const Workflow::Frame*>( m_mainWorkflow->getOutput( Workflow::VideoTrack, m_paused ) );
+        if ( m_cacheEnd >= 0 && m_mainWorkflow->renderCache()->isRecording() == false )
+            QMetaObject::invokeMethod( this, "cacheRendered", Qt::QueuedConnection );
+    }
+    //The preview was scaled down, imem and the filters still expect the output resolution.
+    if ( ret->width() != width || ret->height() != height )
+    {
+        upscaled.resize( width, height );
+        upscale( ret, &upscaled );
+        ret = &upscaled;
+    }
     ptsDiff = ret->ptsDiff;
     if ( ptsDiff == 0 )
     {
@@ -146,15 +220,34 @@ WorkflowRenderer::lockVideo( void* data, int64_t *pts, size_t *bufferSize, const
         //this is a bit hackish though... (especially regarding the "no frame computed" detection)
         ptsDiff = 1000000 / handler->fps;
     }
-    m_effectFrame = applyFilters( ret, m_mainWorkflow->getCurrentFrame(),
+    effectFrame = applyFilters( ret, m_mainWorkflow->getCurrentFrame(),
                                       m_mainWorkflow->getCurrentFrame() * 1000.0 / handler->fps );
     m_pts = *pts = ptsDiff + m_pts;
-    if ( m_effectFrame != NULL )
-        *buffer = m_effectFrame;
+    // Whatever buffer we hand to imem is referenced until unlock() is called, so
+    // that the workflow can't recycle it while it's being read.
+    // imem expects packed I420 planes, while effects output RV32.
+    const quint8    *yuv;
+    if ( effectFrame != NULL )
+    {
+        Workflow::Frame     filtered( *ret );
+        filtered.setBuffer( effectFrame );
+        yuv = filtered.yuvBuffer();
+        // Take our reference before filtered drops its own
+        Workflow::FramePool::getInstance()->ref( reinterpret_cast<const quint32*>( yuv ) );
+    }
     else
-        *buffer = ret->buffer();
-    *bufferSize = ret->size();
+    {
+        yuv = ret->yuvBuffer();
+        Workflow::FramePool::getInstance()->ref( reinterpret_cast<const quint32*>( yuv ) );
+    }
+    *buffer = yuv;
+    *bufferSize = Workflow::Frame::Size( ret->width(), ret->height(), Workflow::I420 );
     vlmcDebug() << __func__ << "Rendered frame. pts:" << m_pts;
+    //Only scale down once the previous decision has been applied.
+    if ( m_governed == true && m_paused == false &&
+         m_mainWorkflow->renderDivisor() == m_governor->divisor() &&
+         m_governor->addFrame( mdate() - start ) == true )
+        m_mainWorkflow->setRenderDivisor( m_governor->divisor() );
     return 0;
 }
 
@@ -197,11 +290,10 @@ WorkflowRenderer::lockAudio( EsHandler *handler, int64_t *pts, size_t *bufferSiz
 }
 
 void
-WorkflowRenderer::unlock( void *data, const char*, size_t, void* )
+WorkflowRenderer::unlock( void*, const char* cookie, size_t, void* buffer )
 {
-    EsHandler*      handler = reinterpret_cast<EsHandler*>( data );
-    delete[] handler->self->m_effectFrame;
-    handler->self->m_effectFrame = NULL;
+    if ( cookie != NULL && cookie[0] == WorkflowRenderer::VideoCookie )
+        Workflow::FramePool::getInstance()->release( reinterpret_cast<quint32*>( buffer ) );
 }
 
 void
@@ -220,13 +312,38 @@ WorkflowRenderer::startPreview()
 
     setupRenderer( m_width, m_height, m_outputFps );
 
-    m_mainWorkflow->setFullSpeedRender( false );
+    //The cached frames may end up in an export, so they come from the originals.
+    m_mainWorkflow->setUseProxies( m_cacheEnd < 0 && VLMC_PROJECT_GET_BOOL( "video/UseProxies" ) == true );
     m_mainWorkflow->startRender( m_width, m_height, m_outputFps );
+    m_governor->setFps( m_outputFps );
+    m_governor->reset();
+    if ( m_cacheEnd >= 0 )
+    {
+        if ( m_mainWorkflow->cacheRange( m_cacheBegin, m_cacheEnd ) == true )
+            m_mainWorkflow->setCurrentFrame( m_cacheBegin, Vlmc::Renderer );
+        else
+            m_cacheEnd = -1;
+    }
+    //Every frame has to be rendered to be cached, no matter how long it takes.
+    m_mainWorkflow->setFullSpeedRender( m_cacheEnd >= 0 );
+    //Rendering to the cache doesn't have to keep up, and has to be full resolution.
+    m_governed = ( m_cacheEnd < 0 );
     m_isRendering = true;
     m_paused = false;
     m_stopping = false;
     m_pts = 0;
     m_audioPts = 0;
+    //The renderer gets started once the clips are ready.
+    m_mainWorkflow->preroll( VLMC_PROJECT_GET_UINT( "video/PrerollFrames" ),
+                             qMin( VLMC_PROJECT_GET_UINT( "video/PrerollTimeout" ), MaxPreviewPrerollTimeout ) );
+}
+
+void
+WorkflowRenderer::workflowPrerolled()
+{
+    //The render may have been stopped meanwhile.
+    if ( m_isRendering == false || m_stopping == true )
+        return ;
     m_sourceRenderer->start();
 }
 
@@ -250,7 +367,15 @@ WorkflowRenderer::togglePlayPause()
     if ( m_isRendering == false )
         startPreview();
     else
+    {
         m_paused = !m_paused;
+        //Get the full resolution back for the still frame.
+        if ( m_paused == true )
+        {
+            m_governor->reset();
+            m_mainWorkflow->setRenderDivisor( 1 );
+        }
+    }
 }
 
 void
@@ -260,6 +385,9 @@ WorkflowRenderer::stop()
     m_isRendering = false;
     m_paused = false;
     m_stopping = true;
+    m_cacheEnd = -1;
+    m_governed = false;
+    m_governor->reset();
     m_mainWorkflow->stopFrameComputing();
     if ( m_sourceRenderer != NULL )
         m_sourceRenderer->stop();
@@ -268,6 +396,26 @@ WorkflowRenderer::stop()
     m_silencedAudioBuffer = NULL;
 }
 
+void
+WorkflowRenderer::renderToCache( qint64 begin, qint64 end )
+{
+    if ( m_isRendering == true )
+        stop();
+    m_cacheBegin = begin;
+    m_cacheEnd = end;
+    startPreview();
+}
+
+void
+WorkflowRenderer::cacheRendered()
+{
+    if ( m_cacheEnd < 0 )
+        return ;
+    const qint64    begin = m_cacheBegin;
+    stop();
+    m_mainWorkflow->setCurrentFrame( begin, Vlmc::Renderer );
+}
+
 int
 WorkflowRenderer::getVolume() const
 {
@@ -36,6 +36,11 @@ namespace Backend
     class IMemorySource;
 }
 
+namespace Workflow
+{
+    class PreviewGovernor;
+}
+
 class   Clip;
 
 class   QWidget;
@@ -132,6 +137,14 @@ class   WorkflowRenderer : public GenericRenderer, public ILoadSave
          */
         virtual float       getFps() const;
 
+        /**
+         *  \brief  Play the given range at full speed, storing the frames in the
+         *          render cache, so it can be previewed in real time afterward.
+         *
+         *  The preview stops once the range has been rendered.
+         */
+        void                renderToCache( qint64 begin, qint64 end );
+
     private:
         /**
          *  \brief          This is a subpart of the togglePlayPause( bool ) method
@@ -278,9 +291,15 @@ class   WorkflowRenderer : public GenericRenderer, public ILoadSave
          *                  has to be performed.
          */
         qint64              m_oldLength;
+        /// The range being rendered to the cache, if m_cacheEnd isn't -1.
+        qint64              m_cacheBegin;
+        qint64              m_cacheEnd;
+        /// Lowers the preview resolution when the frames are late.
+        Workflow::PreviewGovernor   *m_governor;
+        /// false while exporting or rendering to the cache, which need every pixel.
+        bool                m_governed;
 
-        quint32             *m_effectFrame;
-
+    protected:
         static const quint8     VideoCookie = '0';
         static const quint8     AudioCookie = '1';
 
@@ -306,6 +325,12 @@ class   WorkflowRenderer : public GenericRenderer, public ILoadSave
          *  If the length comes to a 0 value again, the permanent playback will be stoped.
          */
         void                mainWorkflowLenghtChanged( qint64 newLength );
+        void                cacheRendered();
+        /**
+         *  \brief          Start the renderer once the clips are ready.
+         *  \sa             MainWorkflow::preroll()
+         */
+        void                workflowPrerolled();
 };
 
 #endif // WORKFLOWRENDERER_H
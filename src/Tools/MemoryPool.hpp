@@ -24,54 +24,304 @@
 #ifndef MEMORYPOOL_HPP
 #define MEMORYPOOL_HPP
 
-#include <QMutex>
-#include <QQueue>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QThreadStorage>
+#include <QtGlobal>
+
+#include <new>
 
 #include "Singleton.hpp"
 #include "VlmcDebug.h"
 
+/**
+ *  \brief  A pool of T, usable from any thread without taking a lock.
+ *
+ *  Each thread caches a few free elements in its own magazine, so most get() and
+ *  release() never touch shared state. Magazines are refilled from, and spilled to,
+ *  a lock free global free list.
+ *  The pool starts with NB_ELEM elements, and grows on demand until setMaxElements()
+ *  is reached. Past that point, elements are still allocated (and counted as
+ *  fallbacks), but they are freed as soon as they are released.
+ *  When more than setMaxIdle() elements sit in the global free list, spilled
+ *  magazines are freed instead of being kept, so the memory goes back gradually.
+ *
+ *  \warning    The pool must outlive every thread that used it.
+ */
 template <typename T, size_t NB_ELEM = 5>
 class       MemoryPool : public Singleton< MemoryPool<T, NB_ELEM> >
 {
 public:
+    struct  Stats
+    {
+        /// Number of get() served from the cached elements
+        int     hits;
+        /// Number of get() which required the pool to grow
+        int     misses;
+        /// Number of get() which required an allocation past the maximum size
+        int     fallbacks;
+        /// Number of elements currently allocated, used or not.
+        int     allocated;
+        /// Number of elements waiting in the global free list
+        int     idle;
+    };
+
     T*      get()
     {
-        QMutexLocker    lock( m_mutex );
-        if ( m_pool.size() == 0 )
+        Magazine*   mag = magazine();
+        if ( mag->head == NULL )
+            refill( mag );
+        Slot*       slot = mag->head;
+        if ( slot != NULL )
         {
-            vlmcCritical() << "Pool is empty !!";
-            return new T;
+            mag->head = slot->next;
+            --mag->count;
+            if ( ++mag->hits >= MagazineSize )
+            {
+                m_hits.fetchAndAddRelaxed( mag->hits );
+                mag->hits = 0;
+            }
         }
-        quint8*    ptr = m_pool.dequeue();
-        T*  ret = new (ptr) T;
-        return ret;
+        else
+            slot = allocate();
+        return new ( slot->data ) T;
     }
+
     void    release( T* toRelease )
     {
-        QMutexLocker    lock( m_mutex );
         toRelease->~T();
-        m_pool.enqueue( reinterpret_cast<quint8*>( toRelease ) );
+        Slot*       slot = reinterpret_cast<Slot*>( toRelease );
+
+        // This element was allocated past the maximum pool size, don't keep it.
+        if ( load( m_nbAllocated ) > load( m_maxElements ) )
+        {
+            m_nbAllocated.fetchAndAddRelaxed( -1 );
+            delete slot;
+            return ;
+        }
+        Magazine*   mag = magazine();
+        slot->next = mag->head;
+        mag->head = slot;
+        if ( ++mag->count >= MagazineSize )
+            spill( mag );
     }
+
+    void    setMaxElements( int maxElements )
+    {
+        m_maxElements.fetchAndStoreRelaxed( qMax<int>( maxElements, NB_ELEM ) );
+    }
+
+    void    setMaxIdle( int maxIdle )
+    {
+        m_maxIdle.fetchAndStoreRelaxed( maxIdle );
+    }
+
+    /**
+     *  \brief  Returns the pool counters.
+     *
+     *  Hits are accumulated per thread and published in batches, so they may lag
+     *  behind by a few elements.
+     */
+    Stats   stats() const
+    {
+        Stats   s;
+        s.hits = load( m_hits );
+        s.misses = load( m_misses );
+        s.fallbacks = load( m_fallbacks );
+        s.allocated = load( m_nbAllocated );
+        s.idle = load( m_nbFree );
+        return s;
+    }
+
 private:
+    union   Slot
+    {
+        Slot*       next;
+        quint8      data[sizeof(T)];
+        // Only here to get a suitable alignment for T
+        double      alignDouble;
+        qint64      alignInt;
+        void*       alignPtr;
+    };
+
+    struct  Magazine
+    {
+        Magazine( MemoryPool* _pool ) : pool( _pool ), head( NULL ), count( 0 ), hits( 0 ) {}
+        ~Magazine()
+        {
+            // The thread is exiting, hand our elements back.
+            pool->m_hits.fetchAndAddRelaxed( hits );
+            if ( head != NULL )
+            {
+                Slot*   last = head;
+                while ( last->next != NULL )
+                    last = last->next;
+                pool->push( head, last, count );
+            }
+        }
+        MemoryPool*     pool;
+        Slot*           head;
+        quint32         count;
+        quint32         hits;
+    };
+
+    static const quint32    MagazineSize = 16;
+
     MemoryPool()
     {
+        m_maxElements.fetchAndStoreRelaxed( NB_ELEM * 16 );
+        m_maxIdle.fetchAndStoreRelaxed( NB_ELEM );
         for ( size_t i = 0; i < NB_ELEM; ++i )
-            m_pool.enqueue( new quint8[ sizeof(T) ] );
-        m_mutex = new QMutex;
+        {
+            Slot*   slot = new Slot;
+            push( slot, slot, 1 );
+        }
+        m_nbAllocated.fetchAndStoreRelaxed( NB_ELEM );
     }
     ~MemoryPool()
     {
-        while ( m_pool.size() != 0 )
+        // Flush the current thread magazine, then free everything we can reach.
+        m_magazines.setLocalData( NULL );
+        Slot*   slot = m_freeList.fetchAndStoreAcquire( NULL );
+        while ( slot != NULL )
         {
-            quint8*  ptr = m_pool.dequeue();
-            delete ptr;
+            Slot*   next = slot->next;
+            delete slot;
+            slot = next;
         }
-        delete m_mutex;
     }
-    QQueue<quint8*>     m_pool;
-    QMutex*             m_mutex;
-    friend class Singleton< MemoryPool<T> >;
+
+    static int      load( const QAtomicInt& value )
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+        return value.load();
+#else
+        return value;
+#endif
+    }
+
+    static Slot*    load( const QAtomicPointer<Slot>& value )
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+        return value.load();
+#else
+        return value;
+#endif
+    }
+
+    Magazine*   magazine()
+    {
+        if ( m_magazines.hasLocalData() == false )
+            m_magazines.setLocalData( new Magazine( this ) );
+        return m_magazines.localData();
+    }
+
+    Slot*       allocate()
+    {
+        if ( m_nbAllocated.fetchAndAddRelaxed( 1 ) >= load( m_maxElements ) )
+        {
+            m_fallbacks.fetchAndAddRelaxed( 1 );
+            vlmcDebug() << "Memory pool is full, allocating an extra element";
+        }
+        else
+            m_misses.fetchAndAddRelaxed( 1 );
+        return new Slot;
+    }
+
+    /**
+     *  Pushing a chain is ABA safe, as we never dereference the previous head.
+     */
+    void        push( Slot* first, Slot* last, int count )
+    {
+        Slot*   head;
+        do
+        {
+            head = load( m_freeList );
+            last->next = head;
+        } while ( m_freeList.testAndSetRelease( head, first ) == false );
+        m_nbFree.fetchAndAddRelaxed( count );
+    }
+
+    /**
+     *  Detach the whole free list at once, keep what we need and push the rest back.
+     *  Doing so avoids the ABA problem a single element pop would have.
+     */
+    void        refill( Magazine* mag )
+    {
+        Slot*   list = m_freeList.fetchAndStoreAcquire( NULL );
+        if ( list == NULL )
+            return ;
+        Slot*   last = list;
+        quint32 count = 1;
+        while ( count < MagazineSize / 2 && last->next != NULL )
+        {
+            last = last->next;
+            ++count;
+        }
+        Slot*   remaining = last->next;
+        last->next = mag->head;
+        mag->head = list;
+        mag->count += count;
+        m_nbFree.fetchAndAddRelaxed( -(int)count );
+        if ( remaining == NULL )
+            return ;
+        // Most of the time, nobody pushed anything meanwhile.
+        if ( m_freeList.testAndSetRelease( NULL, remaining ) == true )
+            return ;
+        Slot*   remainingLast = remaining;
+        int     nbRemaining = 1;
+        while ( remainingLast->next != NULL )
+        {
+            remainingLast = remainingLast->next;
+            ++nbRemaining;
+        }
+        // push() will account for them again.
+        m_nbFree.fetchAndAddRelaxed( -nbRemaining );
+        push( remaining, remainingLast, nbRemaining );
+    }
+
+    void        spill( Magazine* mag )
+    {
+        Slot*   first = mag->head;
+        Slot*   last = first;
+        quint32 count = 1;
+        while ( count < MagazineSize / 2 )
+        {
+            last = last->next;
+            ++count;
+        }
+        mag->head = last->next;
+        mag->count -= count;
+        last->next = NULL;
+
+        if ( load( m_nbFree ) >= load( m_maxIdle ) )
+        {
+            // We have enough idle elements already, release this batch.
+            while ( first != NULL )
+            {
+                Slot*   next = first->next;
+                delete first;
+                first = next;
+            }
+            m_nbAllocated.fetchAndAddRelaxed( -(int)count );
+            return ;
+        }
+        push( first, last, count );
+    }
+
+private:
+    QAtomicPointer<Slot>        m_freeList;
+    QThreadStorage<Magazine*>   m_magazines;
+    /// Approximate count of elements in m_freeList
+    QAtomicInt                  m_nbFree;
+    QAtomicInt                  m_nbAllocated;
+    QAtomicInt                  m_maxElements;
+    QAtomicInt                  m_maxIdle;
+    QAtomicInt                  m_hits;
+    QAtomicInt                  m_misses;
+    QAtomicInt                  m_fallbacks;
+
+    friend class Singleton< MemoryPool<T, NB_ELEM> >;
 };
 
 #endif // MEMORYPOOL_HPP
-
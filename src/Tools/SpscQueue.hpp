@@ -0,0 +1,183 @@
+/*****************************************************************************
+ * SpscQueue.hpp: Bounded queue between a producer and a consumer thread
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QtGlobal>
+
+/**
+ *  \brief  A bounded FIFO of T, for one producer thread and one consumer thread.
+ *
+ *  The values live in a ring of slots. The producer only writes the tail index,
+ *  and the consumer only writes the head index, so pushing and popping never
+ *  take a lock, and the producer can fill a slot while the consumer reads another.
+ *  A thread may still wait for the queue to become non empty or non full: the
+ *  other side only takes the wait lock when someone is actually waiting.
+ *
+ *  \warning    Several producers (or consumers) have to be serialized by the caller.
+ */
+template <typename T>
+class       SpscQueue
+{
+public:
+    explicit SpscQueue( quint32 capacity ) :
+        m_size( capacity + 1 )
+    {
+        // One slot is always left empty, to tell a full queue from an empty one.
+        m_slots = new T[m_size];
+    }
+    ~SpscQueue()
+    {
+        delete[] m_slots;
+    }
+
+    quint32     capacity() const
+    {
+        return m_size - 1;
+    }
+
+    quint32     count() const
+    {
+        const int   count = m_tail.fetchAndAddAcquire( 0 ) - m_head.fetchAndAddAcquire( 0 );
+        return count < 0 ? count + m_size : count;
+    }
+
+    bool        isEmpty() const
+    {
+        return count() == 0;
+    }
+
+    bool        isFull() const
+    {
+        return count() == capacity();
+    }
+
+    /**
+     *  \brief  Producer side: append a value.
+     *
+     *  \returns    false if the queue is full.
+     */
+    bool        push( const T& value )
+    {
+        const int   tail = m_tail.fetchAndAddRelaxed( 0 );
+        const int   next = ( tail + 1 ) % m_size;
+        if ( next == m_head.fetchAndAddAcquire( 0 ) )
+            return false;
+        m_slots[tail] = value;
+        // Ordered, so that the value is published before we look for a waiter.
+        m_tail.fetchAndStoreOrdered( next );
+        if ( m_nbWaiters.fetchAndAddOrdered( 0 ) > 0 )
+            wake();
+        return true;
+    }
+
+    /**
+     *  \brief  Consumer side: take the oldest value out.
+     *
+     *  \returns    false if the queue is empty.
+     */
+    bool        pop( T& value )
+    {
+        const int   head = m_head.fetchAndAddRelaxed( 0 );
+        if ( head == m_tail.fetchAndAddAcquire( 0 ) )
+            return false;
+        value = m_slots[head];
+        m_head.fetchAndStoreOrdered( ( head + 1 ) % m_size );
+        if ( m_nbWaiters.fetchAndAddOrdered( 0 ) > 0 )
+            wake();
+        return true;
+    }
+
+    /**
+     *  \brief  Consumer side: the oldest value, which stays in the queue.
+     *
+     *  \warning    The queue must not be empty.
+     */
+    const T&    head() const
+    {
+        Q_ASSERT( isEmpty() == false );
+        return m_slots[m_head.fetchAndAddRelaxed( 0 )];
+    }
+
+    /**
+     *  \brief  Wait until a value is pushed, or wake() is called.
+     *
+     *  \returns    false if the timeout expired.
+     */
+    bool        waitForData( unsigned long timeout )
+    {
+        return wait( 0, timeout );
+    }
+
+    /**
+     *  \brief  Wait until less than maxCount values are queued, or wake() is called.
+     *
+     *  \returns    false if the timeout expired.
+     */
+    bool        waitForRoom( quint32 maxCount, unsigned long timeout )
+    {
+        return wait( qMin( maxCount, capacity() ), timeout );
+    }
+
+    /**
+     *  \brief  Wake the waiting threads up, so they can check they still have to wait.
+     */
+    void        wake()
+    {
+        QMutexLocker    lock( &m_waitLock );
+        m_waitCond.wakeAll();
+    }
+
+private:
+    SpscQueue( const SpscQueue& );
+    SpscQueue&  operator=( const SpscQueue& );
+
+    /// Waits for some data if maxCount is 0, for some room otherwise.
+    bool        wait( quint32 maxCount, unsigned long timeout )
+    {
+        QMutexLocker    lock( &m_waitLock );
+        // Announce ourselves before checking, so that a push or pop can't slip in between.
+        m_nbWaiters.fetchAndAddOrdered( 1 );
+        bool    ret = true;
+        if ( ( maxCount == 0 && isEmpty() == true ) || ( maxCount > 0 && count() >= maxCount ) )
+            ret = m_waitCond.wait( &m_waitLock, timeout );
+        m_nbWaiters.fetchAndAddOrdered( -1 );
+        return ret;
+    }
+
+private:
+    T*                      m_slots;
+    const int               m_size;
+    /// The next slot to read, only written by the consumer.
+    mutable QAtomicInt      m_head;
+    /// The next slot to write, only written by the producer.
+    mutable QAtomicInt      m_tail;
+    QAtomicInt              m_nbWaiters;
+    QMutex                  m_waitLock;
+    QWaitCondition          m_waitCond;
+};
+
+#endif // SPSCQUEUE_HPP
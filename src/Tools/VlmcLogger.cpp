@@ -32,6 +32,7 @@
 
 VlmcLogger::VlmcLogger()
     : m_logFile( NULL )
+    , m_consoleOutput( stdout )
     , m_backendLogLevel( Backend::IBackend::None )
 {
 }
@@ -107,6 +108,12 @@ VlmcLogger::setup()
 #endif
 }
 
+void
+VlmcLogger::setConsoleOutput( FILE *output )
+{
+    m_consoleOutput = output;
+}
+
 void
 VlmcLogger::logLevelChanged( const QVariant &logLevel )
 {
@@ -160,13 +167,13 @@ VlmcLogger::outputToConsole( int level, const char *msg )
     switch ( (QtMsgType)level )
     {
     case QtDebugMsg:
-        fprintf(stdout, "%s\n", msg);
+        fprintf(m_consoleOutput, "%s\n", msg);
         break;
     case QtWarningMsg:
-        fprintf(stdout, "%s\n", msg);
+        fprintf(m_consoleOutput, "%s\n", msg);
         break;
     case QtCriticalMsg:
-        fprintf(stdout, "%s\n", msg);
+        fprintf(m_consoleOutput, "%s\n", msg);
         break;
     case QtFatalMsg:
         fprintf(stderr, "%s\n", msg);
@@ -57,11 +57,19 @@ class   VlmcLogger : public QObject
         static void     backendLogHandler( void* data, Backend::IBackend::LogLevel logLevel, const char* msg );
 
         void            setup();
+        /**
+         *  \brief  Set where the messages are printed, stdout by default.
+         *
+         *  The console renderer writes its progress to stdout, so the logs go to
+         *  stderr instead.
+         */
+        void            setConsoleOutput( FILE* output );
     private:
         void            writeToFile(const char* msg);
         void            outputToConsole( int level, const char* msg );
 
         FILE*                           m_logFile;
+        FILE*                           m_consoleOutput;
         LogLevel                        m_currentLogLevel;
         Backend::IBackend::LogLevel     m_backendLogLevel;
 
@@ -29,43 +29,62 @@
 #include <QMutexLocker>
 #include <QStringBuilder>
 
-AudioClipWorkflow::AudioClipWorkflow( ClipHelper *ch ) :
-        ClipWorkflow( ch ),
-        m_lastReturnedBuffer( NULL )
+/// How long the decoder waits for some room before checking if it's still needed, in ms.
+static const unsigned long  RoomWaitDelay = 100;
+
+AudioClipWorkflow::AudioClipWorkflow( ClipHelper *ch, MainWorkflow* workflow ) :
+        ClipWorkflow( ch, workflow ),
+        m_computedBuffers( nbBuffers ),
+        m_availableBuffers( nbBuffers ),
+        m_decodingBuffer( NULL ),
+        m_lastReturnedBuffer( NULL ),
+        m_bufferSize( 0 )
 {
-    m_ptsOffset = 0;
+    m_maxQueueDepth = nbBuffers;
 }
 
 AudioClipWorkflow::~AudioClipWorkflow()
 {
     stop();
+    waitForInitTask();
+    releasePrealocated();
 }
 
 void
 AudioClipWorkflow::preallocate()
 {
-    for ( quint32 i = 0; i < AudioClipWorkflow::nbBuffers; ++i )
+    QMutexLocker    lock( m_renderLock );
+
+    //More buffers will be allocated on demand if the FrameBudget allows it.
+    quint32         nbSamples = m_availableBuffers.count() + m_computedBuffers.count();
+    for ( ; nbSamples < getMaxComputedBuffers(); ++nbSamples )
     {
         Workflow::AudioSample *as = new Workflow::AudioSample;
         as->buff = NULL;
-        m_availableBuffers.push_back( as );
+        recycle( as );
     }
 }
 
 void
 AudioClipWorkflow::releasePrealocated()
 {
-    while ( m_availableBuffers.isEmpty() == false )
+    QMutexLocker            lockDecode( m_decodeLock );
+    QMutexLocker            lock( m_renderLock );
+    Workflow::AudioSample   *as;
+
+    while ( m_availableBuffers.pop( as ) == true )
+        deleteBuffer( as );
+    while ( m_computedBuffers.pop( as ) == true )
+        deleteBuffer( as );
+    if ( m_decodingBuffer != NULL )
     {
-        Workflow::AudioSample *as = m_availableBuffers.takeFirst();
-        delete as->buff;
-        delete as;
+        deleteBuffer( m_decodingBuffer );
+        m_decodingBuffer = NULL;
     }
-    while ( m_computedBuffers.isEmpty() == false )
+    if ( m_lastReturnedBuffer != NULL )
     {
-        Workflow::AudioSample *as = m_computedBuffers.takeFirst();
-        delete as->buff;
-        delete as;
+        deleteBuffer( m_lastReturnedBuffer );
+        m_lastReturnedBuffer = NULL;
     }
 }
 
@@ -76,16 +95,25 @@ AudioClipWorkflow::getOutput( ClipWorkflow::GetMode mode, qint64 )
 
     if ( m_lastReturnedBuffer != NULL )
     {
-        m_availableBuffers.enqueue( m_lastReturnedBuffer );
+        //Our queue depth may have been reduced, don't keep more buffers than required.
+        if ( m_availableBuffers.count() + m_computedBuffers.count() >= getMaxComputedBuffers() )
+            deleteBuffer( m_lastReturnedBuffer );
+        else
+            recycle( m_lastReturnedBuffer );
         m_lastReturnedBuffer = NULL;
     }
     if ( getNbComputedBuffers() == 0 )
+    {
+        if ( shouldRender() == true )
+            m_starved = true;
         return NULL;
+    }
     if ( shouldRender() == false )
         return NULL;
     if ( mode == ClipWorkflow::Get )
         vlmcCritical() << "A sound buffer should never be asked with 'Get' mode";
-    Workflow::AudioSample   *buff = m_computedBuffers.dequeue();
+    Workflow::AudioSample   *buff;
+    m_computedBuffers.pop( buff );
     if ( m_previousPts == -1 )
     {
         buff->ptsDiff = 0;
@@ -96,7 +124,6 @@ AudioClipWorkflow::getOutput( ClipWorkflow::GetMode mode, qint64 )
         buff->ptsDiff = buff->pts - m_previousPts;
         m_previousPts = buff->pts;
     }
-    postGetOutput();
     m_lastReturnedBuffer = buff;
     return buff;
 }
@@ -107,6 +134,8 @@ void AudioClipWorkflow::initializeInternals()
     m_renderer->setOutputAudioCodec( "f32l" );
     m_renderer->setOutputAudioNumberChannels( 2 );
     m_renderer->setOutputAudioSampleRate( 48000 );
+    //Our buffers are bounded, the decoder waits for the workflow to consume them.
+    m_renderer->setMemoryOutputBlocking( true );
     m_renderer->enableAudioOutputToMemory( this, &lock, &unlock, m_fullSpeedRender );
 }
 
@@ -119,25 +148,52 @@ AudioClipWorkflow::createBuffer( size_t size )
     return as;
 }
 
+void
+AudioClipWorkflow::deleteBuffer( Workflow::AudioSample *as )
+{
+    delete[] as->buff;
+    delete as;
+}
+
+void
+AudioClipWorkflow::recycle( Workflow::AudioSample *as )
+{
+    if ( m_availableBuffers.push( as ) == false )
+        deleteBuffer( as );
+}
+
 void
 AudioClipWorkflow::lock( void *data, quint8 **pcm_buffer , size_t size )
 {
     AudioClipWorkflow* cw = reinterpret_cast<AudioClipWorkflow*>( data );
-    cw->m_renderLock->lock();
 
-    Workflow::AudioSample     *as = NULL;
-    if ( cw->m_availableBuffers.isEmpty() == true )
+    //Block until the workflow consumed enough buffers, this is what paces the renderer.
+    //The seeks and stops can go through meanwhile.
+    bool                waited = false;
+    while ( cw->shouldRender() == true &&
+            cw->m_computedBuffers.count() >= cw->getMaxComputedBuffers() )
+    {
+        cw->m_computedBuffers.waitForRoom( cw->getMaxComputedBuffers(), RoomWaitDelay );
+        waited = true;
+    }
+    //The consumer never takes this lock to output a buffer, only to change what we're doing.
+    cw->m_decodeLock->lock();
+    //Waiting isn't decoding.
+    if ( waited == true )
+        cw->m_lastDecodeDate = mdate();
+
+    //A buffer which got dropped is reused as is.
+    Workflow::AudioSample     *as = cw->m_decodingBuffer;
+    if ( as == NULL && cw->m_availableBuffers.pop( as ) == false )
         as = cw->createBuffer( size );
-    else
+    else if ( as->buff == NULL || as->size < size )
     {
-        as = cw->m_availableBuffers.dequeue();
-        if ( as->buff == NULL )
-        {
-            as->buff = new uchar[size];
-            as->size = size;
-        }
+        delete[] as->buff;
+        as->buff = new uchar[size];
+        as->size = size;
     }
-    cw->m_computedBuffers.enqueue( as );
+    cw->m_decodingBuffer = as;
+    cw->m_bufferSize = size;
     *pcm_buffer = as->buff;
 }
 
@@ -147,53 +203,33 @@ AudioClipWorkflow::unlock( void* data, uint8_t *pcm_buffer, unsigned int channel
                             size_t size, int64_t pts )
 {
     Q_UNUSED( pcm_buffer );
-    Q_UNUSED( rate );
     Q_UNUSED( bits_per_sample );
     Q_UNUSED( size );
 
     AudioClipWorkflow* cw = reinterpret_cast<AudioClipWorkflow*>( data );
-    pts -= cw->m_ptsOffset;
-    Workflow::AudioSample* as = cw->m_computedBuffers.last();
-    if ( as->buff != NULL )
+    Workflow::AudioSample* as = cw->m_decodingBuffer;
+    as->nbSample = nb_samples;
+    as->nbChannels = channels;
+    as->ptsDiff = 0;
+    as->pts = pts;
+    if ( cw->m_skipDuration > 0 && rate != 0 )
     {
-        as->nbSample = nb_samples;
-        as->nbChannels = channels;
-        as->ptsDiff = 0;
-        as->pts = pts;
-        if ( cw->m_pauseDuration != -1 )
-        {
-            cw->m_ptsOffset += cw->m_pauseDuration;
-            cw->m_pauseDuration = -1;
-        }
-        if ( cw->m_currentPts > pts )
-        {
-            cw->m_computedBuffers.removeLast();
-            cw->insertPastBlock( as );
-        }
-        else
-            cw->m_currentPts = pts;
+        //We were asked to start further, after a seek or a handoff.
+        cw->m_skipDuration -= (qint64)nb_samples * 1000000 / rate;
+        cw->m_decodeLock->unlock();
+        return ;
     }
+    //The published blocks can't be reordered anymore: play a late one right away.
+    if ( cw->m_currentPts > pts )
+        as->pts = cw->m_currentPts;
+    else
+        cw->m_currentPts = pts;
     cw->commonUnlock();
-    cw->m_renderLock->unlock();
-}
-
-void
-AudioClipWorkflow::insertPastBlock( Workflow::AudioSample *as )
-{
-    QQueue<Workflow::AudioSample*>::iterator    it = m_computedBuffers.begin();
-    QQueue<Workflow::AudioSample*>::iterator    end = m_computedBuffers.end();
-
-    while ( it != end )
-    {
-        if ( (*it)->pts > as->pts )
-        {
-            m_computedBuffers.insert( it, as );
-            return ;
-        }
-        ++it;
-    }
-    //Fail safe: reinsert the block at the end.
-    m_computedBuffers.push_back( as );
+    cw->m_decodingBuffer = NULL;
+    //Only we fill this queue, and we waited for some room before decoding.
+    if ( cw->m_computedBuffers.push( as ) == false )
+        deleteBuffer( as );
+    cw->m_decodeLock->unlock();
 }
 
 quint32
@@ -202,19 +238,54 @@ AudioClipWorkflow::getNbComputedBuffers() const
     return m_computedBuffers.count();
 }
 
-quint32
-AudioClipWorkflow::getMaxComputedBuffers() const
+size_t
+AudioClipWorkflow::computedBufferSize() const
 {
-    return AudioClipWorkflow::nbBuffers;
+    return m_bufferSize;
 }
 
 void
 AudioClipWorkflow::flushComputedBuffers()
 {
-    QMutexLocker        lock( m_renderLock );
+    QMutexLocker            lock( m_renderLock );
+    Workflow::AudioSample   *as;
+
+    while ( m_computedBuffers.pop( as ) == true )
+        recycle( as );
+}
+
+void
+AudioClipWorkflow::handOverBuffers( ClipWorkflow *next, qint64 skipDuration )
+{
+    AudioClipWorkflow*      cw = static_cast<AudioClipWorkflow*>( next );
+    QMutexLocker            lockDecode( m_decodeLock );
+    QMutexLocker            lock( m_renderLock );
+    Workflow::AudioSample   *as;
 
-    while ( m_computedBuffers.isEmpty() == false )
+    while ( skipDuration > 0 && m_computedBuffers.pop( as ) == true )
     {
-        m_availableBuffers.enqueue( m_computedBuffers.dequeue() );
+        skipDuration -= (qint64)as->nbSample * 1000000 / 48000;
+        recycle( as );
     }
+    //The next clip was flushed when stopped, and its decoder waits for us.
+    while ( m_computedBuffers.pop( as ) == true )
+    {
+        if ( cw->m_computedBuffers.push( as ) == false )
+            deleteBuffer( as );
+    }
+    if ( m_decodingBuffer != NULL )
+    {
+        cw->recycle( m_decodingBuffer );
+        m_decodingBuffer = NULL;
+    }
+    while ( m_availableBuffers.pop( as ) == true )
+        cw->recycle( as );
+    cw->m_skipDuration = qMax<qint64>( skipDuration, 0 );
+    cw->m_bufferSize = m_bufferSize;
+}
+
+void
+AudioClipWorkflow::wakeBufferWaiters()
+{
+    m_computedBuffers.wake();
 }
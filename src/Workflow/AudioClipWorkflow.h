@@ -24,9 +24,9 @@
 #define AUDIOCLIPWORKFLOW_H
 
 #include "ClipWorkflow.h"
+#include "Tools/SpscQueue.hpp"
 
 #include <QPointer>
-#include <QQueue>
 
 namespace Workflow
 {
@@ -38,20 +38,24 @@ class   AudioClipWorkflow : public ClipWorkflow
     Q_OBJECT
 
     public:
-        AudioClipWorkflow( ClipHelper* ch );
+        AudioClipWorkflow( ClipHelper* ch, MainWorkflow* workflow );
         ~AudioClipWorkflow();
         virtual Workflow::OutputBuffer  *getOutput( ClipWorkflow::GetMode mode, qint64 currentFrame );
+        virtual size_t              computedBufferSize() const;
     protected:
         virtual quint32             getNbComputedBuffers() const;
-        virtual quint32             getMaxComputedBuffers() const;
         virtual void                flushComputedBuffers();
         virtual void                preallocate();
         virtual void                releasePrealocated();
+        virtual void                handOverBuffers( ClipWorkflow* next, qint64 skipDuration );
+        virtual void                wakeBufferWaiters();
 
     private:
         virtual void                initializeInternals();
         Workflow::AudioSample*      createBuffer( size_t size );
-        void                        insertPastBlock( Workflow::AudioSample* as );
+        static void                 deleteBuffer( Workflow::AudioSample* as );
+        /// Recycles a buffer the decoder won't fill, or deletes it if we have enough.
+        void                        recycle( Workflow::AudioSample* as );
         static void                 lock(void *data,
                                           quint8** pcm_buffer , size_t size );
         static void                 unlock(void *data,
@@ -61,10 +65,16 @@ class   AudioClipWorkflow : public ClipWorkflow
                                             size_t size, int64_t pts );
 
     private:
-        QQueue<Workflow::AudioSample*>      m_computedBuffers;
-        QQueue<Workflow::AudioSample*>      m_availableBuffers;
-        qint64                              m_ptsOffset;
+        /// Filled by the decoder, emptied by getOutput()
+        SpscQueue<Workflow::AudioSample*>   m_computedBuffers;
+        /// Filled by getOutput() and the flushes, emptied by the decoder
+        SpscQueue<Workflow::AudioSample*>   m_availableBuffers;
+        /// The buffer being decoded, between the lock and unlock callbacks.
+        Workflow::AudioSample               *m_decodingBuffer;
         Workflow::AudioSample               *m_lastReturnedBuffer;
+        /// The size of the last computed buffer
+        size_t                              m_bufferSize;
+        /// The maximum queue depth
         static const quint32   nbBuffers = 256;
 };
 
@@ -0,0 +1,273 @@
+/*****************************************************************************
+ * AudioMixer.cpp: Mixes the audio tracks down to a single stream
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Workflow/AudioMixer.h"
+
+#include "Tools/VlmcDebug.h"
+#include "Workflow/FramePool.h"
+
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+using namespace Workflow;
+
+const quint32   AudioMixer::NbChannels;
+const quint32   AudioMixer::SampleRate;
+
+/// Pts differences below this are considered as jitter, in microseconds.
+static const qint64     AlignmentTolerance = 20000;
+/// Past this, the track jumped somewhere else, in microseconds.
+static const qint64     MaxDrift = 1000000;
+/// A track never keeps more than a second of samples waiting.
+static const quint32    MaxPendingFrames = 48000;
+/// The output buffer grows by steps of this many bytes.
+static const size_t     BufferGranularity = 4096;
+/// The limiter leaves the samples under this untouched.
+static const float      LimiterThreshold = 0.8f;
+
+static void
+accumulate( float *dst, const float *src, quint32 nbFrames, float left, float right )
+{
+    const quint32   nbSamples = nbFrames * AudioMixer::NbChannels;
+    quint32         i = 0;
+#ifdef __SSE2__
+    const __m128    gains = _mm_setr_ps( left, right, left, right );
+    for ( ; i + 4 <= nbSamples; i += 4 )
+        _mm_storeu_ps( dst + i, _mm_add_ps( _mm_loadu_ps( dst + i ),
+                                            _mm_mul_ps( _mm_loadu_ps( src + i ), gains ) ) );
+#endif
+    for ( ; i < nbSamples; i += 2 )
+    {
+        dst[i] += src[i] * left;
+        dst[i + 1] += src[i + 1] * right;
+    }
+}
+
+/**
+ *  Above the threshold, the samples follow a curve which reaches 1 asymptotically,
+ *  with no slope discontinuity at the threshold.
+ *  The C and SSE2 versions perform the same operations, in the same order.
+ */
+static void
+limit( float *samples, quint32 nbSamples )
+{
+    const float     knee = 1.0f - LimiterThreshold;
+    const float     invKnee = 1.0f / knee;
+    quint32         i = 0;
+#ifdef __SSE2__
+    const __m128    signMask = _mm_set1_ps( -0.0f );
+    const __m128    threshold = _mm_set1_ps( LimiterThreshold );
+    const __m128    knee4 = _mm_set1_ps( knee );
+    const __m128    invKnee4 = _mm_set1_ps( invKnee );
+    const __m128    one = _mm_set1_ps( 1.0f );
+    for ( ; i + 4 <= nbSamples; i += 4 )
+    {
+        __m128      x = _mm_loadu_ps( samples + i );
+        __m128      a = _mm_andnot_ps( signMask, x );
+        __m128      over = _mm_cmpgt_ps( a, threshold );
+        if ( _mm_movemask_ps( over ) == 0 )
+            continue ;
+        __m128      u = _mm_mul_ps( _mm_sub_ps( a, threshold ), invKnee4 );
+        __m128      y = _mm_add_ps( threshold, _mm_mul_ps( knee4, _mm_div_ps( u, _mm_add_ps( one, u ) ) ) );
+        y = _mm_or_ps( y, _mm_and_ps( signMask, x ) );
+        _mm_storeu_ps( samples + i, _mm_or_ps( _mm_and_ps( over, y ), _mm_andnot_ps( over, x ) ) );
+    }
+#endif
+    for ( ; i < nbSamples; ++i )
+    {
+        const float     a = fabsf( samples[i] );
+        if ( a <= LimiterThreshold )
+            continue ;
+        const float     u = ( a - LimiterThreshold ) * invKnee;
+        const float     y = LimiterThreshold + knee * ( u / ( 1.0f + u ) );
+        samples[i] = samples[i] < 0.0f ? -y : y;
+    }
+}
+
+AudioMixer::AudioMixer( quint32 nbTracks ) :
+        m_tracks( nbTracks ),
+        m_reference( NULL )
+{
+    m_output.buff = NULL;
+    m_output.size = 0;
+    m_output.nbSample = 0;
+    m_output.nbChannels = NbChannels;
+    m_output.ptsDiff = 0;
+    m_output.pts = 0;
+}
+
+AudioMixer::~AudioMixer()
+{
+    FramePool::getInstance()->release( reinterpret_cast<quint32*>( m_output.buff ) );
+}
+
+void
+AudioMixer::reset()
+{
+    for ( int i = 0; i < m_tracks.size(); ++i )
+        m_tracks[i] = Track();
+    m_reference = NULL;
+}
+
+void
+AudioMixer::begin()
+{
+    for ( int i = 0; i < m_tracks.size(); ++i )
+        m_tracks[i].sample = NULL;
+    m_reference = NULL;
+}
+
+void
+AudioMixer::addTrack( quint32 trackId, AudioSample *sample, double gain, double pan )
+{
+    Q_ASSERT( trackId < (quint32)m_tracks.size() );
+
+    Track&      track = m_tracks[trackId];
+    track.gain = gain;
+    track.pan = qBound( -1.0, pan, 1.0 );
+    if ( sample == NULL )
+        return ;
+    if ( sample->nbChannels != NbChannels )
+    {
+        vlmcWarning() << "Can't mix a block of" << sample->nbChannels << "channels";
+        return ;
+    }
+    track.sample = sample;
+    if ( m_reference == NULL )
+        m_reference = sample;
+}
+
+AudioSample*
+AudioMixer::mix()
+{
+    if ( m_reference == NULL )
+        return NULL;
+
+    Track*      only = NULL;
+    quint32     nbActive = 0;
+    for ( int i = 0; i < m_tracks.size(); ++i )
+    {
+        if ( m_tracks[i].sample != NULL || m_tracks[i].nbFrames() > 0 )
+        {
+            only = &m_tracks[i];
+            ++nbActive;
+        }
+    }
+    // A single untouched track doesn't need any processing.
+    if ( nbActive == 1 && only->nbFrames() == 0 && only->gain == 1.0f && only->pan == 0.0f )
+    {
+        only->nextPts = m_reference->pts + (qint64)m_reference->nbSample * 1000000 / SampleRate;
+        return m_reference;
+    }
+
+    const quint32   nbFrames = m_reference->nbSample;
+    const size_t    size = nbFrames * NbChannels * sizeof( float );
+    quint32*        buffer = reinterpret_cast<quint32*>( m_output.buff );
+    if ( buffer == NULL || FramePool::getInstance()->bufferSize( buffer ) < size )
+    {
+        FramePool::getInstance()->release( buffer );
+        buffer = FramePool::getInstance()->get( ( size + BufferGranularity - 1 ) /
+                                                BufferGranularity * BufferGranularity );
+        m_output.buff = reinterpret_cast<unsigned char*>( buffer );
+    }
+    float*          out = reinterpret_cast<float*>( buffer );
+    memset( out, 0, size );
+
+    for ( int i = 0; i < m_tracks.size(); ++i )
+    {
+        Track&  track = m_tracks[i];
+        if ( track.sample != NULL )
+            push( track, track.sample );
+        const quint32   n = qMin( nbFrames, track.nbFrames() );
+        if ( n == 0 )
+            continue ;
+        accumulate( out, track.fifo.constData() + track.offset, n,
+                    track.gain * qMin( 1.0f, 1.0f - track.pan ),
+                    track.gain * qMin( 1.0f, 1.0f + track.pan ) );
+        consume( track, n );
+    }
+    limit( out, nbFrames * NbChannels );
+
+    m_output.size = size;
+    m_output.nbSample = nbFrames;
+    m_output.nbChannels = NbChannels;
+    m_output.pts = m_reference->pts;
+    m_output.ptsDiff = m_reference->ptsDiff;
+    return &m_output;
+}
+
+void
+AudioMixer::push( Track &track, const AudioSample *sample )
+{
+    const float*    src = reinterpret_cast<const float*>( sample->buff );
+    quint32         nbFrames = sample->nbSample;
+
+    if ( track.nextPts >= 0 )
+    {
+        const qint64    drift = sample->pts - track.nextPts;
+        if ( qAbs( drift ) > MaxDrift )
+        {
+            track.fifo.clear();
+            track.offset = 0;
+        }
+        else if ( drift > AlignmentTolerance )
+        {
+            // Some samples are missing, keep this block where it belongs.
+            track.fifo.insert( track.fifo.end(), drift * SampleRate / 1000000 * NbChannels, 0.0f );
+        }
+        else if ( drift < -AlignmentTolerance )
+        {
+            // This block overlaps what we already have.
+            const quint32   overlap = qMin<qint64>( nbFrames, -drift * SampleRate / 1000000 );
+            src += overlap * NbChannels;
+            nbFrames -= overlap;
+        }
+    }
+    track.nextPts = sample->pts + (qint64)sample->nbSample * 1000000 / SampleRate;
+
+    const int       size = track.fifo.size();
+    track.fifo.resize( size + nbFrames * NbChannels );
+    memcpy( track.fifo.data() + size, src, nbFrames * NbChannels * sizeof( float ) );
+    if ( track.nbFrames() > MaxPendingFrames )
+        consume( track, track.nbFrames() - MaxPendingFrames );
+}
+
+void
+AudioMixer::consume( Track &track, quint32 nbFrames )
+{
+    track.offset += nbFrames * NbChannels;
+    if ( track.offset >= track.fifo.size() )
+    {
+        track.fifo.clear();
+        track.offset = 0;
+    }
+    // Don't move the samples around for every block.
+    else if ( track.offset > track.fifo.size() / 2 )
+    {
+        track.fifo.remove( 0, track.offset );
+        track.offset = 0;
+    }
+}
@@ -0,0 +1,102 @@
+/*****************************************************************************
+ * AudioMixer.h: Mixes the audio tracks down to a single stream
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+#include <QVector>
+
+#include "Workflow/Types.h"
+
+namespace   Workflow
+{
+    /**
+     *  \brief  Sums the samples of several audio tracks.
+     *
+     *  Every track outputs f32l stereo at 48kHz, but not in blocks of the same
+     *  size, so each track has its own FIFO. Samples are placed in it according
+     *  to their pts: small gaps are filled with silence and small overlaps are
+     *  dropped, while large jumps (seeks, new clip) restart the FIFO.
+     *  The output block has the size of the highest track's block. Each track is
+     *  scaled by its gain and panned, then a soft limiter keeps the sum in range.
+     */
+    class   AudioMixer
+    {
+        public:
+            AudioMixer( quint32 nbTracks );
+            ~AudioMixer();
+
+            /**
+             *  \brief  Drop every pending sample. To be called when the render stops.
+             */
+            void            reset();
+            /**
+             *  \brief  Forget about the blocks of the previous call.
+             */
+            void            begin();
+            /**
+             *  \brief  Hand the block a track rendered for this call, if any.
+             *
+             *  Tracks are expected from the highest to the lowest.
+             *  \param  gain    The linear gain to apply.
+             *  \param  pan     From -1 (left) to 1 (right).
+             */
+            void            addTrack( quint32 trackId, AudioSample* sample, double gain, double pan );
+            /**
+             *  \returns    The mixed block, or the only block itself if it can be
+             *              used untouched. NULL if no track rendered anything.
+             *  \warning    The returned block is only valid until the next call.
+             */
+            AudioSample     *mix();
+
+            static const quint32    NbChannels = 2;
+            static const quint32    SampleRate = 48000;
+
+        private:
+            struct  Track
+            {
+                Track() : offset( 0 ), nextPts( -1 ), gain( 1.0f ), pan( 0.0f ), sample( NULL ) {}
+                /// Interleaved samples, starting at offset.
+                QVector<float>  fifo;
+                int             offset;
+                /// The expected pts of the next block, or -1 if unknown.
+                qint64          nextPts;
+                float           gain;
+                float           pan;
+                /// The block rendered for this call, if any.
+                AudioSample*    sample;
+
+                quint32         nbFrames() const { return ( fifo.size() - offset ) / NbChannels; }
+            };
+
+            void            push( Track& track, const AudioSample* sample );
+            void            consume( Track& track, quint32 nbFrames );
+
+        private:
+            QVector<Track>          m_tracks;
+            /// The highest track which rendered a block for this call
+            AudioSample*            m_reference;
+            AudioSample             m_output;
+    };
+}
+
+#endif // AUDIOMIXER_H
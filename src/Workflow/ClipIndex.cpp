@@ -0,0 +1,110 @@
+/*****************************************************************************
+ * ClipIndex.cpp: Finds the clips of a track overlapping a given frame
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Workflow/ClipIndex.h"
+
+#include "Workflow/ClipHelper.h"
+#include "Workflow/ClipWorkflow.h"
+
+using namespace Workflow;
+
+void
+ClipIndex::rebuild( const QMap<qint64, ClipWorkflow*>& clips )
+{
+    m_entries.clear();
+    m_entries.reserve( clips.size() );
+    QMap<qint64, ClipWorkflow*>::const_iterator     it = clips.begin();
+    QMap<qint64, ClipWorkflow*>::const_iterator     end = clips.end();
+    for ( ; it != end; ++it )
+    {
+        Entry   entry;
+        entry.start = it.key();
+        entry.end = it.key() + it.value()->getClipHelper()->length();
+        entry.clipWorkflow = it.value();
+        m_entries.append( entry );
+    }
+    m_maxEnd.fill( 0, 4 * m_entries.size() );
+    if ( m_entries.isEmpty() == false )
+        build( 0, 0, m_entries.size() - 1 );
+}
+
+qint64
+ClipIndex::build( int node, int first, int last )
+{
+    if ( first == last )
+        return m_maxEnd[node] = m_entries[first].end;
+    const int   middle = ( first + last ) / 2;
+    return m_maxEnd[node] = qMax( build( 2 * node + 1, first, middle ),
+                                  build( 2 * node + 2, middle + 1, last ) );
+}
+
+void
+ClipIndex::collect( int node, int first, int last, int bound,
+                    qint64 frame, QVector<Entry>& result ) const
+{
+    // Either nothing in there starts early enough, or everything ended already.
+    if ( first >= bound || m_maxEnd[node] < frame )
+        return ;
+    if ( first == last )
+    {
+        result.append( m_entries[first] );
+        return ;
+    }
+    const int   middle = ( first + last ) / 2;
+    collect( 2 * node + 1, first, middle, bound, frame, result );
+    collect( 2 * node + 2, middle + 1, last, bound, frame, result );
+}
+
+int
+ClipIndex::upperBound( qint64 frame ) const
+{
+    int     first = 0;
+    int     count = m_entries.size();
+    while ( count > 0 )
+    {
+        const int   step = count / 2;
+        if ( m_entries[first + step].start <= frame )
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+            count = step;
+    }
+    return first;
+}
+
+void
+ClipIndex::active( qint64 frame, QVector<Entry>& result ) const
+{
+    result.clear();
+    if ( m_entries.isEmpty() == false )
+        collect( 0, 0, m_entries.size() - 1, upperBound( frame ), frame, result );
+}
+
+void
+ClipIndex::starting( qint64 from, qint64 to, QVector<Entry>& result ) const
+{
+    result.clear();
+    for ( int i = upperBound( from ); i < m_entries.size() && m_entries[i].start < to; ++i )
+        result.append( m_entries[i] );
+}
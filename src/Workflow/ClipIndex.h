@@ -0,0 +1,77 @@
+/*****************************************************************************
+ * ClipIndex.h: Finds the clips of a track overlapping a given frame
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef CLIPINDEX_H
+#define CLIPINDEX_H
+
+#include <QMap>
+#include <QVector>
+
+class   ClipWorkflow;
+
+namespace   Workflow
+{
+    /**
+     *  \brief  An interval index over the clips of a track.
+     *
+     *  The clips are sorted by their starting frame, and a tree keeps the maximum
+     *  ending frame of each range of clips. This allows to find the clips covering
+     *  a frame without looking at the ones that ended before it.
+     *  The index is a snapshot: it has to be rebuilt whenever a clip is added,
+     *  moved, removed or resized.
+     */
+    class   ClipIndex
+    {
+        public:
+            struct  Entry
+            {
+                qint64          start;
+                /// The last frame of the clip, included.
+                qint64          end;
+                ClipWorkflow*   clipWorkflow;
+            };
+
+            void        rebuild( const QMap<qint64, ClipWorkflow*>& clips );
+            /**
+             *  \brief  Lists the clips for which start <= frame <= end, by starting frame.
+             */
+            void        active( qint64 frame, QVector<Entry>& result ) const;
+            /**
+             *  \brief  Lists the clips for which from < start < to, by starting frame.
+             */
+            void        starting( qint64 from, qint64 to, QVector<Entry>& result ) const;
+
+        private:
+            qint64      build( int node, int first, int last );
+            void        collect( int node, int first, int last, int bound,
+                                 qint64 frame, QVector<Entry>& result ) const;
+            /// \returns    The index of the first entry starting after frame.
+            int         upperBound( qint64 frame ) const;
+
+        private:
+            QVector<Entry>      m_entries;
+            /// Maximum ending frame of the entries below each node.
+            QVector<qint64>     m_maxEnd;
+    };
+}
+
+#endif // CLIPINDEX_H
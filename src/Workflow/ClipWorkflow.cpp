@@ -22,7 +22,10 @@
 
 #include <QMutex>
 #include <QReadWriteLock>
+#include <QRunnable>
+#include <QSemaphore>
 #include <QStringBuilder>
+#include <QThreadPool>
 #include <QWaitCondition>
 
 #include "vlmc.h"
@@ -32,82 +35,243 @@
 #include "Backend/ISource.h"
 #include "Backend/ISourceRenderer.h"
 #include "Media/Media.h"
+#include "Project/Project.h"
+#include "Settings/Settings.h"
 #include "Tools/RendererEventWatcher.h"
+#include "Workflow/FrameBudget.h"
+#include "Workflow/MainWorkflow.h"
+#include "Workflow/RendererPool.h"
 #include "Workflow/Types.h"
 
 #include "Tools/VlmcDebug.h"
 
-ClipWorkflow::ClipWorkflow( ClipHelper* ch )
+/// How long to wait for a renderer to play before asking it again, in milliseconds.
+static const int    RestartDelay = 200;
+/**
+ *  How much may be decoded and dropped after seeking to a keyframe, in milliseconds.
+ *  Past this, we let the demuxer seek on its own instead.
+ */
+static const qint64 MaxKeyframeSkip = 5000;
+
+class   ClipWorkflow::InitTask : public QRunnable
+{
+    public:
+        InitTask( ClipWorkflow* clipWorkflow ) :
+            m_clipWorkflow( clipWorkflow )
+        {
+            // The task is reused every time the clip gets started.
+            setAutoDelete( false );
+        }
+
+        virtual void    run()
+        {
+            QMutexLocker    lock( m_clipWorkflow->m_initMutex );
+            m_clipWorkflow->initializeRenderer();
+            m_clipWorkflow->m_pendingInits.deref();
+            m_clipWorkflow->m_initWaitCond->wakeAll();
+            m_clipWorkflow->m_workflow->notifyClipStarted();
+        }
+
+    private:
+        ClipWorkflow*   m_clipWorkflow;
+};
+
+ClipWorkflow::ClipWorkflow( ClipHelper* ch, MainWorkflow* workflow )
     : m_renderer( NULL )
     , m_eventWatcher( NULL )
     , m_clipHelper( ch )
+    , m_workflow( workflow )
     , m_state( ClipWorkflow::Stopped )
+    , m_queueDepth( 1 )
+    , m_maxQueueDepth( 1 )
+    , m_starved( false )
+    , m_decodeDuration( 0 )
+    , m_lastDecodeDate( 0 )
+    , m_playheadDistance( 0 )
+    , m_initDate( 0 )
+    , m_readyDate( 0 )
+    , m_seekDate( 0 )
+    , m_skipDuration( 0 )
 {
     m_stateLock = new QReadWriteLock;
+    m_initTask = new InitTask( this );
+    m_initMutex = new QMutex;
     m_initWaitCond = new QWaitCondition;
+    m_playingSem = new QSemaphore;
+    m_initPosition = -1;
     m_renderLock = new QMutex;
-    m_renderWaitCond = new QWaitCondition;
+    m_decodeLock = new QMutex;
     m_eventWatcher = new RendererEventWatcher;
 }
 
 ClipWorkflow::~ClipWorkflow()
 {
     delete m_eventWatcher;
-    delete m_renderWaitCond;
+    delete m_decodeLock;
     delete m_renderLock;
+    delete m_playingSem;
     delete m_initWaitCond;
+    delete m_initMutex;
+    delete m_initTask;
     delete m_stateLock;
 }
 
 void
-ClipWorkflow::initialize()
+ClipWorkflow::initialize( qint64 position )
 {
     QWriteLocker lock( m_stateLock );
+    if ( m_state != ClipWorkflow::Stopped )
+        return ;
     m_state = ClipWorkflow::Initializing;
+    m_initDate = mdate();
+    m_readyDate = 0;
+    m_seekDate = 0;
+    m_initPosition = position;
+    m_pendingInits.ref();
+    m_workflow->clipStartPool()->start( m_initTask );
+}
 
-    delete m_renderer;
-    m_renderer = m_clipHelper->clip()->getMedia()->source()->createRenderer( m_eventWatcher );
+qint64
+ClipWorkflow::takeInitialPosition()
+{
+    qint64  position = m_initPosition;
+    m_initPosition = -1;
+    return position;
+}
+
+void
+ClipWorkflow::initializeRenderer()
+{
+    {
+        QWriteLocker lock( m_stateLock );
+        //We may have been stopped before the pool got to us.
+        if ( m_state != ClipWorkflow::Initializing )
+            return ;
+        //Forget about the previous runs.
+        m_playingSem->tryAcquire( m_playingSem->available() );
+        createRenderer();
+    }
+    qint64      position;
+    while ( true )
+    {
+        const bool  playing = m_playingSem->tryAcquire( 1, RestartDelay );
+        QReadLocker lock( m_stateLock );
+        if ( m_state != ClipWorkflow::Initializing )
+            return ;
+        position = m_initPosition;
+        if ( playing == true )
+            break ;
+        //A warm renderer may have been resumed before the pause it was released
+        //with got processed, in which case it won't tell us it's playing.
+        m_renderer->start();
+    }
+    adjustBegin( qMax<qint64>( position, 0 ) );
 
+    QWriteLocker lock( m_stateLock );
+    if ( m_state != ClipWorkflow::Initializing )
+        return ;
+    disconnect( m_eventWatcher, SIGNAL( playing() ), this, SLOT( rendererPlaying() ) );
+    m_isRendering = true;
+    m_state = Rendering;
+}
+
+void
+ClipWorkflow::createRenderer()
+{
+    Media*      media = m_clipHelper->clip()->getMedia();
+
+    //This one was stopped while it was initializing.
+    delete m_renderer;
+    Backend::ISource*   proxy = NULL;
+    if ( canUseProxy() == true && m_workflow->useProxies() == true )
+        proxy = media->proxySource();
+    m_rendererKey.source = proxy != NULL ? proxy : media->source();
+    m_rendererKey.mrl = proxy != NULL ? media->proxyPath() : media->mrl();
+    m_rendererKey.proxy = ( proxy != NULL );
+    m_rendererKey.output = metaObject()->className();
+    m_rendererKey.width = m_workflow->getWidth();
+    m_rendererKey.height = m_workflow->getHeight();
+    m_rendererKey.fps = VLMC_PROJECT_GET_DOUBLE( "video/VLMCOutputFPS" );
+    m_rendererKey.timeSync = m_fullSpeedRender;
+    //A warm renderer is retargeted by initializeInternals(), then resumed by start().
+    m_renderer = m_workflow->rendererPool()->acquire( m_rendererKey, m_eventWatcher );
+
+    //Start small, the FrameBudget will give us more room if we need it.
+    m_queueDepth = qMin( m_maxQueueDepth, Workflow::FrameBudget::PreloadQueueDepth );
     preallocate();
     initializeInternals();
 
     m_currentPts = -1;
     m_previousPts = -1;
-    m_pauseDuration = -1;
-
-    //Use QueuedConnection to avoid getting called from intf-event callback, as
-    //we will trigger intf-event callback as well when setting time for this clip,
-    //thus resulting in a deadlock.
-    connect( m_eventWatcher, SIGNAL( playing() ), this, SLOT( loadingComplete() ), Qt::QueuedConnection );
+    m_starved = false;
+    m_decodeDuration = 0;
+    m_lastDecodeDate = 0;
+    m_skipDuration = 0;
+    m_workflow->frameBudget()->add( this );
+
+    //The slot only wakes the InitTask up: setting the time from the intf-event
+    //callback would trigger it again, thus resulting in a deadlock.
+    connect( m_eventWatcher, SIGNAL( playing() ), this, SLOT( rendererPlaying() ), Qt::DirectConnection );
     connect( m_eventWatcher, SIGNAL( endReached() ), this, SLOT( clipEndReached() ), Qt::DirectConnection );
     connect( m_eventWatcher, SIGNAL( errorEncountered() ), this, SLOT( errorEncountered() ) );
     m_renderer->start();
 }
 
 void
-ClipWorkflow::loadingComplete()
+ClipWorkflow::rendererPlaying()
 {
-    adjustBegin();
-    disconnect( m_eventWatcher, SIGNAL( playing() ), this, SLOT( loadingComplete() ) );
-    connect( m_eventWatcher, SIGNAL( playing() ), this, SLOT( mediaPlayerUnpaused() ), Qt::DirectConnection );
-    connect( m_eventWatcher, SIGNAL( paused() ), this, SLOT( mediaPlayerPaused() ), Qt::DirectConnection );
-    QWriteLocker lock( m_stateLock );
-    m_isRendering = true;
-    m_state = Rendering;
-    m_initWaitCond->wakeAll();
+    m_playingSem->release();
 }
 
 void
-ClipWorkflow::adjustBegin()
+ClipWorkflow::waitForInitTask()
+{
+    QMutexLocker    lock( m_initMutex );
+    while ( m_pendingInits.fetchAndAddOrdered( 0 ) > 0 )
+        m_initWaitCond->wait( m_initMutex );
+}
+
+bool
+ClipWorkflow::canUseProxy() const
+{
+    return false;
+}
+
+void
+ClipWorkflow::wakeBufferWaiters()
+{
+}
+
+void
+ClipWorkflow::adjustBegin( qint64 position )
 {
     if ( m_clipHelper->clip()->getMedia()->fileType() == Media::Video ||
          m_clipHelper->clip()->getMedia()->fileType() == Media::Audio )
     {
-        m_renderer->setTime( m_clipHelper->begin() /
-                                m_clipHelper->clip()->getMedia()->source()->fps() * 1000 );
+        seek( ( m_clipHelper->begin() + position ) /
+                m_clipHelper->clip()->getMedia()->source()->fps() * 1000 );
     }
 }
 
+void
+ClipWorkflow::seek( qint64 time )
+{
+    //Every frame of a proxy is a keyframe.
+    qint64          keyframe = m_rendererKey.proxy == true ? -1 :
+                               m_clipHelper->clip()->getMedia()->keyframeBefore( time );
+    if ( keyframe >= 0 && time - keyframe > MaxKeyframeSkip )
+        keyframe = -1;
+    //Without keyframes, or past the part of the media they were looked for in, we land
+    //wherever the demuxer decides.
+    m_renderer->setTime( keyframe >= 0 ? keyframe : time );
+    //Don't output what was decoded before getting there.
+    QMutexLocker    lock( m_decodeLock );
+    resyncClipWorkflow();
+    //Decode from the keyframe, and drop what precedes the requested frame.
+    if ( keyframe >= 0 )
+        m_skipDuration = ( time - keyframe ) * 1000;
+}
+
 ClipWorkflow::State
 ClipWorkflow::getState() const
 {
@@ -118,6 +282,9 @@ void
 ClipWorkflow::clipEndReached()
 {
     m_state = EndReached;
+    //Don't leave an InitTask waiting for a playing event that won't come.
+    m_playingSem->release();
+    m_workflow->notifyPrerollProgress();
 }
 
 void
@@ -126,105 +293,143 @@ ClipWorkflow::stop()
     QWriteLocker    lockState( m_stateLock );
 
     //Let's make sure the ClipWorkflow isn't beeing stopped from another thread.
-    if ( m_renderer && m_state != Stopped )
+    if ( m_state == Stopped )
+        return ;
+    const State                 state = m_state;
+    //A decoder blocked on our buffers has to give up before the renderer can stop.
+    if ( m_state != Error )
+        m_state = Stopped;
+    wakeBufferWaiters();
+    Backend::ISourceRenderer*   warmRenderer = NULL;
+    //The InitTask may not have created the renderer yet, it will then give up.
+    if ( m_renderer != NULL )
     {
-        m_renderer->stop();
+        //Once initialized, the renderer is paused and kept for the next clip of this media.
+        if ( state == Rendering )
+        {
+            m_renderer->playPause();
+            warmRenderer = m_renderer;
+            m_renderer = NULL;
+        }
+        else
+            m_renderer->stop();
         m_eventWatcher->disconnect();
-        if ( m_state != Error )
-            m_state = Stopped;
-        flushComputedBuffers();
-        m_isRendering = false;
-
-        m_initWaitCond->wakeAll();
-        m_renderWaitCond->wakeAll();
-    }
-}
-
-void
-ClipWorkflow::setTime( qint64 time )
-{
-    vlmcDebug() << "Setting ClipWorkflow" << m_clipHelper->uuid() << "time:" << time;
-    m_renderer->setTime( time );
-    resyncClipWorkflow();
-    QWriteLocker    lock( m_stateLock );
-    if ( m_state == ClipWorkflow::Paused )
-    {
-        m_renderer->playPause();
-        m_state = ClipWorkflow::UnpauseRequired;
     }
+    //The renderer may have reached its end meanwhile.
+    if ( m_state != Error )
+        m_state = Stopped;
+    m_workflow->frameBudget()->remove( this );
+    m_isRendering = false;
+
+    m_playingSem->release();
+    //The output callbacks in progress may need our locks.
+    lockState.unlock();
+    if ( warmRenderer != NULL )
+        m_workflow->rendererPool()->release( m_rendererKey, warmRenderer );
+    flushComputedBuffers();
+    //Give our buffers back while we're not rendering.
+    releasePrealocated();
 }
 
 bool
-ClipWorkflow::waitForCompleteInit()
+ClipWorkflow::handOff( ClipWorkflow* next, qint64 skipDuration )
 {
-    QReadLocker lock( m_stateLock );
-
-    if ( m_state != ClipWorkflow::Rendering && m_state != ClipWorkflow::Error )
+    Backend::ISourceRenderer*   renderer;
     {
-        m_initWaitCond->wait( m_stateLock );
+        QWriteLocker    lockState( m_stateLock );
+        QWriteLocker    lockNextState( next->m_stateLock );
 
-        if ( m_state != ClipWorkflow::Rendering )
+        if ( m_state != Rendering || m_renderer == NULL )
+            return false;
+        //An InitTask still running for the next clip would reposition our renderer.
+        if ( next->m_state != Stopped || next->m_pendingInits.fetchAndAddOrdered( 0 ) > 0 )
             return false;
+        renderer = m_renderer;
+        m_renderer = NULL;
+        //The renderer of a clip stopped while it was initializing.
+        delete next->m_renderer;
+        next->m_renderer = renderer;
+        next->m_rendererKey = m_rendererKey;
+        next->m_state = m_state;
+        next->m_initPosition = -1;
+        next->m_initDate = m_initDate;
+        next->m_readyDate = m_readyDate;
+        next->m_seekDate = 0;
+        next->m_starved = false;
+        next->m_queueDepth = m_queueDepth;
+        next->m_isRendering = true;
+        connect( next->m_eventWatcher, SIGNAL( endReached() ), next, SLOT( clipEndReached() ), Qt::DirectConnection );
+        connect( next->m_eventWatcher, SIGNAL( errorEncountered() ), next, SLOT( errorEncountered() ) );
+        renderer->setEventCallback( next->m_eventWatcher );
+        m_eventWatcher->disconnect();
+        m_state = Stopped;
+        m_isRendering = false;
     }
+    //A lock() waiting for room would only notice we stopped once it times out,
+    //and initializeInternals() waits for it.
+    wakeBufferWaiters();
+    Workflow::FrameBudget*  frameBudget = m_workflow->frameBudget();
+    frameBudget->remove( this );
+    next->preallocate();
+    {
+        //Hold the next clip's buffers back until ours are in front of them.
+        QMutexLocker    lockDecode( next->m_decodeLock );
+        QMutexLocker    lock( next->m_renderLock );
+        //This waits for the buffer we're being sent to be returned to us.
+        next->initializeInternals();
+        handOverBuffers( next, skipDuration );
+        next->m_currentPts = m_currentPts;
+        next->m_previousPts = m_previousPts;
+        next->m_decodeDuration = m_decodeDuration;
+        next->m_lastDecodeDate = m_lastDecodeDate;
+    }
+    frameBudget->add( next );
+    m_playingSem->release();
+    releasePrealocated();
     return true;
 }
 
 void
-ClipWorkflow::postGetOutput()
+ClipWorkflow::setTime( qint64 time )
 {
-    //If we're running out of computed buffers, refill our stack.
-    if ( getNbComputedBuffers() < getMaxComputedBuffers() / 3 )
-    {
-        QWriteLocker        lock( m_stateLock );
-        if ( m_state == ClipWorkflow::Paused )
-        {
-            m_state = ClipWorkflow::UnpauseRequired;
-            //This will act like an "unpause";
-            m_renderer->playPause();
-        }
-    }
+    vlmcDebug() << "Setting ClipWorkflow" << m_clipHelper->uuid() << "time:" << time;
+    m_seekDate = mdate();
+    seek( time );
 }
 
 void
 ClipWorkflow::commonUnlock()
 {
-    //Don't test using availableBuffer, as it may evolve if a buffer is required while
-    //no one is available : we would spawn a new buffer, thus modifying the number of available buffers
-    if ( getNbComputedBuffers() >= getMaxComputedBuffers() )
+    //The time spent blocked is excluded, as m_lastDecodeDate is set again once unblocked.
+    qint64      now = mdate();
+    if ( m_lastDecodeDate != 0 )
     {
-        QWriteLocker lock( m_stateLock );
-        m_state = ClipWorkflow::PauseRequired;
-        m_renderer->playPause();
+        qint64  duration = now - m_lastDecodeDate;
+        if ( m_decodeDuration == 0 )
+            m_decodeDuration = duration;
+        else
+            m_decodeDuration = ( m_decodeDuration * 7 + duration ) / 8;
     }
-}
-
-void
-ClipWorkflow::computePtsDiff( qint64 pts )
-{
-    if ( m_pauseDuration != -1 )
+    m_lastDecodeDate = now;
+    //Frames computed before the playing event precede the seek to our beginning.
+    if ( m_readyDate == 0 && m_state == ClipWorkflow::Rendering )
     {
-        //No need to check for m_currentPtr before, as we can't start in paused mode.
-        //so m_currentPts will not be -1
-        m_previousPts = m_currentPts + m_pauseDuration;
-        m_pauseDuration = -1;
+        m_readyDate = now;
+        m_clipHelper->clip()->getMedia()->addStartupLatency( now - m_initDate );
     }
-    else
-        m_previousPts = m_currentPts;
-    m_currentPts = qMax( pts, m_previousPts );
-}
-
-void
-ClipWorkflow::mediaPlayerPaused()
-{
-    m_state = ClipWorkflow::Paused;
-    m_beginPausePts = mdate();
+    else if ( m_seekDate != 0 )
+    {
+        m_clipHelper->clip()->getMedia()->addSeekLatency( now - m_seekDate );
+        m_seekDate = 0;
+    }
+    m_workflow->notifyPrerollProgress();
 }
 
 void
-ClipWorkflow::mediaPlayerUnpaused()
+ClipWorkflow::computePtsDiff( qint64 pts )
 {
-    m_state = ClipWorkflow::Rendering;
-    m_pauseDuration = mdate() - m_beginPausePts;
+    m_previousPts = m_currentPts;
+    m_currentPts = qMax( pts, m_previousPts );
 }
 
 void
@@ -233,6 +438,8 @@ ClipWorkflow::resyncClipWorkflow()
     flushComputedBuffers();
     m_previousPts = -1;
     m_currentPts = -1;
+    m_lastDecodeDate = 0;
+    m_skipDuration = 0;
 }
 
 void
@@ -281,6 +488,8 @@ void
 ClipWorkflow::errorEncountered()
 {
     m_state = Error;
+    m_playingSem->release();
+    m_workflow->notifyPrerollProgress();
     emit error( this );
 }
 
@@ -292,6 +501,70 @@ ClipWorkflow::shouldRender() const
              state != ClipWorkflow::Stopped);
 }
 
+quint32
+ClipWorkflow::getMaxComputedBuffers() const
+{
+    return m_queueDepth;
+}
+
+void
+ClipWorkflow::setQueueDepth( quint32 depth )
+{
+    m_queueDepth = qBound<quint32>( 1, depth, m_maxQueueDepth );
+}
+
+quint32
+ClipWorkflow::maxQueueDepth() const
+{
+    return m_maxQueueDepth;
+}
+
+bool
+ClipWorkflow::isPrerolled( quint32 nbBuffers ) const
+{
+    const ClipWorkflow::State   state = getState();
+    if ( state == ClipWorkflow::EndReached || state == ClipWorkflow::Error )
+        return true;
+    if ( state != ClipWorkflow::Rendering )
+        return false;
+    return getNbComputedBuffers() >= qMin( nbBuffers, getMaxComputedBuffers() );
+}
+
+qint64
+ClipWorkflow::decodeDuration() const
+{
+    return m_decodeDuration;
+}
+
+bool
+ClipWorkflow::hasStarved()
+{
+    if ( m_starved == true )
+    {
+        m_starved = false;
+        return true;
+    }
+    return false;
+}
+
+void
+ClipWorkflow::setPlayheadDistance( qint64 nbFrames )
+{
+    m_playheadDistance = nbFrames;
+}
+
+qint64
+ClipWorkflow::playheadDistance() const
+{
+    return m_playheadDistance;
+}
+
+qint64
+ClipWorkflow::readyDate() const
+{
+    return m_readyDate;
+}
+
 void
 ClipWorkflow::save( QXmlStreamWriter &project ) const
 {
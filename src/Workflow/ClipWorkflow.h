@@ -27,18 +27,22 @@
 
 #include "EffectsEngine/EffectUser.h"
 #include "ClipHelper.h"
+#include "Workflow/RendererPool.h"
 #include "Workflow/Types.h"
 
+#include <QAtomicInt>
 #include <QObject>
 #include <QUuid>
 #include <QXmlStreamWriter>
 
 class   Clip;
 class   Effect;
+class   MainWorkflow;
 class   RendererEventWatcher;
 
 class   QMutex;
 class   QReadWriteLock;
+class   QSemaphore;
 class   QWaitCondition;
 
 namespace Workflow
@@ -71,18 +75,8 @@ class   ClipWorkflow : public EffectUser
             /// \brief  Used when end is reached, IE no more frame has to be rendered, but the trackworkflow
             ///         may eventually ask for some.
             EndReached,         //3
-            // Here start internal states :
-            /// \brief  This state will be used when an unpause
-            ///         has been required
-            UnpauseRequired,    //4
-            /// \brief  This state will be used when a pause
-            ///         has been required
-            PauseRequired,      //5
-            /// \brief  This state will be used when the ISourceRenderer is paused,
-            ///         because of a sufficient number of computed buffers
-            Paused,             //6
             /// \brief  An error was encountered, this ClipWorkflow must not be used anymore.
-            Error               //7
+            Error               //4
         };
 
         /**
@@ -96,7 +90,7 @@ class   ClipWorkflow : public EffectUser
             Get,
         };
 
-        ClipWorkflow( ClipHelper* clip );
+        ClipWorkflow( ClipHelper* clip, MainWorkflow* workflow );
         virtual ~ClipWorkflow();
 
         /**
@@ -105,7 +99,6 @@ class   ClipWorkflow : public EffectUser
          *  of the rendering process advancement.
          */
         virtual Workflow::OutputBuffer      *getOutput( ClipWorkflow::GetMode mode, qint64 currentFrame ) = 0;
-        void                    postGetOutput();
         /**
          * @brief Initialize base variables for the SourceRenderer.
          *
@@ -114,7 +107,23 @@ class   ClipWorkflow : public EffectUser
          */
         virtual void            initializeInternals() = 0;
         virtual void            preallocate() = 0;
-        void                    initialize();
+        /**
+         *  \brief  Start this workflow in the background.
+         *
+         *  The renderer is created, started and positioned by the MainWorkflow's
+         *  clip start pool. The state remains Initializing until it's done, and
+         *  this method never waits for it.
+         *  \param  position    The frame to start at, from the beginning of the clip.
+         */
+        void                    initialize( qint64 position = 0 );
+        /**
+         *  \returns    The position passed to initialize(), the first time this is
+         *              called, -1 afterward.
+         *
+         *  As the playhead moves on while the clip is starting, the caller can
+         *  compare it with the current position once the clip is rendering.
+         */
+        qint64                  takeInitialPosition();
 
         /**
          *  \return             true if the ClipWorkflow is able to, and should render
@@ -154,8 +163,6 @@ class   ClipWorkflow : public EffectUser
          */
         virtual void            setTime( qint64 time );
 
-        bool                    waitForCompleteInit();
-
         /**
          *  \sa MainWorkflow::setFullSpeedRender();
          */
@@ -174,23 +181,99 @@ class   ClipWorkflow : public EffectUser
          */
         bool                    isResyncRequired();
 
+        /**
+         *  \brief  Set how many buffers may be computed ahead.
+         *
+         *  This is the high watermark at which the decoder blocks, and is driven
+         *  by the Workflow::FrameBudget. It is bounded by maxQueueDepth().
+         */
+        void                    setQueueDepth( quint32 depth );
+        quint32                 maxQueueDepth() const;
+        /**
+         *  \return true once nbBuffers buffers are computed, or when this workflow
+         *          won't compute any more of them (end reached or error).
+         *
+         *  nbBuffers is bounded by the queue depth, as the decoder doesn't go past it.
+         */
+        bool                    isPrerolled( quint32 nbBuffers ) const;
+        /**
+         *  \return The size of a computed buffer, in bytes.
+         */
+        virtual size_t          computedBufferSize() const = 0;
+        /**
+         *  \return The average time between two computed buffers, in microseconds,
+         *          or 0 if it hasn't been measured yet.
+         */
+        qint64                  decodeDuration() const;
+        /**
+         *  \return true if a buffer was requested while none was computed.
+         *
+         *  If so, true will be returned, and the flag will be set back to false
+         */
+        bool                    hasStarved();
+        /**
+         *  \brief  Set the number of frames before this clip gets rendered.
+         *
+         *  This is 0 for a clip that is being rendered.
+         */
+        void                    setPlayheadDistance( qint64 nbFrames );
+        qint64                  playheadDistance() const;
+        /**
+         *  \return The date at which the first frame was computed after the
+         *          initialization, or 0 if it wasn't yet.
+         */
+        qint64                  readyDate() const;
+        /**
+         *  \brief  Give the running renderer and the computed buffers to the next clip.
+         *
+         *  This is used when the next clip continues the same media, so that it
+         *  doesn't have to start and seek a new renderer. This workflow is then
+         *  stopped, and the next one takes over its state.
+         *  \param  next            A stopped ClipWorkflow of the same type, for the same media.
+         *  \param  skipDuration    How much of the media lies between the end of this
+         *                          clip and the beginning of the next one, in microseconds.
+         *                          This gets decoded and dropped.
+         *  \returns    false if this workflow isn't rendering or the next one isn't stopped.
+         */
+        bool                    handOff( ClipWorkflow* next, qint64 skipDuration );
+
         void                    save( QXmlStreamWriter& project ) const;
         virtual qint64          length() const;
         virtual Type            effectType() const;
 
     private:
-        void                    adjustBegin();
+        class   InitTask;
+        friend class    InitTask;
+
+        /// Run by the InitTask, on the clip start pool.
+        void                    initializeRenderer();
+        void                    createRenderer();
+        void                    adjustBegin( qint64 position );
+        /**
+         *  \brief  Position the renderer on the frame at time, in milliseconds.
+         *
+         *  When the keyframes of our media are known, the renderer seeks to the
+         *  one preceding time, and the frames up to time get decoded and dropped.
+         */
+        void                    seek( qint64 time );
+        /**
+         *  \brief  Drop the computed buffers, and start over with the next decoded one.
+         *
+         *  \warning    m_decodeLock has to be held.
+         */
+        void                    resyncClipWorkflow();
 
     protected:
         void                    computePtsDiff( qint64 pts );
         void                    commonUnlock();
         /**
-         *  \warning    Must be called from a thread safe context.
-         *              This thread safe context has to be set
-         *              from the underlying ClipWorkflow implementation.
+         *  \brief  The number of computed buffers waiting to be output.
+         *
+         *  This can be called from any thread, but the result is only a hint
+         *  when called from neither the decoder nor the consumer side.
          */
         virtual quint32         getNbComputedBuffers() const = 0;
-        virtual quint32         getMaxComputedBuffers() const = 0;
+        quint32                 getMaxComputedBuffers() const;
         /**
          *  \brief  Will empty the computed buffers stack.
          *          This has to be implemented in the underlying
@@ -202,14 +285,50 @@ class   ClipWorkflow : public EffectUser
          *  \brief  Release the preallocated buffers
          */
         virtual void            releasePrealocated() = 0;
+        /**
+         *  \brief  Move the computed and available buffers to the next clip.
+         *
+         *  The buffers covering skipDuration are dropped, and the next clip will
+         *  drop what's left of it once decoded.
+         *  \warning    The next clip's decode and render locks have to be held by the caller.
+         *  \sa     handOff()
+         */
+        virtual void            handOverBuffers( ClipWorkflow* next, qint64 skipDuration ) = 0;
+        /**
+         *  \brief  Wait until no initialization is running in the background.
+         *
+         *  This has to be called after stop() by the destructor of the underlying
+         *  implementation, as the initialization uses its virtual methods.
+         */
+        void                    waitForInitTask();
+        /**
+         *  \returns    true if this workflow may decode the proxy of its media
+         *              instead of the media itself, when the preview asks for it.
+         */
+        virtual bool            canUseProxy() const;
+        /**
+         *  \brief  Wake up the threads waiting for the computed buffers to be filled
+         *          or emptied, so that they notice we're stopping.
+         */
+        virtual void            wakeBufferWaiters();
 
     private:
+        InitTask                *m_initTask;
+        /// Held by the InitTask while it runs, so that a ClipWorkflow is never initialized twice at once.
+        QMutex                  *m_initMutex;
         /**
-         * @brief m_initWaitCond Used to synchronize initialization.
+         * @brief m_initWaitCond Signaled when an InitTask completes.
          *
-         * The associated lock is m_stateLock
+         * The associated lock is m_initMutex
          */
         QWaitCondition          *m_initWaitCond;
+        /// The number of InitTask runs which are queued or running.
+        QAtomicInt              m_pendingInits;
+        /// Released when the renderer starts playing, or when the initialization gets aborted.
+        QSemaphore              *m_playingSem;
+        qint64                  m_initPosition;
+        /// What the renderer was acquired with, to give it back to the RendererPool.
+        Workflow::RendererPool::Key     m_rendererKey;
         /**
          *  \brief              Used by the trackworkflow to query a clipworkflow resync.
          *
@@ -222,28 +341,43 @@ class   ClipWorkflow : public EffectUser
         Backend::ISourceRenderer*   m_renderer;
         RendererEventWatcher*       m_eventWatcher;
         ClipHelper*                 m_clipHelper;
+        /// The workflow this clip is rendered for.
+        MainWorkflow*               m_workflow;
+        /// Serializes the threads consuming the computed buffers.
         QMutex*                     m_renderLock;
+        /**
+         *  \brief  Held by the decoder from the lock to the unlock callback.
+         *
+         *  This is never taken by the consumer when outputting a buffer, only by
+         *  what changes the decoder's work: seeks, flushes, stops and handoffs.
+         *  When both are needed, it has to be locked before m_renderLock.
+         */
+        QMutex*                     m_decodeLock;
         QReadWriteLock*             m_stateLock;
         State                       m_state;
         qint64                      m_previousPts;
         qint64                      m_currentPts;
-        /**
-         *  \brief  This is used for basic synchronisation when
-         *          the clipworkflow hasn't generate a frame yet,
-         *          while the renderer asks for one.
-         */
-        QWaitCondition          *m_renderWaitCond;
-        qint64                  m_beginPausePts;
-        qint64                  m_pauseDuration;
         bool                    m_fullSpeedRender;
         bool                    m_muted;
+        /// The current high watermark, as set by the FrameBudget
+        quint32                 m_queueDepth;
+        /// The upper bound for m_queueDepth. This has to be set by the implementations.
+        quint32                 m_maxQueueDepth;
+        /// Has to be set to true by implementations when running out of computed buffers
+        bool                    m_starved;
+        qint64                  m_decodeDuration;
+        qint64                  m_lastDecodeDate;
+        qint64                  m_playheadDistance;
+        /// Used to measure the startup and seek latencies of our Media
+        qint64                  m_initDate;
+        qint64                  m_readyDate;
+        qint64                  m_seekDate;
+        /// What's still to be dropped after a handoff or a seek, in microseconds.
+        qint64                  m_skipDuration;
 
     private slots:
-        void                    loadingComplete();
+        void                    rendererPlaying();
         void                    clipEndReached();
-        void                    mediaPlayerPaused();
-        void                    mediaPlayerUnpaused();
-        void                    resyncClipWorkflow();
 
     protected slots:
         void                    errorEncountered();
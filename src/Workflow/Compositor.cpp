@@ -0,0 +1,405 @@
+/*****************************************************************************
+ * Compositor.cpp: Blends the video tracks together
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Workflow/Compositor.h"
+
+#include "Workflow/PixelConverter.h"
+#include "Workflow/Types.h"
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include <cstring>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+// The AVX2 path is built with a target attribute and picked at runtime, so
+// the binary still runs on CPUs without it.
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+# define VLMC_BLEND_AVX2
+# define VLMC_TARGET_AVX2 __attribute__((target("avx2")))
+# include <immintrin.h>
+#endif
+
+using namespace Workflow;
+
+/// Below this, splitting the rows costs more than it saves.
+static const quint32    MinRowsPerBand = 32;
+static const quint32    OpaqueBlack = 0xff000000;
+
+/**
+ *  Renders a band of rows of the composited frame.
+ */
+class   Compositor::BandTask : public QRunnable
+{
+    public:
+        BandTask( const Compositor* compositor, QSemaphore* done ) :
+            m_compositor( compositor ),
+            m_done( done ),
+            m_firstRow( 0 ),
+            m_nbRows( 0 )
+        {
+            setAutoDelete( false );
+        }
+
+        void    prepare( quint32 firstRow, quint32 nbRows, quint32 width )
+        {
+            m_firstRow = firstRow;
+            m_nbRows = nbRows;
+            // Room for two converted lines, as I420 chroma covers two of them.
+            if ( (quint32)m_scratch.size() < width * 2 )
+                m_scratch.resize( width * 2 );
+        }
+
+        virtual void    run()
+        {
+            m_compositor->compositeRows( m_firstRow, m_nbRows, m_scratch.data() );
+            m_done->release();
+        }
+
+    private:
+        const Compositor*   m_compositor;
+        QSemaphore*         m_done;
+        quint32             m_firstRow;
+        quint32             m_nbRows;
+        QVector<quint32>    m_scratch;
+};
+
+// The C and SIMD versions compute the exact same rounded x / 255.
+static inline quint32
+div255( quint32 x )
+{
+    x += 128;
+    return ( x + ( x >> 8 ) ) >> 8;
+}
+
+static inline quint32
+blendPixel( quint32 dst, quint32 src, quint32 opacity )
+{
+    const quint32   a = div255( ( src >> 24 ) * opacity );
+    quint32         out = OpaqueBlack;
+    for ( quint32 shift = 0; shift < 24; shift += 8 )
+    {
+        const quint32   s = ( src >> shift ) & 0xff;
+        const quint32   d = ( dst >> shift ) & 0xff;
+        out |= div255( s * a + d * ( 255 - a ) ) << shift;
+    }
+    return out;
+}
+
+#ifdef __SSE2__
+static inline __m128i
+div255( __m128i x )
+{
+    x = _mm_add_epi16( x, _mm_set1_epi16( 128 ) );
+    return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 ) ), 8 );
+}
+
+/**
+ *  Blends 2 pixels, unpacked as 16 bits per channel.
+ */
+static inline __m128i
+blend2( __m128i dst, __m128i src, __m128i opacity )
+{
+    // Spread each pixel alpha over its 4 channels.
+    __m128i     a = _mm_shufflehi_epi16( _mm_shufflelo_epi16( src, _MM_SHUFFLE( 3, 3, 3, 3 ) ),
+                                         _MM_SHUFFLE( 3, 3, 3, 3 ) );
+    a = div255( _mm_mullo_epi16( a, opacity ) );
+    const __m128i   invA = _mm_sub_epi16( _mm_set1_epi16( 255 ), a );
+    return div255( _mm_add_epi16( _mm_mullo_epi16( src, a ), _mm_mullo_epi16( dst, invA ) ) );
+}
+#endif
+
+#ifdef VLMC_BLEND_AVX2
+static inline VLMC_TARGET_AVX2 __m256i
+div255( __m256i x )
+{
+    x = _mm256_add_epi16( x, _mm256_set1_epi16( 128 ) );
+    return _mm256_srli_epi16( _mm256_add_epi16( x, _mm256_srli_epi16( x, 8 ) ), 8 );
+}
+
+static inline VLMC_TARGET_AVX2 __m256i
+blend4( __m256i dst, __m256i src, __m256i opacity )
+{
+    __m256i     a = _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( src, _MM_SHUFFLE( 3, 3, 3, 3 ) ),
+                                            _MM_SHUFFLE( 3, 3, 3, 3 ) );
+    a = div255( _mm256_mullo_epi16( a, opacity ) );
+    const __m256i   invA = _mm256_sub_epi16( _mm256_set1_epi16( 255 ), a );
+    return div255( _mm256_add_epi16( _mm256_mullo_epi16( src, a ), _mm256_mullo_epi16( dst, invA ) ) );
+}
+
+/**
+ *  Same as the SSE2 loop of blendLine(), 8 pixels at a time.
+ *  \returns   The number of pixels it blended, the caller handles the rest.
+ */
+static VLMC_TARGET_AVX2 quint32
+blendLineAvx2( quint32 *dst, const quint32 *src, quint32 width, quint32 opacity )
+{
+    const __m256i   zero = _mm256_setzero_si256();
+    const __m256i   alphaMask = _mm256_set1_epi32( (int)OpaqueBlack );
+    const __m256i   op = _mm256_set1_epi16( (short)opacity );
+    quint32         i = 0;
+    for ( ; i + 8 <= width; i += 8 )
+    {
+        __m256i     s = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( src + i ) );
+        __m256i     alpha = _mm256_and_si256( s, alphaMask );
+        if ( _mm256_movemask_epi8( _mm256_cmpeq_epi32( alpha, zero ) ) == -1 )
+            continue ;
+        __m256i     *out = reinterpret_cast<__m256i*>( dst + i );
+        if ( opacity == 255 &&
+             _mm256_movemask_epi8( _mm256_cmpeq_epi32( alpha, alphaMask ) ) == -1 )
+        {
+            _mm256_storeu_si256( out, s );
+            continue ;
+        }
+        __m256i     d = _mm256_loadu_si256( out );
+        __m256i     lo = blend4( _mm256_unpacklo_epi8( d, zero ), _mm256_unpacklo_epi8( s, zero ), op );
+        __m256i     hi = blend4( _mm256_unpackhi_epi8( d, zero ), _mm256_unpackhi_epi8( s, zero ), op );
+        _mm256_storeu_si256( out, _mm256_or_si256( _mm256_packus_epi16( lo, hi ), alphaMask ) );
+    }
+    return i;
+}
+
+static bool
+cpuHasAvx2()
+{
+    static const bool   hasAvx2 = ( __builtin_cpu_init(), __builtin_cpu_supports( "avx2" ) != 0 );
+    return hasAvx2;
+}
+#endif
+
+/**
+ *  Blends a line of straight alpha pixels over an opaque one.
+ *  Runs of fully transparent or fully opaque pixels, which are most of what
+ *  overlays are made of, skip the arithmetic.
+ */
+static void
+blendLine( quint32 *dst, const quint32 *src, quint32 width, quint32 opacity )
+{
+    quint32     i = 0;
+#ifdef VLMC_BLEND_AVX2
+    if ( cpuHasAvx2() == true )
+        i = blendLineAvx2( dst, src, width, opacity );
+#endif
+#ifdef __SSE2__
+    {
+        const __m128i   zero = _mm_setzero_si128();
+        const __m128i   alphaMask = _mm_set1_epi32( (int)OpaqueBlack );
+        const __m128i   op = _mm_set1_epi16( (short)opacity );
+        for ( ; i + 4 <= width; i += 4 )
+        {
+            __m128i     s = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i ) );
+            __m128i     alpha = _mm_and_si128( s, alphaMask );
+            if ( _mm_movemask_epi8( _mm_cmpeq_epi32( alpha, zero ) ) == 0xffff )
+                continue ;
+            __m128i     *out = reinterpret_cast<__m128i*>( dst + i );
+            if ( opacity == 255 &&
+                 _mm_movemask_epi8( _mm_cmpeq_epi32( alpha, alphaMask ) ) == 0xffff )
+            {
+                _mm_storeu_si128( out, s );
+                continue ;
+            }
+            __m128i     d = _mm_loadu_si128( out );
+            __m128i     lo = blend2( _mm_unpacklo_epi8( d, zero ), _mm_unpacklo_epi8( s, zero ), op );
+            __m128i     hi = blend2( _mm_unpackhi_epi8( d, zero ), _mm_unpackhi_epi8( s, zero ), op );
+            _mm_storeu_si128( out, _mm_or_si128( _mm_packus_epi16( lo, hi ), alphaMask ) );
+        }
+    }
+#endif
+    for ( ; i < width; ++i )
+        dst[i] = blendPixel( dst[i], src[i], opacity );
+}
+
+static void
+convertRows( const Frame* frame, quint32 row, quint32 nbLines, quint32 *dst, quint32 dstPitch )
+{
+    PixelConverter::I420ToRV32( frame->plane( 0 ) + row * frame->pitch( 0 ), frame->pitch( 0 ),
+                                frame->plane( 1 ) + row / 2 * frame->pitch( 1 ),
+                                frame->plane( 2 ) + row / 2 * frame->pitch( 2 ), frame->pitch( 1 ),
+                                dst, dstPitch, frame->width(), nbLines );
+}
+
+/**
+ *  \returns    nbLines RV32 lines of frame, starting at row, either straight from
+ *              the frame or converted into scratch.
+ */
+static const quint32*
+rgbaRows( const Frame* frame, quint32 row, quint32 nbLines, quint32 *scratch, quint32 *pitch )
+{
+    if ( frame->chroma() == RV32 )
+    {
+        *pitch = frame->pitch( 0 );
+        return reinterpret_cast<const quint32*>( frame->plane( 0 ) + row * *pitch );
+    }
+    *pitch = frame->width() * Depth;
+    convertRows( frame, row, nbLines, scratch, *pitch );
+    return scratch;
+}
+
+Compositor::Compositor() :
+        m_covered( false ),
+        m_output( NULL )
+{
+    const int   nbThreads = qMax( QThread::idealThreadCount(), 1 );
+    m_bandsDone = new QSemaphore;
+    m_pool = new QThreadPool;
+    m_pool->setMaxThreadCount( nbThreads );
+    for ( int i = 0; i < nbThreads; ++i )
+        m_tasks.append( new BandTask( this, m_bandsDone ) );
+}
+
+Compositor::~Compositor()
+{
+    m_pool->waitForDone();
+    delete m_pool;
+    qDeleteAll( m_tasks );
+    delete m_bandsDone;
+    delete m_output;
+}
+
+void
+Compositor::begin()
+{
+    m_layers.clear();
+    m_covered = false;
+}
+
+bool
+Compositor::addLayer( Frame *frame, double opacity )
+{
+    if ( m_covered == true )
+        return false;
+    const quint32   op = qBound( 0, qRound( opacity * 255 ), 255 );
+    if ( frame == NULL || op == 0 )
+        return true;
+    // All tracks render at the project size, anything else is most likely stale.
+    if ( m_layers.isEmpty() == false && ( frame->width() != m_layers[0].frame->width() ||
+                                          frame->height() != m_layers[0].frame->height() ) )
+        return true;
+    Layer   layer;
+    layer.frame = frame;
+    layer.opacity = op;
+    m_layers.append( layer );
+    if ( op == 255 && frame->isOpaque() == true )
+        m_covered = true;
+    return m_covered == false;
+}
+
+Frame*
+Compositor::composite()
+{
+    if ( m_layers.isEmpty() == true )
+        return NULL;
+    Frame*          top = m_layers[0].frame;
+    if ( m_layers.size() == 1 && m_covered == true )
+        return top;
+
+    const quint32   width = top->width();
+    const quint32   height = top->height();
+    prepareOutput( width, height );
+
+    // Bands start on an even row, so I420 chroma lines aren't split.
+    const quint32   maxBands = qMax( height / MinRowsPerBand, 1u );
+    const quint32   nbBands = qMin( (quint32)m_tasks.size(), maxBands );
+    const quint32   rowsPerBand = ( ( height + nbBands - 1 ) / nbBands + 1 ) & ~1u;
+    quint32         nbDispatched = 0;
+    for ( quint32 i = 1; i < nbBands && i * rowsPerBand < height; ++i )
+    {
+        const quint32   firstRow = i * rowsPerBand;
+        m_tasks[i]->prepare( firstRow, qMin( rowsPerBand, height - firstRow ), width );
+        m_pool->start( m_tasks[i] );
+        ++nbDispatched;
+    }
+    m_tasks[0]->prepare( 0, qMin( rowsPerBand, height ), width );
+    m_tasks[0]->run();
+    m_bandsDone->acquire( nbDispatched + 1 );
+
+    m_output->ptsDiff = top->ptsDiff;
+    return m_output;
+}
+
+void
+Compositor::compositeRows( quint32 firstRow, quint32 nbRows, quint32 *scratch ) const
+{
+    const quint32   width = m_output->width();
+    const quint32   outPitch = m_output->pitch( 0 );
+    const int       bottom = m_layers.size() - 1;
+    // When covered, the bottom layer is opaque and is copied rather than blended.
+    const int       firstBlended = m_covered == true ? bottom - 1 : bottom;
+    const quint32   endRow = firstRow + nbRows;
+
+    for ( quint32 row = firstRow; row < endRow; row += 2 )
+    {
+        const quint32   nbLines = qMin( 2u, endRow - row );
+        quint8*         dst = reinterpret_cast<quint8*>( m_output->buffer() ) + row * outPitch;
+
+        if ( m_covered == true )
+        {
+            const Frame*    base = m_layers[bottom].frame;
+            if ( base->chroma() == RV32 )
+            {
+                for ( quint32 l = 0; l < nbLines; ++l )
+                    memcpy( dst + l * outPitch, base->plane( 0 ) + ( row + l ) * base->pitch( 0 ),
+                            width * Depth );
+            }
+            else
+                convertRows( base, row, nbLines, reinterpret_cast<quint32*>( dst ), outPitch );
+        }
+        else
+        {
+            for ( quint32 l = 0; l < nbLines; ++l )
+            {
+                quint32*    line = reinterpret_cast<quint32*>( dst + l * outPitch );
+                for ( quint32 i = 0; i < width; ++i )
+                    line[i] = OpaqueBlack;
+            }
+        }
+        for ( int i = firstBlended; i >= 0; --i )
+        {
+            quint32         srcPitch;
+            const quint8*   src = reinterpret_cast<const quint8*>(
+                        rgbaRows( m_layers[i].frame, row, nbLines, scratch, &srcPitch ) );
+            for ( quint32 l = 0; l < nbLines; ++l )
+                blendLine( reinterpret_cast<quint32*>( dst + l * outPitch ),
+                           reinterpret_cast<const quint32*>( src + l * srcPitch ),
+                           width, m_layers[i].opacity );
+        }
+    }
+}
+
+void
+Compositor::prepareOutput( quint32 width, quint32 height )
+{
+    const size_t    size = Frame::Size( width, height, RV32 );
+
+    if ( m_output == NULL )
+        m_output = new Frame( width, height, RV32 );
+    else if ( m_output->width() != width || m_output->height() != height )
+        m_output->resize( width, height );
+    // The previous composition may still be on its way to the renderer, which
+    // reserve() takes care of.
+    m_output->reserve( size, RV32 );
+    m_output->setLayout( size );
+}
@@ -0,0 +1,96 @@
+/*****************************************************************************
+ * Compositor.h: Blends the video tracks together
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <QVector>
+
+class   QSemaphore;
+class   QThreadPool;
+
+namespace   Workflow
+{
+    class   Frame;
+
+    /**
+     *  \brief  Blends the video tracks outputs in z-order.
+     *
+     *  Layers are added from the top to the bottom. RV32 layers are straight alpha,
+     *  as frei0r outputs them, and I420 layers are opaque. While being blended over
+     *  the layers below, each layer is premultiplied by its alpha and by its track
+     *  opacity. Once an opaque layer has been added, the layers below it are hidden
+     *  and never read.
+     *  The result is always opaque. Its rows are split in bands, which are blended
+     *  concurrently.
+     */
+    class   Compositor
+    {
+        public:
+            Compositor();
+            ~Compositor();
+
+            /**
+             *  \brief  Forget about the layers of the previous frame.
+             */
+            void        begin();
+            /**
+             *  \brief  Stack a layer below the ones already added.
+             *
+             *  \param  opacity     The layer opacity, between 0 and 1.
+             *  \returns    false if the layer hides everything below it, in which
+             *              case there's no point in adding more layers.
+             */
+            bool        addLayer( Frame* frame, double opacity );
+            /**
+             *  \returns    The blended frame, or the only visible layer itself when
+             *              there is nothing to blend. NULL if no layer was added.
+             *  \warning    The returned frame is only valid until the next call.
+             */
+            Frame       *composite();
+
+        private:
+            class   BandTask;
+            friend class    BandTask;
+
+            struct  Layer
+            {
+                Frame*      frame;
+                quint32     opacity;
+            };
+
+            void        compositeRows( quint32 firstRow, quint32 nbRows, quint32 *scratch ) const;
+            void        prepareOutput( quint32 width, quint32 height );
+
+        private:
+            /// From the top to the bottom
+            QVector<Layer>          m_layers;
+            /// Set when the last layer hides everything below it.
+            bool                    m_covered;
+            Frame*                  m_output;
+            QThreadPool*            m_pool;
+            QSemaphore*             m_bandsDone;
+            QVector<BandTask*>      m_tasks;
+    };
+}
+
+#endif // COMPOSITOR_H
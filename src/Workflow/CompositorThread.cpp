@@ -0,0 +1,183 @@
+/*****************************************************************************
+ * CompositorThread.cpp: Composites the video frames ahead of the output
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include "Workflow/CompositorThread.h"
+
+#include "Workflow/MainWorkflow.h"
+#include "Workflow/Types.h"
+
+using namespace Workflow;
+
+CompositorThread::CompositorThread( MainWorkflow* workflow ) :
+        m_workflow( workflow ),
+        m_depth( 0 ),
+        m_nextFrame( 0 ),
+        m_generation( 0 ),
+        m_stopping( true ),
+        m_suspended( false ),
+        m_busy( false )
+{
+}
+
+CompositorThread::~CompositorThread()
+{
+    stop();
+    wait();
+}
+
+void
+CompositorThread::begin( qint64 frame, quint32 depth )
+{
+    {
+        QMutexLocker    lock( &m_lock );
+        m_depth = depth;
+        m_stopping = false;
+        //Leave the clips to the preroll until the first frame is asked for.
+        m_suspended = true;
+        restart( frame );
+    }
+    start();
+}
+
+void
+CompositorThread::stop()
+{
+    QMutexLocker    lock( &m_lock );
+    m_stopping = true;
+    m_cond.wakeAll();
+}
+
+Frame*
+CompositorThread::take( qint64 frame )
+{
+    QMutexLocker    lock( &m_lock );
+    if ( m_stopping == true )
+        return NULL;
+    m_suspended = false;
+    reposition( frame );
+    while ( m_stopping == false && m_queue.isEmpty() == true )
+        m_cond.wait( &m_lock );
+    if ( m_stopping == true )
+        return NULL;
+    Frame*          output = m_queue.dequeue().output;
+    m_cond.wakeAll();
+    return output;
+}
+
+void
+CompositorThread::seek( qint64 frame )
+{
+    QMutexLocker    lock( &m_lock );
+    if ( m_stopping == false )
+        reposition( frame );
+}
+
+void
+CompositorThread::invalidate()
+{
+    QMutexLocker    lock( &m_lock );
+    //Start over from the first frame which wasn't taken yet.
+    if ( m_queue.isEmpty() == false )
+        m_nextFrame = m_queue.head().frame;
+    restart( m_nextFrame );
+}
+
+void
+CompositorThread::suspend()
+{
+    QMutexLocker    lock( &m_lock );
+    m_suspended = true;
+    while ( m_busy == true )
+        m_cond.wait( &m_lock );
+}
+
+void
+CompositorThread::run()
+{
+    QMutexLocker    lock( &m_lock );
+    while ( m_stopping == false )
+    {
+        if ( m_suspended == true || (quint32)m_queue.size() >= m_depth )
+        {
+            m_cond.wait( &m_lock );
+            continue ;
+        }
+        const qint64    frame = m_nextFrame;
+        const quint32   generation = m_generation;
+        m_busy = true;
+        lock.unlock();
+
+        //Share the composited buffer, and convert it for imem while we're at it.
+        Frame*          output = new Frame( *m_workflow->renderVideo( frame, false ) );
+        output->yuvBuffer();
+
+        lock.relock();
+        m_busy = false;
+        //A seek or an edit occurred meanwhile.
+        if ( generation == m_generation && m_stopping == false )
+        {
+            Entry   entry;
+            entry.frame = frame;
+            entry.output = output;
+            m_queue.enqueue( entry );
+            ++m_nextFrame;
+        }
+        else
+            delete output;
+        m_cond.wakeAll();
+    }
+    clear();
+}
+
+void
+CompositorThread::reposition( qint64 frame )
+{
+    //The frames served from somewhere else, such as the render cache, are skipped.
+    bool    dropped = false;
+    while ( m_queue.isEmpty() == false && m_queue.head().frame < frame )
+    {
+        delete m_queue.dequeue().output;
+        dropped = true;
+    }
+    const qint64    next = m_queue.isEmpty() == true ? m_nextFrame : m_queue.head().frame;
+    if ( next != frame )
+        restart( frame );
+    else if ( dropped == true )
+        m_cond.wakeAll();
+}
+
+void
+CompositorThread::restart( qint64 frame )
+{
+    clear();
+    m_nextFrame = frame;
+    ++m_generation;
+    m_cond.wakeAll();
+}
+
+void
+CompositorThread::clear()
+{
+    while ( m_queue.isEmpty() == false )
+        delete m_queue.dequeue().output;
+}
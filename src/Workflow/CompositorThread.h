@@ -0,0 +1,125 @@
+/*****************************************************************************
+ * CompositorThread.h: Composites the video frames ahead of the output
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef COMPOSITORTHREAD_H
+#define COMPOSITORTHREAD_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+
+class   MainWorkflow;
+
+namespace   Workflow
+{
+    class   Frame;
+
+    /**
+     *  \brief  Composites the video frames following the current one, ahead of
+     *          the imem callbacks asking for them.
+     *
+     *  Compositing goes through every track, clip and filter, which VLC's input
+     *  thread used to wait for. This thread fills a bounded queue with the next
+     *  frames instead, so the callbacks only take them out.
+     *  Seeks and edits increment a generation counter: a frame rendered for an
+     *  older generation is dropped, and the queue starts over from the frame
+     *  being asked for.
+     */
+    class   CompositorThread : public QThread
+    {
+        public:
+            explicit CompositorThread( MainWorkflow* workflow );
+            ~CompositorThread();
+
+            /**
+             *  \brief  Composite from frame, keeping up to depth frames ahead.
+             *
+             *  Nothing is composited until the first take(), so that the workflow
+             *  can be prerolled meanwhile.
+             */
+            void        begin( qint64 frame, quint32 depth );
+            /**
+             *  \brief  Stop compositing, and wake up a take() waiting for a frame.
+             *
+             *  The frame being composited may still need the clips to be stopped
+             *  before it returns, so wait() has to be called afterward.
+             */
+            void        stop();
+            /**
+             *  \brief  Take the next frame out of the queue, waiting for it if needed.
+             *
+             *  The queue is repositioned if it doesn't continue with frame.
+             *  \returns    The composited frame, which the caller owns, or NULL once
+             *              stopped. This is a later frame if a seek occurs meanwhile.
+             */
+            Frame       *take( qint64 frame );
+            /**
+             *  \brief  Reposition the queue, if it doesn't continue with frame.
+             */
+            void        seek( qint64 frame );
+            /**
+             *  \brief  Drop the frames composited so far, which are outdated.
+             */
+            void        invalidate();
+            /**
+             *  \brief  Wait for the frame being composited, and don't start another
+             *          one until the next take().
+             *
+             *  The workflow can then be rendered from another thread, as when paused.
+             */
+            void        suspend();
+
+        protected:
+            virtual void    run();
+
+        private:
+            struct  Entry
+            {
+                qint64      frame;
+                Frame*      output;
+            };
+
+            /// \warning    m_lock has to be held for all the methods below.
+            void        reposition( qint64 frame );
+            void        restart( qint64 frame );
+            void        clear();
+
+        private:
+            MainWorkflow*           m_workflow;
+            QMutex                  m_lock;
+            /// Signaled when a frame is queued or taken, and when the state changes.
+            QWaitCondition          m_cond;
+            QQueue<Entry>           m_queue;
+            quint32                 m_depth;
+            /// The next frame to composite.
+            qint64                  m_nextFrame;
+            quint32                 m_generation;
+            bool                    m_stopping;
+            bool                    m_suspended;
+            /// true while a frame is being composited, without m_lock.
+            bool                    m_busy;
+    };
+}
+
+#endif // COMPOSITORTHREAD_H
@@ -0,0 +1,170 @@
+/*****************************************************************************
+ * FrameBudget.cpp: Splits the decoded frames memory between the clips
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Workflow/FrameBudget.h"
+
+#include "Workflow/ClipWorkflow.h"
+#include "Workflow/FramePool.h"
+
+#include <QVector>
+
+using namespace Workflow;
+
+const quint32   FrameBudget::MinQueueDepth;
+const quint32   FrameBudget::PreloadQueueDepth;
+
+FrameBudget::FrameBudget() :
+        m_capacity( 512 * 1024 * 1024 ),
+        m_fps( 30.0 ),
+        m_assignedSize( 0 ),
+        m_reservedSize( 0 )
+{
+}
+
+void
+FrameBudget::setCapacity( quint64 capacity )
+{
+    QMutexLocker    lock( &m_lock );
+    m_capacity = capacity;
+}
+
+quint64
+FrameBudget::capacity() const
+{
+    QMutexLocker    lock( &m_lock );
+    return m_capacity;
+}
+
+void
+FrameBudget::setFps( double fps )
+{
+    QMutexLocker    lock( &m_lock );
+    if ( fps > 0.0 )
+        m_fps = fps;
+}
+
+void
+FrameBudget::add( ClipWorkflow *cw )
+{
+    QMutexLocker    lock( &m_lock );
+    if ( m_clipWorkflows.contains( cw ) == false )
+        m_clipWorkflows.append( cw );
+}
+
+void
+FrameBudget::remove( ClipWorkflow *cw )
+{
+    QMutexLocker    lock( &m_lock );
+    m_clipWorkflows.removeOne( cw );
+    m_boosts.remove( cw );
+}
+
+void
+FrameBudget::rebalance()
+{
+    QMutexLocker    lock( &m_lock );
+
+    m_assignedSize = 0;
+    m_reservedSize = 0;
+    if ( m_clipWorkflows.isEmpty() == true )
+        return ;
+    const int       nbClips = m_clipWorkflows.count();
+    const qint64    frameDuration = 1000000 / m_fps;
+    // About one second worth of frames when the decoder keeps up.
+    const quint32   comfortDepth = qMax<quint32>( (quint32)m_fps, PreloadQueueDepth );
+    QVector<quint32>    wanted( nbClips );
+    QVector<bool>       starving( nbClips );
+    quint64         floorSize = 0;
+    quint64         starvingExtraSize = 0;
+    quint64         extraSize = 0;
+
+    for ( int i = 0; i < nbClips; ++i )
+    {
+        ClipWorkflow*   cw = m_clipWorkflows[i];
+        const quint32   maxDepth = cw->maxQueueDepth();
+        const quint32   minDepth = qMin( maxDepth, MinQueueDepth );
+        const quint64   bufferSize = cw->computedBufferSize();
+
+        if ( cw->hasStarved() == true )
+            m_boosts[cw] = (int)( 2 * m_fps );
+        QHash<ClipWorkflow*, int>::iterator     boost = m_boosts.find( cw );
+        starving[i] = boost != m_boosts.end();
+        if ( starving[i] == true )
+        {
+            if ( --boost.value() <= 0 )
+                m_boosts.erase( boost );
+            wanted[i] = maxDepth;
+        }
+        else if ( cw->playheadDistance() > 0 )
+            wanted[i] = PreloadQueueDepth;
+        else
+        {
+            const qint64    decodeDuration = cw->decodeDuration();
+            // Be generous with the decoders that barely keep up, they have no margin.
+            if ( decodeDuration > frameDuration * 9 / 10 )
+                wanted[i] = maxDepth;
+            else
+                wanted[i] = comfortDepth;
+        }
+        wanted[i] = qBound( minDepth, wanted[i], maxDepth );
+        floorSize += minDepth * bufferSize;
+        if ( starving[i] == true )
+            starvingExtraSize += ( wanted[i] - minDepth ) * bufferSize;
+        else
+            extraSize += ( wanted[i] - minDepth ) * bufferSize;
+    }
+
+    // Serve the starving clips first, then split what remains.
+    quint64     available = m_capacity > floorSize ? m_capacity - floorSize : 0;
+    double      starvingRatio = 1.0;
+    if ( starvingExtraSize > available )
+        starvingRatio = (double)available / starvingExtraSize;
+    available -= qMin( available, starvingExtraSize );
+    double      ratio = 1.0;
+    if ( extraSize > available )
+        ratio = (double)available / extraSize;
+
+    quint64     assignedSize = 0;
+    for ( int i = 0; i < nbClips; ++i )
+    {
+        ClipWorkflow*   cw = m_clipWorkflows[i];
+        const quint32   minDepth = qMin( cw->maxQueueDepth(), MinQueueDepth );
+        const double    r = starving[i] == true ? starvingRatio : ratio;
+        const quint32   depth = minDepth + (quint32)( ( wanted[i] - minDepth ) * r );
+        cw->setQueueDepth( depth );
+        assignedSize += depth * cw->computedBufferSize();
+    }
+    m_assignedSize = assignedSize;
+    // Whatever isn't assigned to a queue can be kept around by the pool.
+    FramePool::getInstance()->setMaxIdleSize(
+                qMax( m_capacity > assignedSize ? m_capacity - assignedSize : 0, m_capacity / 8 ) );
+}
+
+bool
+FrameBudget::tryReserve( quint64 size )
+{
+    QMutexLocker    lock( &m_lock );
+    if ( m_assignedSize + m_reservedSize + size > m_capacity )
+        return false;
+    m_reservedSize += size;
+    return true;
+}
@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * FrameBudget.h: Splits the decoded frames memory between the clips
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef FRAMEBUDGET_H
+#define FRAMEBUDGET_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+
+class   ClipWorkflow;
+
+namespace   Workflow
+{
+    /**
+     *  \brief  Assigns a queue depth to each running ClipWorkflow.
+     *
+     *  The queue depth is the high watermark at which a ClipWorkflow blocks its
+     *  decoder. The clip currently being rendered gets about one second of
+     *  frames, or its maximum depth if its decoder can't keep up or if it recently
+     *  ran out of frames. Preloading clips only keep a few frames.
+     *  If the whole doesn't fit in the capacity, the depths are scaled down, the
+     *  starving clips being served first.
+     */
+    class   FrameBudget
+    {
+        public:
+            FrameBudget();
+
+            /**
+             *  \brief  Set the maximum amount of memory, in bytes, for all the queues.
+             */
+            void            setCapacity( quint64 capacity );
+            quint64         capacity() const;
+            void            setFps( double fps );
+
+            void            add( ClipWorkflow* cw );
+            void            remove( ClipWorkflow* cw );
+            /**
+             *  \brief  Compute the queue depth of every running ClipWorkflow
+             *
+             *  This is meant to be called once per rendered frame.
+             */
+            void            rebalance();
+            /**
+             *  \brief  Check whether an additional clip could be preloaded.
+             *
+             *  On success, size bytes are considered used until the next
+             *  rebalance, so that a single call can't start more clips than
+             *  the capacity allows.
+             */
+            bool            tryReserve( quint64 size );
+
+            /// No queue will be shrinked under this depth.
+            static const quint32    MinQueueDepth = 4;
+            /// The depth given to clips that are not being rendered yet.
+            static const quint32    PreloadQueueDepth = 8;
+
+        private:
+            mutable QMutex              m_lock;
+            QList<ClipWorkflow*>        m_clipWorkflows;
+            /// Number of frames for which a clip that starved will keep its maximum depth.
+            QHash<ClipWorkflow*, int>   m_boosts;
+            quint64                     m_capacity;
+            double                      m_fps;
+            /// What the last rebalance gave to the queues, and what was reserved since.
+            quint64                     m_assignedSize;
+            quint64                     m_reservedSize;
+    };
+}
+
+#endif // FRAMEBUDGET_H
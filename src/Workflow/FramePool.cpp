@@ -0,0 +1,204 @@
+/*****************************************************************************
+ * FramePool.cpp: Process wide pool of reference counted frame buffers
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Workflow/FramePool.h"
+
+#include "Tools/VlmcDebug.h"
+
+#include <limits>
+#include <new>
+
+using namespace Workflow;
+
+FramePool::FramePool() :
+    m_idleSize( 0 ),
+    m_maxIdleSize( std::numeric_limits<size_t>::max() )
+{
+}
+
+FramePool::~FramePool()
+{
+    QMutexLocker    lock( &m_lock );
+
+    foreach ( const Stats& s, m_stats )
+    {
+        if ( s.inUse != 0 )
+            vlmcWarning() << s.inUse << "frame buffers of" << s.bufferSize
+                          << "bytes are still in use while destroying the frame pool";
+    }
+    foreach ( const QList<Header*>& list, m_freeBuffers )
+    {
+        foreach ( Header* h, list )
+        {
+            h->~Header();
+            qFreeAligned( h );
+        }
+    }
+}
+
+FramePool::Header*
+FramePool::header( const quint32 *buffer )
+{
+    const quint8*   ptr = reinterpret_cast<const quint8*>( buffer ) - HeaderSize;
+    return reinterpret_cast<Header*>( const_cast<quint8*>( ptr ) );
+}
+
+quint32*
+FramePool::data( Header *header )
+{
+    return reinterpret_cast<quint32*>( reinterpret_cast<quint8*>( header ) + HeaderSize );
+}
+
+quint32*
+FramePool::get( size_t size )
+{
+    Header*     h = NULL;
+    {
+        QMutexLocker    lock( &m_lock );
+
+        Stats&          s = m_stats[size];
+        s.bufferSize = size;
+        QHash<size_t, QList<Header*> >::iterator    it = m_freeBuffers.find( size );
+        if ( it != m_freeBuffers.end() && it.value().isEmpty() == false )
+        {
+            h = it.value().takeLast();
+            m_idleSize -= size;
+            ++s.hits;
+        }
+        else
+        {
+            ++s.misses;
+            ++s.allocated;
+        }
+        ++s.inUse;
+        if ( s.inUse > s.highWaterMark )
+            s.highWaterMark = s.inUse;
+    }
+    if ( h == NULL )
+    {
+        // Allocate outside of the lock, this is the slow path anyway.
+        void*   ptr = qMallocAligned( HeaderSize + size, Alignment );
+        if ( ptr == NULL )
+            vlmcFatal( "Failed to allocate a %u bytes frame buffer", (unsigned int)size );
+        h = new ( ptr ) Header;
+        h->size = size;
+    }
+    h->refCount.fetchAndStoreOrdered( 1 );
+    return data( h );
+}
+
+void
+FramePool::ref( const quint32 *buffer )
+{
+    Q_ASSERT( buffer != NULL );
+    header( buffer )->refCount.ref();
+}
+
+void
+FramePool::release( const quint32 *buffer )
+{
+    if ( buffer == NULL )
+        return ;
+    Header*     h = header( buffer );
+    if ( h->refCount.deref() == true )
+        return ;
+
+    {
+        QMutexLocker    lock( &m_lock );
+        Stats&          s = m_stats[h->size];
+        --s.inUse;
+        if ( m_idleSize + h->size <= m_maxIdleSize )
+        {
+            m_idleSize += h->size;
+            m_freeBuffers[h->size].append( h );
+            return ;
+        }
+        --s.allocated;
+    }
+    h->~Header();
+    qFreeAligned( h );
+}
+
+bool
+FramePool::isShared( const quint32 *buffer ) const
+{
+    Q_ASSERT( buffer != NULL );
+    return header( buffer )->refCount.fetchAndAddOrdered( 0 ) > 1;
+}
+
+size_t
+FramePool::bufferSize( const quint32 *buffer ) const
+{
+    Q_ASSERT( buffer != NULL );
+    return header( buffer )->size;
+}
+
+void
+FramePool::trim()
+{
+    QList<Header*>  toFree;
+    {
+        QMutexLocker    lock( &m_lock );
+
+        QHash<size_t, QList<Header*> >::iterator    it = m_freeBuffers.begin();
+        QHash<size_t, QList<Header*> >::iterator    ite = m_freeBuffers.end();
+        for ( ; it != ite; ++it )
+        {
+            m_stats[it.key()].allocated -= it.value().size();
+            toFree += it.value();
+            it.value().clear();
+        }
+        m_idleSize = 0;
+    }
+    foreach ( Header* h, toFree )
+    {
+        h->~Header();
+        qFreeAligned( h );
+    }
+}
+
+void
+FramePool::setMaxIdleSize( size_t maxIdleSize )
+{
+    QMutexLocker    lock( &m_lock );
+    m_maxIdleSize = maxIdleSize;
+}
+
+QList<FramePool::Stats>
+FramePool::stats() const
+{
+    QMutexLocker    lock( &m_lock );
+
+    return m_stats.values();
+}
+
+void
+FramePool::dumpStats() const
+{
+    foreach ( const Stats& s, stats() )
+    {
+        vlmcDebug() << "Frame pool:" << s.bufferSize << "bytes buffers:"
+                    << s.allocated << "allocated," << s.inUse << "in use,"
+                    << "high water mark:" << s.highWaterMark
+                    << "hits:" << s.hits << "misses:" << s.misses;
+    }
+}
@@ -0,0 +1,132 @@
+/*****************************************************************************
+ * FramePool.h: Process wide pool of reference counted frame buffers
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+
+#include "Tools/Singleton.hpp"
+
+namespace   Workflow
+{
+    /**
+     *  \brief  Hands out pixel buffers to every stage of the workflow.
+     *
+     *  Buffers are keyed by their size in bytes, which basically means by resolution.
+     *  Each buffer carries a reference count, so a stage can keep a buffer alive
+     *  after its producer moved on. When the last reference is released, the
+     *  buffer goes back to the free list instead of the heap.
+     */
+    class   FramePool : public Singleton<FramePool>
+    {
+        public:
+            struct  Stats
+            {
+                Stats() : bufferSize( 0 ), allocated( 0 ), inUse( 0 ),
+                    highWaterMark( 0 ), hits( 0 ), misses( 0 ) {}
+                size_t      bufferSize;
+                /// Number of buffers currently allocated for this size (free + in use)
+                quint32     allocated;
+                quint32     inUse;
+                /// The maximum number of buffers that were in use at the same time.
+                quint32     highWaterMark;
+                /// Number of requests served from the free list
+                quint64     hits;
+                /// Number of requests that required a new allocation
+                quint64     misses;
+            };
+
+            /**
+             *  \brief      Borrow a buffer of at least size bytes.
+             *
+             *  The returned buffer has a reference count of 1, and is aligned on
+             *  FramePool::Alignment bytes.
+             */
+            quint32         *get( size_t size );
+            /**
+             *  \brief      Take an additional reference on a buffer returned by get()
+             */
+            void            ref( const quint32 *buffer );
+            /**
+             *  \brief      Drop a reference. The buffer returns to the pool when the
+             *              last reference is released.
+             *
+             *  Passing NULL is a no-op.
+             */
+            void            release( const quint32 *buffer );
+            /**
+             *  \returns    true if more than one reference is held on this buffer.
+             *
+             *  A shared buffer must not be written to.
+             */
+            bool            isShared( const quint32 *buffer ) const;
+            /**
+             *  \returns    The usable size of this buffer, in bytes.
+             */
+            size_t          bufferSize( const quint32 *buffer ) const;
+            /**
+             *  \brief      Free every buffer that is not currently in use.
+             */
+            void            trim();
+            /**
+             *  \brief      Set how many bytes worth of unused buffers may be kept.
+             *
+             *  Buffers released past this limit are freed right away.
+             *  This is unlimited by default.
+             */
+            void            setMaxIdleSize( size_t maxIdleSize );
+            QList<Stats>    stats() const;
+            void            dumpStats() const;
+
+            static const size_t     Alignment = 32;
+
+        private:
+            FramePool();
+            ~FramePool();
+
+            struct  Header
+            {
+                size_t      size;
+                QAtomicInt  refCount;
+            };
+            // Keep the pixels aligned after the header.
+            static const size_t     HeaderSize = Alignment;
+
+            static Header           *header( const quint32 *buffer );
+            static quint32          *data( Header *header );
+
+        private:
+            mutable QMutex                      m_lock;
+            QHash<size_t, QList<Header*> >      m_freeBuffers;
+            QHash<size_t, Stats>                m_stats;
+            size_t                              m_idleSize;
+            size_t                              m_maxIdleSize;
+
+            friend class    Singleton<FramePool>;
+    };
+}
+
+#endif // FRAMEPOOL_H
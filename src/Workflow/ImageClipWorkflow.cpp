@@ -35,8 +35,8 @@
 #include "Settings/Settings.h"
 #include "Workflow/Types.h"
 
-ImageClipWorkflow::ImageClipWorkflow( ClipHelper *ch ) :
-        ClipWorkflow( ch ),
+ImageClipWorkflow::ImageClipWorkflow( ClipHelper *ch, MainWorkflow* workflow ) :
+        ClipWorkflow( ch, workflow ),
         m_buffer( NULL )
 {
     //This is used to queue the media player stopping, as it can't be asked for
@@ -49,6 +49,7 @@ ImageClipWorkflow::ImageClipWorkflow( ClipHelper *ch ) :
 ImageClipWorkflow::~ImageClipWorkflow()
 {
     stop();
+    waitForInitTask();
     delete m_effectFrame;
 }
 
@@ -59,10 +60,10 @@ void ImageClipWorkflow::initializeInternals()
     m_renderer->setOutputWidth( m_width );
     m_renderer->setOutputHeight( m_height );
     m_renderer->setOutputFps( (float)VLMC_PROJECT_GET_DOUBLE( "video/VLMCOutputFPS" ) );
-    m_renderer->setOutputVideoCodec( "RV32" );
+    m_renderer->setOutputVideoCodec( "I420" );
 
-    m_effectFrame->resize( Project::getInstance()->workflow()->getWidth(),
-                            Project::getInstance()->workflow()->getHeight() );
+    m_effectFrame->resize( m_workflow->getWidth(),
+                            m_workflow->getHeight() );
     m_isRendering = true;
 }
 
@@ -88,22 +89,25 @@ ImageClipWorkflow::getOutput( ClipWorkflow::GetMode, qint64 currentFrame )
 }
 
 void
-ImageClipWorkflow::lock(void *data, uint8_t **pp_ret, size_t )
+ImageClipWorkflow::lock(void *data, uint8_t **pp_ret, size_t size )
 {
     ImageClipWorkflow* cw = reinterpret_cast<ImageClipWorkflow*>( data );
     cw->m_renderLock->lock();
     if ( cw->m_buffer == NULL )
     {
-        cw->m_buffer = new Workflow::Frame( Project::getInstance()->workflow()->getWidth(),
-                                            Project::getInstance()->workflow()->getHeight() );
+        cw->m_buffer = new Workflow::Frame( cw->m_workflow->getWidth(),
+                                            cw->m_workflow->getHeight(),
+                                            Workflow::I420 );
     }
+    cw->m_buffer->reserve( size, Workflow::I420 );
     *pp_ret = (uint8_t*)cw->m_buffer->buffer();
 }
 
 void
-ImageClipWorkflow::unlock( void* data, uint8_t*, int, int, int, size_t, int64_t )
+ImageClipWorkflow::unlock( void* data, uint8_t*, int, int, int, size_t size, int64_t )
 {
     ImageClipWorkflow* cw = reinterpret_cast<ImageClipWorkflow*>( data );
+    cw->m_buffer->setLayout( size );
     cw->m_renderLock->unlock();
     cw->emit computedFinished();
 }
@@ -118,10 +122,14 @@ ImageClipWorkflow::getNbComputedBuffers() const
     return 0;
 }
 
-quint32
-ImageClipWorkflow::getMaxComputedBuffers() const
+size_t
+ImageClipWorkflow::computedBufferSize() const
 {
-    return 1;
+    QMutexLocker    lock( m_renderLock );
+
+    if ( m_buffer != NULL )
+        return m_buffer->size();
+    return 0;
 }
 
 void
@@ -30,7 +30,7 @@ class   ImageClipWorkflow : public ClipWorkflow
     Q_OBJECT
 
     public:
-        ImageClipWorkflow( ClipHelper* ch );
+        ImageClipWorkflow( ClipHelper* ch, MainWorkflow* workflow );
         ~ImageClipWorkflow();
 
         virtual Workflow::OutputBuffer  *getOutput( ClipWorkflow::GetMode mode, qint64 currentFrame );
@@ -38,13 +38,17 @@ class   ImageClipWorkflow : public ClipWorkflow
          *  \brief      Deactivate time seeking in an ImageClipWorkflow
          */
         virtual void            setTime( qint64 ){}
+        virtual size_t          computedBufferSize() const;
     protected:
         virtual void            initializeInternals();
         virtual void            preallocate();
         virtual quint32         getNbComputedBuffers() const;
-        virtual quint32         getMaxComputedBuffers() const;
         virtual void            flushComputedBuffers();
         virtual void            releasePrealocated(){}
+        /**
+         *  \brief      Images are never handed over, as they don't have a position.
+         */
+        virtual void            handOverBuffers( ClipWorkflow*, qint64 ){}
     private:
         static void             lock(void *data, uint8_t **pp_ret,
                                       size_t size );
@@ -24,36 +24,75 @@
 #include "vlmc.h"
 #include "Project/Project.h"
 #include "Media/Clip.h"
+#include "Media/Media.h"
 #include "ClipHelper.h"
 #include "ClipWorkflow.h"
+#include "CompositorThread.h"
+#include "FrameBudget.h"
+#include "FramePool.h"
 #include "Library/Library.h"
 #include "MainWorkflow.h"
 #include "Project/Project.h"
+#include "RenderCache.h"
+#include "RendererPool.h"
+#include "ScrubCache.h"
 #include "TrackWorkflow.h"
 #include "TrackHandler.h"
 #include "Settings/Settings.h"
 #include "Tools/VlmcDebug.h"
+#include "Tools/mdate.h"
 #include "Workflow/Types.h"
 
+#include <QCryptographicHash>
+#include <QDomDocument>
 #include <QDomElement>
 #include <QMutex>
+#include <QThreadPool>
+#include <QTimer>
+#include <QWaitCondition>
+
+/// Starting a renderer mostly waits for libvlc, so this doesn't depend on the cores count.
+static const int    MaxConcurrentClipStarts = 8;
 
 MainWorkflow::MainWorkflow( int trackCount ) :
         m_blackOutput( NULL ),
+        m_trackBlackOutput( NULL ),
+        m_renderAhead( 0 ),
+        m_aheadOutput( NULL ),
+        m_prerollFrame( 0 ),
+        m_prerollFrames( 0 ),
+        m_prerollTimeout( 0 ),
+        m_prerollStartDate( 0 ),
         m_lengthFrame( 0 ),
         m_renderStarted( false ),
         m_width( 0 ),
         m_height( 0 ),
+        m_fps( 0.0 ),
+        m_outputWidth( 0 ),
+        m_outputHeight( 0 ),
+        m_renderDivisor( 1 ),
+        m_pendingDivisor( 1 ),
+        m_useProxies( false ),
+        m_ownsClipHelpers( false ),
+        m_ownsFrameBudget( true ),
         m_trackCount( trackCount )
 {
     m_currentFrameLock = new QReadWriteLock;
+    m_clipStartedCond = new QWaitCondition;
+    m_frameBudget = new Workflow::FrameBudget;
+    m_clipStartPool = new QThreadPool;
+    m_clipStartPool->setMaxThreadCount( MaxConcurrentClipStarts );
+    m_rendererPool = new Workflow::RendererPool;
+    m_scrubCache = new Workflow::ScrubCache;
+    m_renderCache = new Workflow::RenderCache;
+    m_compositorThread = new Workflow::CompositorThread( this );
 
     m_tracks = new TrackHandler*[Workflow::NbTrackType];
     m_currentFrame = new qint64[Workflow::NbTrackType];
     for ( unsigned int i = 0; i < Workflow::NbTrackType; ++i )
     {
         Workflow::TrackType trackType = static_cast<Workflow::TrackType>(i);
-        m_tracks[i] = new TrackHandler( trackCount, trackType );
+        m_tracks[i] = new TrackHandler( this, trackCount, trackType );
         connect( m_tracks[i], SIGNAL( tracksEndReached() ),
                  this, SLOT( tracksEndReached() ) );
         connect( m_tracks[i], SIGNAL( lengthChanged(qint64) ),
@@ -64,12 +103,22 @@ MainWorkflow::MainWorkflow( int trackCount ) :
 
 MainWorkflow::~MainWorkflow()
 {
+    delete m_compositorThread;
+    delete m_aheadOutput;
     delete m_currentFrameLock;
+    delete m_clipStartedCond;
     delete m_currentFrame;
     for ( unsigned int i = 0; i < Workflow::NbTrackType; ++i )
         delete m_tracks[i];
     delete[] m_tracks;
+    delete m_trackBlackOutput;
     delete m_blackOutput;
+    delete m_clipStartPool;
+    delete m_rendererPool;
+    delete m_scrubCache;
+    delete m_renderCache;
+    if ( m_ownsFrameBudget == true )
+        delete m_frameBudget;
 }
 
 void
@@ -95,15 +144,101 @@ MainWorkflow::startRender( quint32 width, quint32 height, double fps )
 {
     //Reinit the effects in case the width/height has change
     m_renderStarted = true;
-    m_width = width;
-    m_height = height;
+    //Buffers of the previous resolution won't be used anymore
+    if ( width != m_outputWidth || height != m_outputHeight )
+    {
+        Workflow::FramePool::getInstance()->trim();
+        notifyEdit();
+    }
+    m_outputWidth = m_width = width;
+    m_outputHeight = m_height = height;
+    m_fps = fps;
+    m_renderDivisor = 1;
+    m_pendingDivisor.fetchAndStoreRelaxed( 1 );
+    m_nbLateFrames.fetchAndStoreRelaxed( 0 );
+    m_nbDroppedFrames.fetchAndStoreRelaxed( 0 );
+    m_frameBudget->setFps( fps );
+    m_frameBudget->setCapacity( (quint64)VLMC_PROJECT_GET_UINT( "video/FrameMemoryBudget" ) * 1024 * 1024 );
+    m_rendererPool->setCapacity( VLMC_PROJECT_GET_INT( "video/RendererPoolSize" ) );
+    m_scrubCache->setCapacity( (quint64)VLMC_PROJECT_GET_UINT( "video/ScrubCacheSize" ) * 1024 * 1024 );
     if ( m_blackOutput != NULL )
         delete m_blackOutput;
     m_blackOutput = new Workflow::Frame( m_width, m_height );
     memset( m_blackOutput->buffer(), 0, m_blackOutput->size() );
+    delete m_trackBlackOutput;
+    m_trackBlackOutput = new Workflow::Frame( m_width, m_height );
+    memset( m_trackBlackOutput->buffer(), 0, m_trackBlackOutput->size() );
     for ( unsigned int i = 0; i < Workflow::NbTrackType; ++i )
         m_tracks[i]->startRender( width, height, fps );
     computeLength();
+    m_renderAhead = VLMC_PROJECT_GET_UINT( "video/RenderAheadFrames" );
+    if ( m_renderAhead > 0 )
+        m_compositorThread->begin( getCurrentFrame(), m_renderAhead );
+}
+
+void
+MainWorkflow::preroll( quint32 nbFrames, unsigned long timeout )
+{
+    m_prerollFrame = getCurrentFrame( true );
+    m_prerollFrames = nbFrames;
+    m_prerollTimeout = timeout;
+    m_prerollStartDate = mdate();
+    m_prerolling.fetchAndStoreOrdered( 1 );
+    //In case no clip makes any progress meanwhile.
+    QTimer::singleShot( timeout, this, SLOT( checkPreroll() ) );
+    checkPreroll();
+}
+
+void
+MainWorkflow::notifyPrerollProgress()
+{
+    if ( m_prerolling.fetchAndAddOrdered( 0 ) == 0 )
+        return ;
+    if ( m_prerollCheckQueued.fetchAndStoreOrdered( 1 ) == 0 )
+        QMetaObject::invokeMethod( this, "checkPreroll", Qt::QueuedConnection );
+}
+
+void
+MainWorkflow::notifyClipStarted()
+{
+    m_clipStartedCond->wakeAll();
+}
+
+void
+MainWorkflow::waitForClipStart( QReadWriteLock* lock, unsigned long timeout )
+{
+    m_clipStartedCond->wait( lock, timeout );
+}
+
+void
+MainWorkflow::checkPreroll()
+{
+    m_prerollCheckQueued.fetchAndStoreOrdered( 0 );
+    if ( m_prerolling.fetchAndAddOrdered( 0 ) == 0 )
+        return ;
+    QList<ClipWorkflow*>    pending;
+    for ( unsigned int i = 0; i < Workflow::NbTrackType; ++i )
+        m_tracks[i]->preroll( m_prerollFrame, m_prerollFrames, pending );
+    if ( pending.isEmpty() == true )
+    {
+        vlmcDebug() << "Prerolled frame" << m_prerollFrame << "in"
+                    << ( mdate() - m_prerollStartDate ) / 1000 << "ms";
+        m_prerolling.fetchAndStoreOrdered( 0 );
+        emit prerolled( true );
+        return ;
+    }
+    if ( mdate() - m_prerollStartDate < (qint64)m_prerollTimeout * 1000 )
+        return ;
+    foreach ( ClipWorkflow* cw, pending )
+    {
+        Media*  media = cw->clip()->getMedia();
+        vlmcWarning() << "Clip" << cw->getClipHelper()->uuid() << "of" << media->fileName()
+                      << "isn't ready after" << m_prerollTimeout << "ms. State:" << cw->getState()
+                      << ( cw->readyDate() == 0 ? ", no frame decoded yet" : ", decoding too slowly" )
+                      << ", startup latency:" << media->startupLatency() / 1000 << "ms";
+    }
+    m_prerolling.fetchAndStoreOrdered( 0 );
+    emit prerolled( false );
 }
 
 const Workflow::OutputBuffer*
@@ -120,18 +255,63 @@ MainWorkflow::getOutput( Workflow::TrackType trackType, bool paused )
             subFrame = m_currentFrame[trackType];
         }
 
-        Workflow::OutputBuffer  *ret = m_tracks[trackType]->getOutput( currentFrame,
-                                                                       subFrame, paused );
-        if ( trackType == Workflow::VideoTrack )
+        if ( trackType == Workflow::AudioTrack )
+            return m_tracks[trackType]->getOutput( currentFrame, subFrame, paused );
+        if ( m_renderAhead == 0 )
+            return renderVideo( currentFrame, paused );
+        //A still frame has to reflect the edits right away, there's nothing to render ahead.
+        if ( paused == true )
+        {
+            m_compositorThread->suspend();
+            return renderVideo( currentFrame, paused );
+        }
+        delete m_aheadOutput;
+        m_aheadOutput = m_compositorThread->take( currentFrame );
+        if ( m_aheadOutput == NULL )
         {
-            if ( ret == NULL )
-                return m_blackOutput;
+            m_nbDroppedFrames.fetchAndAddRelaxed( 1 );
+            return m_blackOutput;
         }
-        return ret;
+        return m_aheadOutput;
     }
     return NULL;
 }
 
+const Workflow::Frame*
+MainWorkflow::renderVideo( qint64 frame, bool paused )
+{
+    const quint32           generation = m_editGeneration.fetchAndAddRelaxed( 0 );
+    const quint32           divisor = m_pendingDivisor.fetchAndAddRelaxed( 0 );
+    if ( divisor != m_renderDivisor )
+        applyRenderDivisor( divisor );
+    //The scaled down frames are only good enough while playing.
+    if ( paused == true && m_renderDivisor == 1 )
+    {
+        const Workflow::Frame   *cached = m_scrubCache->find( frame, generation );
+        if ( cached != NULL )
+            return cached;
+    }
+    const Workflow::Frame   *ret = static_cast<Workflow::Frame*>(
+            m_tracks[Workflow::VideoTrack]->getOutput( frame, frame, paused ) );
+    m_frameBudget->rebalance();
+    const bool              complete = m_tracks[Workflow::VideoTrack]->isOutputComplete();
+    if ( complete == false && paused == false )
+        m_nbLateFrames.fetchAndAddRelaxed( 1 );
+    if ( ret == NULL )
+        return m_blackOutput;
+    //Don't keep a frame missing a clip which wasn't ready yet.
+    if ( complete == true && m_renderDivisor == 1 )
+    {
+        //Only what the user stopped on is worth scrubbing back to, playback would
+        //flush it out of the cache.
+        if ( paused == true )
+            m_scrubCache->insert( frame, generation, ret );
+        else
+            m_renderCache->store( frame, ret );
+    }
+    return ret;
+}
+
 void
 MainWorkflow::nextFrame( Workflow::TrackType trackType )
 {
@@ -174,31 +354,46 @@ MainWorkflow::stop()
         before stopping the mainworkflow.
     */
     m_renderStarted = false;
+    m_prerolling.fetchAndStoreOrdered( 0 );
+    m_compositorThread->stop();
+    m_compositorThread->wait();
+    delete m_aheadOutput;
+    m_aheadOutput = NULL;
+    m_renderCache->stopRecording();
     for (unsigned int i = 0; i < Workflow::NbTrackType; ++i)
     {
         m_tracks[i]->stop();
         m_currentFrame[i] = 0;
     }
+    m_scrubCache->trim( m_editGeneration.fetchAndAddRelaxed( 0 ) );
+    Workflow::FramePool::getInstance()->dumpStats();
+    m_rendererPool->dumpStats();
+    m_scrubCache->dumpStats();
     emit frameChanged( 0, Vlmc::Renderer );
 }
 
 void
 MainWorkflow::stopFrameComputing()
 {
+    //The frame being composited ahead may be waiting for the clips to be stopped.
+    m_compositorThread->stop();
     for ( qint32 type = 0; type < Workflow::NbTrackType; ++type )
         m_tracks[type]->stopFrameComputing();
+    m_compositorThread->wait();
 }
 
 void
 MainWorkflow::muteTrack( unsigned int trackId, Workflow::TrackType trackType )
 {
     m_tracks[trackType]->muteTrack( trackId );
+    notifyEdit();
 }
 
 void
 MainWorkflow::unmuteTrack( unsigned int trackId, Workflow::TrackType trackType )
 {
     m_tracks[trackType]->unmuteTrack( trackId );
+    notifyEdit();
 }
 
 void
@@ -206,6 +401,7 @@ MainWorkflow::muteClip( const QUuid& uuid, unsigned int trackId,
                         Workflow::TrackType trackType )
 {
     m_tracks[trackType]->muteClip( uuid, trackId );
+    notifyEdit();
 }
 
 void
@@ -213,6 +409,7 @@ MainWorkflow::unmuteClip( const QUuid& uuid, unsigned int trackId,
                           Workflow::TrackType trackType )
 {
     m_tracks[trackType]->unmuteClip( uuid, trackId );
+    notifyEdit();
 }
 
 void
@@ -222,6 +419,7 @@ MainWorkflow::setCurrentFrame( qint64 currentFrame, Vlmc::FrameChangedReason rea
 
     for ( unsigned int i = 0; i < Workflow::NbTrackType; ++i)
         m_currentFrame[i] = currentFrame;
+    m_compositorThread->seek( currentFrame );
     emit frameChanged( currentFrame, reason );
 }
 
@@ -264,6 +462,12 @@ MainWorkflow::load(const QDomDocument& root )
         type = static_cast<Workflow::TrackType>( utype );
 
         track( type, trackId )->loadEffects( elem );
+        if ( elem.hasAttribute( "opacity" ) == true )
+            track( type, trackId )->setOpacity( elem.attribute( "opacity" ).toDouble() );
+        if ( elem.hasAttribute( "gain" ) == true )
+            track( type, trackId )->setGain( elem.attribute( "gain" ).toDouble() );
+        if ( elem.hasAttribute( "pan" ) == true )
+            track( type, trackId )->setPan( elem.attribute( "pan" ).toDouble() );
 
         QDomElement clips = elem.firstChildElement( "clips" );
         if ( clips.isNull() == false )
@@ -295,6 +499,9 @@ MainWorkflow::load(const QDomDocument& root )
                 {
                     ClipHelper  *ch = new ClipHelper( c, begin.toLongLong(),
                                                       end.toLongLong(), chUuid );
+                    //They're deleted along with the tracks, as QObject children.
+                    if ( m_ownsClipHelpers == true )
+                        ch->setParent( this );
                     track( type, trackId )->addClip( ch, startFrame.toLongLong() );
 
                     ch->clipWorkflow()->loadEffects( clip );
@@ -304,6 +511,7 @@ MainWorkflow::load(const QDomDocument& root )
         }
         elem = elem.nextSiblingElement();
     }
+    notifyEdit();
     return true;
 }
 
@@ -319,11 +527,40 @@ MainWorkflow::save( QXmlStreamWriter& project )
     return true;
 }
 
+MainWorkflow*
+MainWorkflow::clone()
+{
+    QByteArray          xml;
+    QXmlStreamWriter    writer( &xml );
+    save( writer );
+
+    QDomDocument        project;
+    MainWorkflow        *ret = new MainWorkflow( m_trackCount );
+    ret->m_ownsClipHelpers = true;
+    //A single budget for all the copies, which also sets the FramePool idle size alone.
+    delete ret->m_frameBudget;
+    ret->m_frameBudget = m_frameBudget;
+    ret->m_ownsFrameBudget = false;
+    if ( project.setContent( xml ) == false || ret->load( project ) == false )
+    {
+        vlmcWarning() << "Failed to copy the workflow";
+        delete ret;
+        return NULL;
+    }
+    return ret;
+}
+
 void
 MainWorkflow::clear()
 {
     for ( unsigned int i = 0; i < Workflow::NbTrackType; ++i )
         m_tracks[i]->clear();
+    //The medias may go away with the project.
+    m_rendererPool->clear();
+    //The cached ranges are kept for when the project is loaded again.
+    m_renderCache->stopRecording();
+    m_editGeneration.fetchAndAddRelaxed( 1 );
+    m_compositorThread->invalidate();
     emit cleared();
 }
 
@@ -369,6 +606,46 @@ MainWorkflow::getHeight() const
     return m_height;
 }
 
+quint32
+MainWorkflow::getOutputWidth() const
+{
+    return m_outputWidth;
+}
+
+quint32
+MainWorkflow::getOutputHeight() const
+{
+    return m_outputHeight;
+}
+
+void
+MainWorkflow::setRenderDivisor( quint32 divisor )
+{
+    m_pendingDivisor.fetchAndStoreRelaxed( divisor );
+}
+
+quint32
+MainWorkflow::renderDivisor() const
+{
+    return m_renderDivisor;
+}
+
+void
+MainWorkflow::applyRenderDivisor( quint32 divisor )
+{
+    vlmcDebug() << "Rendering the video tracks at 1 /" << divisor << "of the output resolution";
+    m_renderDivisor = divisor;
+    //The clips output sizes and the effects are better off with multiples of 8.
+    m_width = qMax<quint32>( ( m_outputWidth / divisor ) & ~7, 8 );
+    m_height = qMax<quint32>( ( m_outputHeight / divisor ) & ~7, 8 );
+    m_tracks[Workflow::VideoTrack]->stop();
+    //The mixers and filters get initialized with the new size, and so must be what we feed them.
+    delete m_trackBlackOutput;
+    m_trackBlackOutput = new Workflow::Frame( m_width, m_height );
+    memset( m_trackBlackOutput->buffer(), 0, m_trackBlackOutput->size() );
+    m_tracks[Workflow::VideoTrack]->startRender( m_width, m_height, m_fps );
+}
+
 void
 MainWorkflow::renderOneFrame()
 {
@@ -385,6 +662,22 @@ MainWorkflow::setFullSpeedRender( bool val )
         m_tracks[i]->setFullSpeedRender( val );
 }
 
+void
+MainWorkflow::setUseProxies( bool useProxies )
+{
+    if ( useProxies == m_useProxies )
+        return ;
+    m_useProxies = useProxies;
+    //What was rendered with the other sources can't be reused as is.
+    notifyEdit();
+}
+
+bool
+MainWorkflow::useProxies() const
+{
+    return m_useProxies;
+}
+
 bool
 MainWorkflow::contains( const QUuid &uuid ) const
 {
@@ -397,7 +690,25 @@ MainWorkflow::contains( const QUuid &uuid ) const
 const Workflow::Frame*
 MainWorkflow::blackOutput() const
 {
-    return m_blackOutput;
+    return m_trackBlackOutput;
+}
+
+Workflow::FrameBudget*
+MainWorkflow::frameBudget()
+{
+    return m_frameBudget;
+}
+
+QThreadPool*
+MainWorkflow::clipStartPool()
+{
+    return m_clipStartPool;
+}
+
+Workflow::RendererPool*
+MainWorkflow::rendererPool()
+{
+    return m_rendererPool;
 }
 
 quint32
@@ -428,3 +739,55 @@ MainWorkflow::track( Workflow::TrackType type, quint32 trackId )
 {
     return m_tracks[type]->track( trackId );
 }
+
+void
+MainWorkflow::notifyEdit()
+{
+    m_editGeneration.fetchAndAddRelaxed( 1 );
+    m_compositorThread->invalidate();
+    validateRenderCache();
+}
+
+Workflow::RenderCache*
+MainWorkflow::renderCache()
+{
+    return m_renderCache;
+}
+
+bool
+MainWorkflow::cacheRange( qint64 begin, qint64 end )
+{
+    Q_ASSERT( m_renderStarted == true );
+    m_renderCache->setCapacity( (quint64)VLMC_PROJECT_GET_UINT( "video/RenderCacheSize" ) * 1024 * 1024 );
+    return m_renderCache->record( begin, end, m_outputWidth, m_outputHeight, m_fps, contentHash( begin, end ) );
+}
+
+quint32
+MainWorkflow::nbLateFrames() const
+{
+    return m_nbLateFrames.fetchAndAddRelaxed( 0 );
+}
+
+quint32
+MainWorkflow::nbDroppedFrames() const
+{
+    return m_nbDroppedFrames.fetchAndAddRelaxed( 0 );
+}
+
+QByteArray
+MainWorkflow::contentHash( qint64 begin, qint64 end ) const
+{
+    QCryptographicHash  hash( QCryptographicHash::Sha1 );
+    m_tracks[Workflow::VideoTrack]->hashRange( hash, begin, end );
+    return hash.result();
+}
+
+void
+MainWorkflow::validateRenderCache()
+{
+    foreach ( const Workflow::RenderCache::Range& range, m_renderCache->ranges() )
+    {
+        if ( contentHash( range.begin, range.end ) != range.hash )
+            m_renderCache->remove( range.begin, range.end );
+    }
+}
@@ -40,13 +40,21 @@ namespace   Workflow
 {
     class   Frame;
     class   AudioSample;
+    class   CompositorThread;
+    class   FrameBudget;
+    class   RenderCache;
+    class   RendererPool;
+    class   ScrubCache;
 }
 
 class   QDomDocument;
 class   QDomElement;
 class   QMutex;
 class   QReadWriteLock;
+class   QThreadPool;
+class   QWaitCondition;
 
+#include <QAtomicInt>
 #include <QObject>
 #include <QUuid>
 
@@ -69,6 +77,39 @@ class   MainWorkflow : public QObject, public ILoadSave
          *  This will basically activate all the tracks, newLengthso they can render.
          */
         void                    startRender( quint32 width, quint32 height, double fps );
+        /**
+         *  \brief      Start the clips active at the current frame, and wait until
+         *              each of them computed nbFrames frames.
+         *
+         *  This has to be called after startRender(), and the first frame mustn't be
+         *  asked for before prerolled() is emitted, so that the render doesn't start
+         *  with clips which aren't ready.
+         *  This doesn't block: the clips are checked from the event loop, each time
+         *  one of them makes progress.
+         *  \param      timeout     In milliseconds.
+         *  \sa         prerolled()
+         */
+        void                    preroll( quint32 nbFrames, unsigned long timeout );
+        /**
+         *  \brief      Tell the preroll a clip computed a buffer, or changed its state.
+         *
+         *  This can be called from any thread.
+         */
+        void                    notifyPrerollProgress();
+        /**
+         *  \brief      Tell the tracks waiting for a clip that one is done starting.
+         *
+         *  This can be called from any thread.
+         */
+        void                    notifyClipStarted();
+        /**
+         *  \brief      Wait for a clip to be done starting.
+         *
+         *  \param      lock    Held by the caller, and released while waiting.
+         *  \param      timeout In milliseconds.
+         *  \sa         notifyClipStarted()
+         */
+        void                    waitForClipStart( QReadWriteLock* lock, unsigned long timeout );
         /**
          *  \brief      Gets a frame from the workflow
          *
@@ -79,6 +120,8 @@ class   MainWorkflow : public QObject, public ILoadSave
          *          AudioTrack
          *  \param  trackType   The type of track you wish to get the render from.
          *  \param  paused      The paused state of the renderer
+         *  While playing, the video frames are taken from the ones composited ahead,
+         *  if the render was started with some.
          */
         const Workflow::OutputBuffer    *getOutput( Workflow::TrackType trackType, bool paused );
         /**
@@ -205,8 +248,10 @@ class   MainWorkflow : public QObject, public ILoadSave
          *  This value is used by the ClipWorkflow that generates the frames.
          *  If this value is edited in the preferences, it will only change after the
          *  current render has been stopped.
+         *  This is lower than the output width while the preview is scaled down.
          *  \return     The width (in pixels) of the currently rendered frames
          *  \sa         getHeight()
+         *  \sa         setRenderDivisor()
          */
         quint32                getWidth() const;
         /**
@@ -219,6 +264,24 @@ class   MainWorkflow : public QObject, public ILoadSave
          *  \sa         getWidth()
          */
         quint32                getHeight() const;
+        /**
+         *  \returns    The resolution the render was started with, which the
+         *              rendered frames have to be scaled to.
+         */
+        quint32                 getOutputWidth() const;
+        quint32                 getOutputHeight() const;
+        /**
+         *  \brief  Render the video tracks at the output resolution divided by divisor.
+         *
+         *  The video clips are restarted with the new resolution when the next
+         *  frame gets rendered.
+         *  startRender() goes back to the output resolution.
+         */
+        void                    setRenderDivisor( quint32 divisor );
+        /**
+         *  \returns    The divisor the current frames are rendered with.
+         */
+        quint32                 renderDivisor() const;
 
         /**
          *  \brief          Will render one frame only
@@ -237,6 +300,16 @@ class   MainWorkflow : public QObject, public ILoadSave
          */
         void                    setFullSpeedRender( bool val );
 
+        /**
+         *  \brief  Decode the proxies of the medias which have one, instead of
+         *          the medias themselves.
+         *
+         *  This is only meant for the preview, the exports should use the originals.
+         *  This has to be called before startRender().
+         */
+        void                    setUseProxies( bool useProxies );
+        bool                    useProxies() const;
+
         /**
          *  \return     true if the current workflow contains the clip which the uuid was
          *              passed. Falsed otherwise.
@@ -255,13 +328,74 @@ class   MainWorkflow : public QObject, public ILoadSave
 
         TrackWorkflow           *track( Workflow::TrackType type, quint32 trackId );
 
+        /**
+         *  \returns    A black frame at the rendering resolution.
+         *  \sa         getWidth()
+         */
         const Workflow::Frame   *blackOutput() const;
 
+        /**
+         *  \brief     The budget the running ClipWorkflows take their queue depth from.
+         */
+        Workflow::FrameBudget   *frameBudget();
+        /**
+         *  \brief     The threads on which the ClipWorkflows start their renderer.
+         */
+        QThreadPool             *clipStartPool();
+        /**
+         *  \brief     Where the ClipWorkflows get their renderer from, and give it back.
+         */
+        Workflow::RendererPool  *rendererPool();
+
         /**
          * \brief   Return the number of track for each track type.
          */
         quint32                 trackCount() const;
 
+        /**
+         *  \brief     To be called when the timeline has been edited.
+         *
+         *  The frames rendered before won't be reused for scrubbing.
+         */
+        void                    notifyEdit();
+
+        /**
+         *  \brief     The cache of the ranges rendered ahead, for this project.
+         */
+        Workflow::RenderCache   *renderCache();
+        /**
+         *  \brief     Store the composited frames of [begin, end] in the render cache,
+         *             as they get rendered.
+         *
+         *  \warning   The render has to be started, as the frames are stored with its
+         *             resolution and frame rate.
+         */
+        bool                    cacheRange( qint64 begin, qint64 end );
+
+        /**
+         *  \brief     The number of frames composited while a clip wasn't ready yet,
+         *             and which therefore miss it, since the render started.
+         */
+        quint32                 nbLateFrames() const;
+        /**
+         *  \brief     The number of frames replaced by a black frame since the render
+         *             started, because nothing was composited for them.
+         */
+        quint32                 nbDroppedFrames() const;
+
+        /**
+         *  \brief     Create a workflow containing the same timeline, which can be
+         *             rendered independently from this one.
+         *
+         *  The clips and effects are copied, the medias are shared. The edits made
+         *  afterward aren't reflected in the copy.
+         *  The copies share this workflow's FrameBudget, so that rendering several
+         *  of them at once doesn't use more memory than a single render would.
+         *  \returns   The new workflow, which the caller owns, or NULL on failure.
+         *  \warning   The copy has to be deleted before this workflow.
+         */
+        MainWorkflow            *clone();
+
     private:
         /**
          *  \brief  Compute the length of the workflow.
@@ -271,6 +405,27 @@ class   MainWorkflow : public QObject, public ILoadSave
          *  This method will update the attribute m_lengthFrame
          */
         void                    computeLength();
+        /**
+         *  \returns   A hash of everything which is rendered between begin and end.
+         */
+        QByteArray              contentHash( qint64 begin, qint64 end ) const;
+        /**
+         *  \brief     Drop the cached ranges which don't match the timeline anymore.
+         */
+        void                    validateRenderCache();
+        /**
+         *  \brief     Restart the video tracks with the given resolution divisor.
+         *
+         *  \warning   This has to be called from renderVideo().
+         */
+        void                    applyRenderDivisor( quint32 divisor );
+        /**
+         *  \brief     Composite the video tracks for the given frame.
+         *
+         *  \warning   This has to be called from the video render thread, or from
+         *             the compositor thread while it renders ahead.
+         */
+        const Workflow::Frame   *renderVideo( qint64 frame, bool paused );
 
         /**
          *  \param      uuid : The clip helper's uuid.
@@ -287,6 +442,36 @@ class   MainWorkflow : public QObject, public ILoadSave
     private:
         /// Pre-filled buffer used when there's nothing to render
         Workflow::Frame         *m_blackOutput;
+        /**
+         *  The same at the resolution the video tracks render with, which they
+         *  mix and filter. It only changes along with the video tracks.
+         */
+        Workflow::Frame         *m_trackBlackOutput;
+        Workflow::FrameBudget   *m_frameBudget;
+        QThreadPool             *m_clipStartPool;
+        Workflow::RendererPool  *m_rendererPool;
+        Workflow::ScrubCache    *m_scrubCache;
+        Workflow::RenderCache   *m_renderCache;
+        Workflow::CompositorThread  *m_compositorThread;
+        /// How many frames are composited ahead while playing. 0 if none.
+        quint32                 m_renderAhead;
+        /// The frame last taken from the compositor thread.
+        Workflow::Frame         *m_aheadOutput;
+        /// Incremented for each edit, so the cached frames can tell they're outdated.
+        QAtomicInt              m_editGeneration;
+        /// Counted since startRender(). Mutable, as QAtomicInt can only be read through fetchAndAdd.
+        mutable QAtomicInt      m_nbLateFrames;
+        mutable QAtomicInt      m_nbDroppedFrames;
+        /// Set while preroll() waits for the clips.
+        QAtomicInt              m_prerolling;
+        /// Set while a checkPreroll() call is queued, so that the decoders don't flood the event loop.
+        QAtomicInt              m_prerollCheckQueued;
+        qint64                  m_prerollFrame;
+        quint32                 m_prerollFrames;
+        unsigned long           m_prerollTimeout;
+        qint64                  m_prerollStartDate;
+        /// Signaled when a clip is done starting, which a full speed render may wait for.
+        QWaitCondition          *m_clipStartedCond;
 
         /// Lock for the m_currentFrame atribute.
         QReadWriteLock*                 m_currentFrameLock;
@@ -313,9 +498,23 @@ class   MainWorkflow : public QObject, public ILoadSave
         quint32                         m_width;
         /// Height used for the render
         quint32                         m_height;
+        double                          m_fps;
+        /// The resolution startRender() was called with.
+        quint32                         m_outputWidth;
+        quint32                         m_outputHeight;
+        quint32                         m_renderDivisor;
+        /// Applied when the next video frame gets rendered.
+        QAtomicInt                      m_pendingDivisor;
+        bool                            m_useProxies;
+        /// A clone has no undo stack to delete its clip helpers.
+        bool                            m_ownsClipHelpers;
+        /// A clone uses the FrameBudget of the workflow it was copied from.
+        bool                            m_ownsFrameBudget;
         /// Store the number of track for each track type.
         const quint32                   m_trackCount;
 
+        friend class    Workflow::CompositorThread;
+
     private slots:
         /**
          *  \brief  Called when a track end is reached
@@ -325,6 +524,10 @@ class   MainWorkflow : public QObject, public ILoadSave
          *  \sa     mainWorkflowEndReached()
          */
         void                            tracksEndReached();
+        /**
+         *  \brief  Emit prerolled() if the clips are ready, or if the time is up.
+         */
+        void                            checkPreroll();
 
     public slots:
         /**
@@ -372,6 +575,15 @@ class   MainWorkflow : public QObject, public ILoadSave
          *  \param  newLength   The new length, in frames
          */
         void                    lengthChanged( qint64 );
+
+        /**
+         *  \brief  Emitted once the preroll is over.
+         *
+         *  \param  ready   false if some clips still weren't ready after the timeout.
+         *                  They are logged, and the render may go on without them.
+         *  \sa     preroll()
+         */
+        void                    prerolled( bool ready );
 };
 
 #endif // MAINWORKFLOW_H
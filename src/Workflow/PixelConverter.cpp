@@ -0,0 +1,311 @@
+/*****************************************************************************
+ * PixelConverter.cpp: Conversions between the workflow pixel formats
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Workflow/PixelConverter.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+using namespace Workflow;
+
+// Both the C and SSE2 versions use the same 6 bits fixed point coefficients,
+// so they give the exact same result.
+static inline int
+clampPixel( int value )
+{
+    if ( value < 0 )
+        return 0;
+    if ( value > 255 )
+        return 255;
+    return value;
+}
+
+static inline quint32
+yuvToRgb( int y, int u, int v )
+{
+    const int   c = ( y - 16 ) * 75;
+    u -= 128;
+    v -= 128;
+    const int   r = ( c + 102 * v ) >> 6;
+    const int   g = ( c - 25 * u - 52 * v ) >> 6;
+    const int   b = ( c + 129 * u ) >> 6;
+    return 0xff000000 | clampPixel( r ) << 16 | clampPixel( g ) << 8 | clampPixel( b );
+}
+
+static inline int
+luma( quint32 pixel )
+{
+    const int   r = ( pixel >> 16 ) & 0xff;
+    const int   g = ( pixel >> 8 ) & 0xff;
+    const int   b = pixel & 0xff;
+    return ( ( 66 * r + 129 * g + 25 * b + 128 ) >> 8 ) + 16;
+}
+
+static inline quint32
+average( quint32 a, quint32 b )
+{
+    // Per channel (a + b + 1) / 2, as _mm_avg_epu8 does.
+    return ( a | b ) - ( ( ( a ^ b ) & 0xfefefefe ) >> 1 );
+}
+
+static inline void
+chroma( quint32 pixel, quint8 *u, quint8 *v )
+{
+    const int   r = ( pixel >> 16 ) & 0xff;
+    const int   g = ( pixel >> 8 ) & 0xff;
+    const int   b = pixel & 0xff;
+    *u = ( ( -38 * r - 74 * g + 112 * b + 128 ) >> 8 ) + 128;
+    *v = ( ( 112 * r - 94 * g - 18 * b + 128 ) >> 8 ) + 128;
+}
+
+#ifdef __SSE2__
+/**
+ *  Computes the dot product of 4 RV32 pixels with the given per channel coefficients.
+ */
+static inline __m128i
+dot4( __m128i pixels, __m128i coefs )
+{
+    const __m128i   zero = _mm_setzero_si128();
+    __m128i         lo = _mm_madd_epi16( _mm_unpacklo_epi8( pixels, zero ), coefs );
+    __m128i         hi = _mm_madd_epi16( _mm_unpackhi_epi8( pixels, zero ), coefs );
+    lo = _mm_add_epi32( lo, _mm_srli_epi64( lo, 32 ) );
+    hi = _mm_add_epi32( hi, _mm_srli_epi64( hi, 32 ) );
+    lo = _mm_shuffle_epi32( lo, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+    hi = _mm_shuffle_epi32( hi, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+    return _mm_unpacklo_epi64( lo, hi );
+}
+#endif
+
+void
+PixelConverter::I420ToRV32( const quint8 *y, quint32 yPitch,
+                            const quint8 *u, const quint8 *v, quint32 uvPitch,
+                            quint32 *dst, quint32 dstPitch,
+                            quint32 width, quint32 height )
+{
+#ifdef __SSE2__
+    const __m128i   zero = _mm_setzero_si128();
+    const __m128i   offset = _mm_set1_epi16( 16 );
+    const __m128i   center = _mm_set1_epi16( 128 );
+    const __m128i   yCoef = _mm_set1_epi16( 75 );
+    const __m128i   vrCoef = _mm_set1_epi16( 102 );
+    const __m128i   ugCoef = _mm_set1_epi16( 25 );
+    const __m128i   vgCoef = _mm_set1_epi16( 52 );
+    const __m128i   ubCoef = _mm_set1_epi16( 129 );
+    const __m128i   alpha = _mm_set1_epi8( (char)0xff );
+#endif
+
+    for ( quint32 j = 0; j < height; ++j )
+    {
+        const quint8    *yLine = y + j * yPitch;
+        const quint8    *uLine = u + ( j / 2 ) * uvPitch;
+        const quint8    *vLine = v + ( j / 2 ) * uvPitch;
+        quint32         *dstLine = reinterpret_cast<quint32*>(
+                    reinterpret_cast<quint8*>( dst ) + j * dstPitch );
+        quint32         i = 0;
+#ifdef __SSE2__
+        for ( ; i + 16 <= width; i += 16 )
+        {
+            __m128i     yv = _mm_loadu_si128( reinterpret_cast<const __m128i*>( yLine + i ) );
+            __m128i     uv = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( uLine + i / 2 ) );
+            __m128i     vv = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( vLine + i / 2 ) );
+
+            __m128i     yLo = _mm_mullo_epi16( _mm_sub_epi16( _mm_unpacklo_epi8( yv, zero ), offset ), yCoef );
+            __m128i     yHi = _mm_mullo_epi16( _mm_sub_epi16( _mm_unpackhi_epi8( yv, zero ), offset ), yCoef );
+            uv = _mm_sub_epi16( _mm_unpacklo_epi8( uv, zero ), center );
+            vv = _mm_sub_epi16( _mm_unpacklo_epi8( vv, zero ), center );
+            // Each chroma sample covers 2 pixels.
+            __m128i     uLo = _mm_unpacklo_epi16( uv, uv );
+            __m128i     uHi = _mm_unpackhi_epi16( uv, uv );
+            __m128i     vLo = _mm_unpacklo_epi16( vv, vv );
+            __m128i     vHi = _mm_unpackhi_epi16( vv, vv );
+
+            __m128i     r = _mm_packus_epi16(
+                        _mm_srai_epi16( _mm_adds_epi16( yLo, _mm_mullo_epi16( vLo, vrCoef ) ), 6 ),
+                        _mm_srai_epi16( _mm_adds_epi16( yHi, _mm_mullo_epi16( vHi, vrCoef ) ), 6 ) );
+            __m128i     g = _mm_packus_epi16(
+                        _mm_srai_epi16( _mm_subs_epi16( _mm_subs_epi16( yLo, _mm_mullo_epi16( uLo, ugCoef ) ),
+                                                        _mm_mullo_epi16( vLo, vgCoef ) ), 6 ),
+                        _mm_srai_epi16( _mm_subs_epi16( _mm_subs_epi16( yHi, _mm_mullo_epi16( uHi, ugCoef ) ),
+                                                        _mm_mullo_epi16( vHi, vgCoef ) ), 6 ) );
+            __m128i     b = _mm_packus_epi16(
+                        _mm_srai_epi16( _mm_adds_epi16( yLo, _mm_mullo_epi16( uLo, ubCoef ) ), 6 ),
+                        _mm_srai_epi16( _mm_adds_epi16( yHi, _mm_mullo_epi16( uHi, ubCoef ) ), 6 ) );
+
+            __m128i     bg = _mm_unpacklo_epi8( b, g );
+            __m128i     ra = _mm_unpacklo_epi8( r, alpha );
+            __m128i     *out = reinterpret_cast<__m128i*>( dstLine + i );
+            _mm_storeu_si128( out, _mm_unpacklo_epi16( bg, ra ) );
+            _mm_storeu_si128( out + 1, _mm_unpackhi_epi16( bg, ra ) );
+            bg = _mm_unpackhi_epi8( b, g );
+            ra = _mm_unpackhi_epi8( r, alpha );
+            _mm_storeu_si128( out + 2, _mm_unpacklo_epi16( bg, ra ) );
+            _mm_storeu_si128( out + 3, _mm_unpackhi_epi16( bg, ra ) );
+        }
+#endif
+        for ( ; i < width; ++i )
+            dstLine[i] = yuvToRgb( yLine[i], uLine[i / 2], vLine[i / 2] );
+    }
+}
+
+void
+PixelConverter::RV32ToI420( const quint32 *src, quint32 srcPitch,
+                            quint8 *y, quint32 yPitch,
+                            quint8 *u, quint8 *v, quint32 uvPitch,
+                            quint32 width, quint32 height )
+{
+#ifdef __SSE2__
+    const __m128i   yCoefs = _mm_setr_epi16( 25, 129, 66, 0, 25, 129, 66, 0 );
+    const __m128i   uCoefs = _mm_setr_epi16( 112, -74, -38, 0, 112, -74, -38, 0 );
+    const __m128i   vCoefs = _mm_setr_epi16( -18, -94, 112, 0, -18, -94, 112, 0 );
+    const __m128i   rounding = _mm_set1_epi32( 128 );
+    const __m128i   yOffset = _mm_set1_epi32( 16 );
+    const __m128i   uvOffset = _mm_set1_epi32( 128 );
+#endif
+
+    for ( quint32 j = 0; j < height; j += 2 )
+    {
+        const quint32   *src0 = reinterpret_cast<const quint32*>(
+                    reinterpret_cast<const quint8*>( src ) + j * srcPitch );
+        // With an odd height, the last line is its own neighbour.
+        const quint32   *src1 = j + 1 < height ? reinterpret_cast<const quint32*>(
+                    reinterpret_cast<const quint8*>( src0 ) + srcPitch ) : src0;
+        quint8          *y0 = y + j * yPitch;
+        quint8          *y1 = j + 1 < height ? y0 + yPitch : NULL;
+        quint8          *uLine = u + ( j / 2 ) * uvPitch;
+        quint8          *vLine = v + ( j / 2 ) * uvPitch;
+        quint32         i = 0;
+#ifdef __SSE2__
+        for ( ; i + 8 <= width; i += 8 )
+        {
+            __m128i     a0 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src0 + i ) );
+            __m128i     a1 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src0 + i + 4 ) );
+            __m128i     b0 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src1 + i ) );
+            __m128i     b1 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src1 + i + 4 ) );
+
+            __m128i     lo = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( dot4( a0, yCoefs ), rounding ), 8 ), yOffset );
+            __m128i     hi = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( dot4( a1, yCoefs ), rounding ), 8 ), yOffset );
+            __m128i     packed = _mm_packs_epi32( lo, hi );
+            _mm_storel_epi64( reinterpret_cast<__m128i*>( y0 + i ), _mm_packus_epi16( packed, packed ) );
+            if ( y1 != NULL )
+            {
+                lo = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( dot4( b0, yCoefs ), rounding ), 8 ), yOffset );
+                hi = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( dot4( b1, yCoefs ), rounding ), 8 ), yOffset );
+                packed = _mm_packs_epi32( lo, hi );
+                _mm_storel_epi64( reinterpret_cast<__m128i*>( y1 + i ), _mm_packus_epi16( packed, packed ) );
+            }
+
+            // Average the 2x2 blocks: vertically first, then even & odd pixels.
+            __m128i     c0 = _mm_avg_epu8( a0, b0 );
+            __m128i     c1 = _mm_avg_epu8( a1, b1 );
+            __m128i     even = _mm_unpacklo_epi64( _mm_shuffle_epi32( c0, _MM_SHUFFLE( 2, 0, 2, 0 ) ),
+                                                   _mm_shuffle_epi32( c1, _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+            __m128i     odd = _mm_unpacklo_epi64( _mm_shuffle_epi32( c0, _MM_SHUFFLE( 3, 1, 3, 1 ) ),
+                                                  _mm_shuffle_epi32( c1, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+            __m128i     c = _mm_avg_epu8( even, odd );
+            __m128i     uv = _mm_packs_epi32(
+                        _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( dot4( c, uCoefs ), rounding ), 8 ), uvOffset ),
+                        _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( dot4( c, vCoefs ), rounding ), 8 ), uvOffset ) );
+            uv = _mm_packus_epi16( uv, uv );
+            const int   uValues = _mm_cvtsi128_si32( uv );
+            const int   vValues = _mm_cvtsi128_si32( _mm_srli_si128( uv, 4 ) );
+            memcpy( uLine + i / 2, &uValues, 4 );
+            memcpy( vLine + i / 2, &vValues, 4 );
+        }
+#endif
+        for ( ; i < width; i += 2 )
+        {
+            // With an odd width, the last column is its own neighbour.
+            const quint32   next = i + 1 < width ? i + 1 : i;
+            y0[i] = luma( src0[i] );
+            if ( next != i )
+                y0[next] = luma( src0[next] );
+            if ( y1 != NULL )
+            {
+                y1[i] = luma( src1[i] );
+                if ( next != i )
+                    y1[next] = luma( src1[next] );
+            }
+            const quint32   c = average( average( src0[i], src1[i] ),
+                                         average( src0[next], src1[next] ) );
+            chroma( c, uLine + i / 2, vLine + i / 2 );
+        }
+    }
+}
+
+void
+PixelConverter::ScalePlane( const quint8 *src, quint32 srcPitch,
+                            quint32 srcWidth, quint32 srcHeight,
+                            quint8 *dst, quint32 dstPitch,
+                            quint32 dstWidth, quint32 dstHeight )
+{
+    // 16.16 fixed point steps through the source.
+    const quint64   xStep = ( (quint64)srcWidth << 16 ) / dstWidth;
+    const quint64   yStep = ( (quint64)srcHeight << 16 ) / dstHeight;
+    const quint8    *previous = NULL;
+
+    for ( quint32 j = 0; j < dstHeight; ++j )
+    {
+        const quint8    *srcLine = src + ( ( j * yStep ) >> 16 ) * srcPitch;
+        quint8          *dstLine = dst + j * dstPitch;
+        // When blowing up, consecutive lines come from the same source line.
+        if ( srcLine == previous )
+        {
+            memcpy( dstLine, dstLine - dstPitch, dstWidth );
+            continue ;
+        }
+        previous = srcLine;
+        quint64         x = 0;
+        for ( quint32 i = 0; i < dstWidth; ++i, x += xStep )
+            dstLine[i] = srcLine[x >> 16];
+    }
+}
+
+bool
+PixelConverter::IsOpaque( const quint32 *src, quint32 srcPitch,
+                          quint32 width, quint32 height )
+{
+    static const quint32    AlphaMask = 0xff000000;
+
+    for ( quint32 j = 0; j < height; ++j )
+    {
+        const quint32*  line = reinterpret_cast<const quint32*>(
+                    reinterpret_cast<const quint8*>( src ) + j * srcPitch );
+        quint32         i = 0;
+        quint32         acc = AlphaMask;
+#ifdef __SSE2__
+        __m128i         acc4 = _mm_set1_epi32( (int)AlphaMask );
+        for ( ; i + 4 <= width; i += 4 )
+            acc4 = _mm_and_si128( acc4, _mm_loadu_si128( reinterpret_cast<const __m128i*>( line + i ) ) );
+        acc4 = _mm_and_si128( acc4, _mm_srli_si128( acc4, 8 ) );
+        acc4 = _mm_and_si128( acc4, _mm_srli_si128( acc4, 4 ) );
+        acc &= (quint32)_mm_cvtsi128_si32( acc4 );
+#endif
+        for ( ; i < width; ++i )
+            acc &= line[i];
+        if ( ( acc & AlphaMask ) != AlphaMask )
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+/*****************************************************************************
+ * PixelConverter.h: Conversions between the workflow pixel formats
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef PIXELCONVERTER_H
+#define PIXELCONVERTER_H
+
+#include <qglobal.h>
+
+namespace   Workflow
+{
+    /**
+     *  \brief  Converts frames between I420 (BT.601, limited range) and RV32.
+     *
+     *  RV32 pixels use the same layout as VLC's, which is what frei0r effects have
+     *  always been fed. SSE2 is used when available, the plain C version handles
+     *  the remaining pixels and the other architectures.
+     */
+    namespace   PixelConverter
+    {
+        void    I420ToRV32( const quint8 *y, quint32 yPitch,
+                            const quint8 *u, const quint8 *v, quint32 uvPitch,
+                            quint32 *dst, quint32 dstPitch,
+                            quint32 width, quint32 height );
+        void    RV32ToI420( const quint32 *src, quint32 srcPitch,
+                            quint8 *y, quint32 yPitch,
+                            quint8 *u, quint8 *v, quint32 uvPitch,
+                            quint32 width, quint32 height );
+        /**
+         *  \brief  Resize a plane of 8 bits samples, picking the nearest one.
+         *
+         *  This is only meant to blow up the frames rendered at a lower
+         *  resolution for the preview, where speed matters more than quality.
+         */
+        void    ScalePlane( const quint8 *src, quint32 srcPitch,
+                            quint32 srcWidth, quint32 srcHeight,
+                            quint8 *dst, quint32 dstPitch,
+                            quint32 dstWidth, quint32 dstHeight );
+        /**
+         *  \returns    true if the alpha of every RV32 pixel is 255.
+         */
+        bool    IsOpaque( const quint32 *src, quint32 srcPitch,
+                          quint32 width, quint32 height );
+    }
+}
+
+#endif // PIXELCONVERTER_H
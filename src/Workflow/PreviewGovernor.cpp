@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * PreviewGovernor.cpp: Lowers the preview resolution when it can't keep up
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Workflow/PreviewGovernor.h"
+
+#include "Tools/VlmcDebug.h"
+
+using namespace Workflow;
+
+const quint32   PreviewGovernor::MaxDivisor;
+
+/// The number of frames the decision is based on.
+static const quint32    WindowSize = 25;
+/// The resolution is lowered when more than this many frames of a window were late.
+static const quint32    MaxLateFrames = WindowSize / 5;
+
+PreviewGovernor::PreviewGovernor() :
+        m_frameDuration( 1000000 / 30 ),
+        m_divisor( 1 )
+{
+    startWindow();
+}
+
+void
+PreviewGovernor::setFps( double fps )
+{
+    QMutexLocker    lock( &m_lock );
+    m_frameDuration = 1000000 / fps;
+}
+
+bool
+PreviewGovernor::addFrame( qint64 duration )
+{
+    QMutexLocker    lock( &m_lock );
+    if ( duration > m_frameDuration )
+        ++m_nbLateFrames;
+    m_slack += m_frameDuration - duration;
+    if ( ++m_nbFrames < WindowSize )
+        return false;
+    const bool      lower = ( m_nbLateFrames > MaxLateFrames && m_divisor < MaxDivisor );
+    if ( lower == true )
+    {
+        m_divisor *= 2;
+        vlmcDebug() << m_nbLateFrames << "late frames out of" << WindowSize << ", average slack:"
+                    << m_slack / (qint64)WindowSize << "us. Previewing at 1 /" << m_divisor;
+    }
+    startWindow();
+    return lower;
+}
+
+quint32
+PreviewGovernor::divisor() const
+{
+    QMutexLocker    lock( &m_lock );
+    return m_divisor;
+}
+
+void
+PreviewGovernor::reset()
+{
+    QMutexLocker    lock( &m_lock );
+    m_divisor = 1;
+    startWindow();
+}
+
+void
+PreviewGovernor::startWindow()
+{
+    m_nbFrames = 0;
+    m_nbLateFrames = 0;
+    m_slack = 0;
+}
@@ -0,0 +1,76 @@
+/*****************************************************************************
+ * PreviewGovernor.h: Lowers the preview resolution when it can't keep up
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef PREVIEWGOVERNOR_H
+#define PREVIEWGOVERNOR_H
+
+#include <QMutex>
+
+namespace   Workflow
+{
+    /**
+     *  \brief  Decides which fraction of the output resolution the preview renders at.
+     *
+     *  The time the render thread spends on each frame is compared to the frame
+     *  duration. When too many frames of a window are late, the resolution is
+     *  divided by two, down to a quarter. It only goes back to full resolution
+     *  when reset, which the preview does when paused.
+     */
+    class   PreviewGovernor
+    {
+        public:
+            PreviewGovernor();
+
+            void            setFps( double fps );
+            /**
+             *  \brief  Record how long the render thread took to output a frame.
+             *
+             *  \param  duration    In microseconds.
+             *  \returns    true if the divisor changed.
+             */
+            bool            addFrame( qint64 duration );
+            /**
+             *  \returns    By how much the output width and height should be divided.
+             */
+            quint32         divisor() const;
+            /**
+             *  \brief  Go back to full resolution, and forget the previous frames.
+             */
+            void            reset();
+
+            static const quint32    MaxDivisor = 4;
+
+        private:
+            void            startWindow();
+
+        private:
+            mutable QMutex  m_lock;
+            qint64          m_frameDuration;
+            quint32         m_divisor;
+            quint32         m_nbFrames;
+            quint32         m_nbLateFrames;
+            /// The time left before each deadline, summed over the window, in microseconds.
+            qint64          m_slack;
+    };
+}
+
+#endif // PREVIEWGOVERNOR_H
@@ -0,0 +1,403 @@
+/*****************************************************************************
+ * RenderCache.cpp: Keeps the rendered timeline ranges on disk
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Workflow/RenderCache.h"
+
+#include "Tools/VlmcDebug.h"
+#include "Workflow/Types.h"
+
+#include <QMap>
+
+#include <cstring>
+
+using namespace Workflow;
+
+static const char       Magic[8] = { 'V', 'L', 'M', 'C', 'R', 'C', '0', '1' };
+static const int        HashSize = 20;
+static const int        MaxRanges = 64;
+/// The frames are stored after the index.
+static const quint64    DataOffset = 8192;
+/// The preview handles the frame rate as a float, the exports as a double.
+static const double     FpsTolerance = 0.001;
+
+namespace
+{
+    struct  DiskHeader
+    {
+        char        magic[8];
+        quint32     nbRanges;
+        quint32     reserved;
+    };
+
+    struct  DiskRange
+    {
+        qint64      begin;
+        qint64      end;
+        qint64      nbStored;
+        quint64     offset;
+        quint32     width;
+        quint32     height;
+        double      fps;
+        char        hash[HashSize];
+    };
+}
+
+RenderCache::RenderCache() :
+        m_map( NULL ),
+        m_capacity( 0 ),
+        m_recording( -1 )
+{
+    Q_ASSERT( sizeof( DiskHeader ) + MaxRanges * sizeof( DiskRange ) <= DataOffset );
+}
+
+RenderCache::~RenderCache()
+{
+    close();
+}
+
+bool
+RenderCache::open( const QString& path )
+{
+    close();
+
+    QMutexLocker    lock( &m_lock );
+    m_file.setFileName( path );
+    if ( m_file.open( QFile::ReadWrite ) == false )
+    {
+        vlmcWarning() << "Can't open render cache" << path << ':' << m_file.errorString();
+        return false;
+    }
+    if ( (quint64)m_file.size() >= DataOffset )
+    {
+        m_map = m_file.map( 0, m_file.size() );
+        if ( m_map != NULL && readIndex() == true )
+        {
+            vlmcDebug() << "Loaded" << m_entries.size() << "cached ranges from" << path;
+            return true;
+        }
+        vlmcWarning() << "Invalid render cache" << path << ", starting over";
+        m_entries.clear();
+    }
+    if ( resize( DataOffset ) == false )
+    {
+        m_file.close();
+        return false;
+    }
+    writeIndex();
+    return true;
+}
+
+void
+RenderCache::close()
+{
+    QMutexLocker    lock( &m_lock );
+    if ( m_file.isOpen() == false )
+        return ;
+    m_recording = -1;
+    if ( m_map != NULL )
+    {
+        writeIndex();
+        m_file.unmap( m_map );
+        m_map = NULL;
+    }
+    m_file.close();
+    m_entries.clear();
+}
+
+void
+RenderCache::setCapacity( quint64 capacity )
+{
+    QMutexLocker    lock( &m_lock );
+    m_capacity = capacity;
+}
+
+bool
+RenderCache::record( qint64 begin, qint64 end, quint32 width, quint32 height,
+                     double fps, const QByteArray& hash )
+{
+    Q_ASSERT( hash.size() == HashSize );
+    QMutexLocker    lock( &m_lock );
+
+    m_recording = -1;
+    if ( m_map == NULL || m_capacity == 0 || begin > end )
+        return false;
+    Range   range;
+    range.begin = begin;
+    range.end = end;
+    range.width = width;
+    range.height = height;
+    range.fps = fps;
+    range.hash = hash;
+    const quint64   size = rangeSize( range );
+    if ( size > m_capacity )
+    {
+        vlmcWarning() << "Frames" << begin << "to" << end << "don't fit in the render cache";
+        return false;
+    }
+    for ( int i = m_entries.size() - 1; i >= 0; --i )
+    {
+        if ( m_entries[i].range.begin <= end && m_entries[i].range.end >= begin )
+            removeEntry( i );
+    }
+    if ( m_entries.size() >= MaxRanges )
+        removeEntry( 0 );
+    quint64     offset;
+    while ( allocate( size, offset ) == false )
+    {
+        if ( m_entries.isEmpty() == true )
+        {
+            writeIndex();
+            return false;
+        }
+        removeEntry( 0 );
+    }
+    Entry   entry;
+    entry.range = range;
+    entry.nbStored = 0;
+    entry.offset = offset;
+    m_entries.append( entry );
+    m_recording = m_entries.size() - 1;
+    writeIndex();
+    return true;
+}
+
+void
+RenderCache::stopRecording()
+{
+    QMutexLocker    lock( &m_lock );
+    if ( m_recording < 0 )
+        return ;
+    if ( m_entries[m_recording].nbStored == 0 )
+        removeEntry( m_recording );
+    m_recording = -1;
+    writeIndex();
+}
+
+bool
+RenderCache::isRecording() const
+{
+    QMutexLocker    lock( &m_lock );
+    return m_recording >= 0;
+}
+
+void
+RenderCache::store( qint64 frame, const Frame *output )
+{
+    QMutexLocker    lock( &m_lock );
+    if ( m_recording < 0 )
+        return ;
+    Entry&      entry = m_entries[m_recording];
+    //A frame was missed, we can't fill the hole anymore.
+    if ( frame != entry.range.begin + entry.nbStored || output->width() != entry.range.width ||
+         output->height() != entry.range.height )
+        return ;
+    const size_t    frameSize = Frame::Size( entry.range.width, entry.range.height, I420 );
+    memcpy( m_map + entry.offset + entry.nbStored * frameSize, output->yuvBuffer(), frameSize );
+    ++entry.nbStored;
+    if ( entry.range.begin + entry.nbStored > entry.range.end )
+    {
+        vlmcDebug() << "Frames" << entry.range.begin << "to" << entry.range.end << "are cached";
+        m_recording = -1;
+    }
+    writeIndex();
+}
+
+bool
+RenderCache::fetch( qint64 frame, quint32 width, quint32 height, double fps,
+                    Frame *output ) const
+{
+    QMutexLocker    lock( &m_lock );
+    const int       i = find( frame, width, height, fps );
+    if ( i < 0 )
+        return false;
+    const Entry&    entry = m_entries[i];
+    const size_t    frameSize = Frame::Size( width, height, I420 );
+    output->resize( width, height );
+    output->reserve( frameSize, I420 );
+    memcpy( output->buffer(), m_map + entry.offset + ( frame - entry.range.begin ) * frameSize,
+            frameSize );
+    output->setLayout( frameSize );
+    return true;
+}
+
+QVector<RenderCache::Range>
+RenderCache::ranges() const
+{
+    QMutexLocker    lock( &m_lock );
+    QVector<Range>  ret;
+    foreach ( const Entry& entry, m_entries )
+        ret.append( entry.range );
+    return ret;
+}
+
+void
+RenderCache::remove( qint64 begin, qint64 end )
+{
+    QMutexLocker    lock( &m_lock );
+    for ( int i = m_entries.size() - 1; i >= 0; --i )
+    {
+        if ( m_entries[i].range.begin == begin && m_entries[i].range.end == end )
+        {
+            vlmcDebug() << "Cached frames" << begin << "to" << end << "are outdated";
+            removeEntry( i );
+        }
+    }
+    writeIndex();
+}
+
+int
+RenderCache::find( qint64 frame, quint32 width, quint32 height, double fps ) const
+{
+    for ( int i = 0; i < m_entries.size(); ++i )
+    {
+        const Entry&    entry = m_entries[i];
+        if ( entry.range.width == width && entry.range.height == height &&
+             qAbs( entry.range.fps - fps ) < FpsTolerance &&
+             frame >= entry.range.begin && frame < entry.range.begin + entry.nbStored )
+            return i;
+    }
+    return -1;
+}
+
+void
+RenderCache::removeEntry( int index )
+{
+    m_entries.remove( index );
+    if ( index == m_recording )
+        m_recording = -1;
+    else if ( index < m_recording )
+        --m_recording;
+}
+
+bool
+RenderCache::allocate( quint64 size, quint64 &offset )
+{
+    //First fit between the ranges, by offset.
+    QMap<quint64, quint64>  used;
+    foreach ( const Entry& entry, m_entries )
+        used.insert( entry.offset, entry.offset + rangeSize( entry.range ) );
+    offset = DataOffset;
+    QMap<quint64, quint64>::const_iterator  it = used.begin();
+    for ( ; it != used.end() && it.key() < offset + size; ++it )
+        offset = qMax( offset, it.value() );
+    if ( offset + size > DataOffset + m_capacity )
+        return false;
+    //Give the space after the last range back, or make some room.
+    quint64     fileSize = offset + size;
+    if ( used.isEmpty() == false )
+        fileSize = qMax( fileSize, ( used.end() - 1 ).value() );
+    if ( fileSize != (quint64)m_file.size() )
+        return resize( fileSize );
+    return true;
+}
+
+bool
+RenderCache::resize( quint64 size )
+{
+    if ( m_map != NULL )
+    {
+        m_file.unmap( m_map );
+        m_map = NULL;
+    }
+    //On failure, try to keep what we had.
+    const bool  resized = m_file.resize( size );
+    if ( resized == false )
+        vlmcWarning() << "Can't resize render cache:" << m_file.errorString();
+    m_map = m_file.map( 0, m_file.size() );
+    if ( m_map == NULL )
+    {
+        vlmcWarning() << "Can't map render cache:" << m_file.errorString();
+        m_entries.clear();
+        m_recording = -1;
+        return false;
+    }
+    return resized;
+}
+
+void
+RenderCache::writeIndex()
+{
+    if ( m_map == NULL )
+        return ;
+    DiskHeader      header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, Magic, sizeof( Magic ) );
+    header.nbRanges = m_entries.size();
+    memcpy( m_map, &header, sizeof( header ) );
+
+    DiskRange*      ranges = reinterpret_cast<DiskRange*>( m_map + sizeof( header ) );
+    for ( int i = 0; i < m_entries.size(); ++i )
+    {
+        const Entry&    entry = m_entries[i];
+        DiskRange       range;
+        memset( &range, 0, sizeof( range ) );
+        range.begin = entry.range.begin;
+        range.end = entry.range.end;
+        range.nbStored = entry.nbStored;
+        range.offset = entry.offset;
+        range.width = entry.range.width;
+        range.height = entry.range.height;
+        range.fps = entry.range.fps;
+        memcpy( range.hash, entry.range.hash.constData(), HashSize );
+        memcpy( ranges + i, &range, sizeof( range ) );
+    }
+}
+
+bool
+RenderCache::readIndex()
+{
+    DiskHeader      header;
+    memcpy( &header, m_map, sizeof( header ) );
+    if ( memcmp( header.magic, Magic, sizeof( Magic ) ) != 0 || header.nbRanges > (quint32)MaxRanges )
+        return false;
+
+    const DiskRange*    ranges = reinterpret_cast<const DiskRange*>( m_map + sizeof( header ) );
+    for ( quint32 i = 0; i < header.nbRanges; ++i )
+    {
+        DiskRange       range;
+        memcpy( &range, ranges + i, sizeof( range ) );
+        Entry           entry;
+        entry.range.begin = range.begin;
+        entry.range.end = range.end;
+        entry.range.width = range.width;
+        entry.range.height = range.height;
+        entry.range.fps = range.fps;
+        entry.range.hash = QByteArray( range.hash, HashSize );
+        entry.nbStored = range.nbStored;
+        entry.offset = range.offset;
+        if ( entry.range.begin > entry.range.end || entry.range.width == 0 ||
+             entry.range.height == 0 || entry.range.fps <= 0.0 || entry.offset < DataOffset ||
+             entry.offset + rangeSize( entry.range ) > (quint64)m_file.size() ||
+             entry.nbStored < 0 || entry.nbStored > entry.range.end - entry.range.begin + 1 )
+            return false;
+        if ( entry.nbStored > 0 )
+            m_entries.append( entry );
+    }
+    return true;
+}
+
+quint64
+RenderCache::rangeSize( const Range &range )
+{
+    return (quint64)( range.end - range.begin + 1 ) *
+            Frame::Size( range.width, range.height, I420 );
+}
@@ -0,0 +1,143 @@
+/*****************************************************************************
+ * RenderCache.h: Keeps the rendered timeline ranges on disk
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef RENDERCACHE_H
+#define RENDERCACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QVector>
+
+namespace   Workflow
+{
+    class   Frame;
+
+    /**
+     *  \brief  Stores the composited frames of some timeline ranges in a file.
+     *
+     *  Sections too heavy to be played in real time can be rendered once, then
+     *  served from here. The file is memory mapped, and starts with an index
+     *  of the ranges, so it outlives the session.
+     *  Each range comes with a hash of what the timeline contained when it was
+     *  rendered. The owner is expected to compare it after each edit, and to
+     *  drop the ranges that don't match anymore.
+     *  The frames are stored as packed I420, which is what imem expects.
+     */
+    class   RenderCache
+    {
+        public:
+            struct  Range
+            {
+                qint64          begin;
+                /// The last frame of the range, included.
+                qint64          end;
+                quint32         width;
+                quint32         height;
+                double          fps;
+                QByteArray      hash;
+            };
+
+            RenderCache();
+            ~RenderCache();
+
+            /**
+             *  \brief  Use the given file, and load the ranges it already contains.
+             *
+             *  An unreadable or outdated file is started over.
+             */
+            bool            open( const QString& path );
+            void            close();
+            /**
+             *  \brief  Set how many bytes the frames may use. 0 disables the cache.
+             */
+            void            setCapacity( quint64 capacity );
+
+            /**
+             *  \brief  Start storing the frames of [begin, end].
+             *
+             *  The ranges overlapping it are dropped, as well as the oldest ones
+             *  if there isn't enough room left.
+             *  \param  hash    Describes what the timeline contains for this range.
+             */
+            bool            record( qint64 begin, qint64 end, quint32 width, quint32 height,
+                                    double fps, const QByteArray& hash );
+            /**
+             *  \brief  Keep the frames stored so far, and ignore the next ones.
+             *
+             *  The range keeps its bounds, so its hash is still compared as a whole.
+             */
+            void            stopRecording();
+            bool            isRecording() const;
+            /**
+             *  \brief  Store the frame rendered for the given timeline frame.
+             *
+             *  The frames are expected in order. Once the last one of the range has
+             *  been stored, the recording stops by itself.
+             */
+            void            store( qint64 frame, const Frame* output );
+
+            /**
+             *  \brief  Copy a cached frame into output, which will be packed I420.
+             *
+             *  output is left untouched if the frame isn't cached, so it can be an
+             *  empty frame which only gets a buffer when needed.
+             *  \returns    false if this frame isn't cached with this resolution and
+             *              frame rate.
+             */
+            bool            fetch( qint64 frame, quint32 width, quint32 height, double fps,
+                                   Frame* output ) const;
+
+            QVector<Range>  ranges() const;
+            void            remove( qint64 begin, qint64 end );
+
+        private:
+            struct  Entry
+            {
+                Range           range;
+                /// The number of frames stored from the beginning of the range.
+                qint64          nbStored;
+                quint64         offset;
+            };
+
+            /// \warning    m_lock has to be held for all the methods below.
+            int             find( qint64 frame, quint32 width, quint32 height, double fps ) const;
+            void            removeEntry( int index );
+            bool            allocate( quint64 size, quint64& offset );
+            bool            resize( quint64 size );
+            void            writeIndex();
+            bool            readIndex();
+            static quint64  rangeSize( const Range& range );
+
+        private:
+            mutable QMutex      m_lock;
+            QFile               m_file;
+            uchar               *m_map;
+            /// By recording order, the oldest first.
+            QVector<Entry>      m_entries;
+            quint64             m_capacity;
+            /// The index of the entry being recorded, or -1
+            int                 m_recording;
+    };
+}
+
+#endif // RENDERCACHE_H
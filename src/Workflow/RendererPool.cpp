@@ -0,0 +1,166 @@
+/*****************************************************************************
+ * RendererPool.cpp: Keeps the renderers of the stopped clips around
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Workflow/RendererPool.h"
+
+#include "Backend/ISource.h"
+#include "Backend/ISourceRenderer.h"
+#include "Tools/VlmcDebug.h"
+
+using namespace Workflow;
+
+bool
+RendererPool::Key::operator==( const Key& key ) const
+{
+    return mrl == key.mrl && proxy == key.proxy && output == key.output && width == key.width &&
+            height == key.height && fps == key.fps && timeSync == key.timeSync;
+}
+
+RendererPool::RendererPool() :
+        m_capacity( 8 ),
+        m_hits( 0 ),
+        m_misses( 0 ),
+        m_evictions( 0 )
+{
+}
+
+RendererPool::~RendererPool()
+{
+    clear();
+}
+
+void
+RendererPool::setCapacity( int capacity )
+{
+    QList<Entry>    evicted;
+    {
+        QMutexLocker    lock( &m_lock );
+        m_capacity = qMax( capacity, 0 );
+        while ( m_idle.size() > m_capacity )
+        {
+            evicted.append( m_idle.takeLast() );
+            ++m_evictions;
+        }
+    }
+    foreach ( const Entry& entry, evicted )
+        destroy( entry.renderer );
+}
+
+Backend::ISourceRenderer*
+RendererPool::acquire( const Key& key, Backend::ISourceRendererEventCb* callback )
+{
+    Backend::ISourceRenderer*   renderer = NULL;
+    {
+        QMutexLocker    lock( &m_lock );
+        for ( QList<Entry>::iterator it = m_idle.begin(); it != m_idle.end(); ++it )
+        {
+            if ( (*it).key == key )
+            {
+                renderer = (*it).renderer;
+                m_idle.erase( it );
+                break ;
+            }
+        }
+        if ( renderer != NULL )
+            ++m_hits;
+        else
+            ++m_misses;
+    }
+    if ( renderer == NULL )
+        return key.source->createRenderer( callback );
+    renderer->setEventCallback( callback );
+    return renderer;
+}
+
+void
+RendererPool::release( const Key& key, Backend::ISourceRenderer* renderer )
+{
+    renderer->setEventCallback( NULL );
+    renderer->disableOutputToMemory();
+
+    Entry           entry;
+    entry.key = key;
+    entry.renderer = renderer;
+    QList<Entry>    evicted;
+    {
+        QMutexLocker    lock( &m_lock );
+        m_idle.prepend( entry );
+        while ( m_idle.size() > m_capacity )
+        {
+            evicted.append( m_idle.takeLast() );
+            ++m_evictions;
+        }
+    }
+    // Tearing a renderer down takes a while, don't block the other threads meanwhile.
+    foreach ( const Entry& e, evicted )
+        destroy( e.renderer );
+}
+
+void
+RendererPool::clear()
+{
+    QList<Entry>    idle;
+    {
+        QMutexLocker    lock( &m_lock );
+        idle.swap( m_idle );
+    }
+    foreach ( const Entry& entry, idle )
+        destroy( entry.renderer );
+}
+
+void
+RendererPool::destroy( Backend::ISourceRenderer* renderer )
+{
+    renderer->stop();
+    delete renderer;
+}
+
+quint64
+RendererPool::hits() const
+{
+    QMutexLocker    lock( &m_lock );
+    return m_hits;
+}
+
+quint64
+RendererPool::misses() const
+{
+    QMutexLocker    lock( &m_lock );
+    return m_misses;
+}
+
+double
+RendererPool::hitRate() const
+{
+    QMutexLocker    lock( &m_lock );
+    if ( m_hits + m_misses == 0 )
+        return 0.0;
+    return (double)m_hits / ( m_hits + m_misses );
+}
+
+void
+RendererPool::dumpStats() const
+{
+    QMutexLocker    lock( &m_lock );
+    vlmcDebug() << "Renderer pool:" << m_idle.size() << "idle renderers, capacity:" << m_capacity
+                << "hits:" << m_hits << "misses:" << m_misses << "evictions:" << m_evictions;
+}
@@ -0,0 +1,126 @@
+/*****************************************************************************
+ * RendererPool.h: Keeps the renderers of the stopped clips around
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef RENDERERPOOL_H
+#define RENDERERPOOL_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+namespace   Backend
+{
+    class   ISource;
+    class   ISourceRenderer;
+    class   ISourceRendererEventCb;
+}
+
+namespace   Workflow
+{
+    /**
+     *  \brief  Keeps the renderers of the stopped ClipWorkflows warm, paused.
+     *
+     *  Creating a renderer means opening the media and setting up a whole
+     *  decoding chain, which is expensive when scrubbing back and forth across
+     *  a cut. A released renderer is kept as it is, and handed to the next
+     *  ClipWorkflow which needs the same media with the same output, which only
+     *  has to retarget it and seek to its own beginning.
+     *  The least recently released renderers are destroyed past the capacity.
+     */
+    class   RendererPool
+    {
+        public:
+            /**
+             *  The renderers are interchangeable if all of this is the same.
+             */
+            struct  Key
+            {
+                Key() : source( NULL ), proxy( false ), width( 0 ), height( 0 ), fps( 0.0 ), timeSync( false ) {}
+                bool        operator==( const Key& key ) const;
+
+                /// Only used to create a renderer, the mrl identifies the source.
+                Backend::ISource*   source;
+                QString     mrl;
+                /// The source is the proxy of the clip's media.
+                bool        proxy;
+                /// Identifies which stream output chain the renderer was set up with.
+                QByteArray  output;
+                quint32     width;
+                quint32     height;
+                double      fps;
+                bool        timeSync;
+            };
+
+            RendererPool();
+            ~RendererPool();
+
+            /**
+             *  \brief  Set how many idle renderers may be kept. 0 disables the pool.
+             */
+            void                        setCapacity( int capacity );
+            /**
+             *  \returns    An idle renderer matching this key, or a new one. The
+             *              renderer sends its events to callback.
+             *
+             *  A warm renderer is paused: calling start() resumes it.
+             */
+            Backend::ISourceRenderer    *acquire( const Key& key, Backend::ISourceRendererEventCb* callback );
+            /**
+             *  \brief  Give a renderer back to the pool.
+             *
+             *  The renderer must be playing or paused, and a pause must have been
+             *  requested if it was playing. Its events and output are disconnected
+             *  first, which waits for the output callbacks in progress.
+             */
+            void                        release( const Key& key, Backend::ISourceRenderer* renderer );
+            /**
+             *  \brief  Destroy every idle renderer.
+             */
+            void                        clear();
+
+            quint64                     hits() const;
+            quint64                     misses() const;
+            /// \returns    The ratio of the acquisitions which reused a renderer.
+            double                      hitRate() const;
+            void                        dumpStats() const;
+
+        private:
+            struct  Entry
+            {
+                Key                         key;
+                Backend::ISourceRenderer*   renderer;
+            };
+            static void                 destroy( Backend::ISourceRenderer* renderer );
+
+        private:
+            mutable QMutex              m_lock;
+            /// The most recently released first.
+            QList<Entry>                m_idle;
+            int                         m_capacity;
+            quint64                     m_hits;
+            quint64                     m_misses;
+            quint64                     m_evictions;
+    };
+}
+
+#endif // RENDERERPOOL_H
@@ -0,0 +1,139 @@
+/*****************************************************************************
+ * ScrubCache.cpp: Keeps the recently composited frames for scrubbing
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Workflow/ScrubCache.h"
+
+#include "Tools/VlmcDebug.h"
+#include "Workflow/Types.h"
+
+using namespace Workflow;
+
+ScrubCache::ScrubCache() :
+        m_generation( 0 ),
+        m_size( 0 ),
+        m_capacity( 0 ),
+        m_hits( 0 ),
+        m_misses( 0 )
+{
+}
+
+ScrubCache::~ScrubCache()
+{
+    foreach ( const Entry& entry, m_frames )
+        delete entry.frame;
+}
+
+void
+ScrubCache::setCapacity( quint64 capacity )
+{
+    QMutexLocker    lock( &m_lock );
+    m_capacity = capacity;
+}
+
+const Frame*
+ScrubCache::find( qint64 frame, quint32 generation )
+{
+    QMutexLocker    lock( &m_lock );
+    purge( generation );
+    QHash<qint64, Entry>::iterator  it = m_frames.find( frame );
+    if ( it == m_frames.end() )
+    {
+        ++m_misses;
+        return NULL;
+    }
+    ++m_hits;
+    m_lru.erase( it.value().lruPos );
+    m_lru.prepend( frame );
+    it.value().lruPos = m_lru.begin();
+    return it.value().frame;
+}
+
+void
+ScrubCache::insert( qint64 frame, quint32 generation, const Frame *output )
+{
+    QMutexLocker    lock( &m_lock );
+    purge( generation );
+    if ( output->size() > m_capacity || m_frames.contains( frame ) == true )
+        return ;
+    m_lru.prepend( frame );
+    Entry   entry;
+    entry.frame = new Frame( *output );
+    entry.lruPos = m_lru.begin();
+    m_frames.insert( frame, entry );
+    m_size += output->size();
+    evict();
+}
+
+void
+ScrubCache::trim( quint32 generation )
+{
+    QMutexLocker    lock( &m_lock );
+    purge( generation );
+    evict();
+}
+
+void
+ScrubCache::purge( quint32 generation )
+{
+    if ( generation == m_generation )
+        return ;
+    foreach ( const Entry& entry, m_frames )
+        delete entry.frame;
+    m_frames.clear();
+    m_lru.clear();
+    m_size = 0;
+    m_generation = generation;
+}
+
+void
+ScrubCache::evict()
+{
+    //The most recent frame may still be in use.
+    while ( m_size > m_capacity && m_lru.size() > 1 )
+    {
+        Frame*  frame = m_frames.take( m_lru.takeLast() ).frame;
+        m_size -= frame->size();
+        delete frame;
+    }
+}
+
+quint64
+ScrubCache::hits() const
+{
+    QMutexLocker    lock( &m_lock );
+    return m_hits;
+}
+
+quint64
+ScrubCache::misses() const
+{
+    QMutexLocker    lock( &m_lock );
+    return m_misses;
+}
+
+void
+ScrubCache::dumpStats() const
+{
+    QMutexLocker    lock( &m_lock );
+    vlmcDebug() << "Scrub cache:" << m_frames.size() << "frames," << m_size / 1024 << "KB of"
+                << m_capacity / 1024 << "KB, hits:" << m_hits << "misses:" << m_misses;
+}
@@ -0,0 +1,99 @@
+/*****************************************************************************
+ * ScrubCache.h: Keeps the recently composited frames for scrubbing
+ *****************************************************************************
+ * Copyright (C) 2008-2014 VideoLAN
+ *
+ * Authors: VLMC developers <vlmc-devel@videolan.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef SCRUBCACHE_H
+#define SCRUBCACHE_H
+
+#include <QHash>
+#include <QLinkedList>
+#include <QMutex>
+
+namespace   Workflow
+{
+    class   Frame;
+
+    /**
+     *  \brief  Keeps the composited frames, so scrubbing back over them doesn't
+     *          restart the decoders.
+     *
+     *  The frames are shallow copies of the rendered ones: the decoders and the
+     *  compositor won't write into a buffer we still reference.
+     *  Each frame is only valid for the edit generation it was rendered in. The
+     *  frames of a previous generation are dropped by the next lookup, from the
+     *  render thread, as a frame returned by find() is in use until then.
+     *  The least recently used frames are dropped past the capacity.
+     */
+    class   ScrubCache
+    {
+        public:
+            ScrubCache();
+            ~ScrubCache();
+
+            /**
+             *  \brief  Set how many bytes the cached frames may use. 0 disables the cache.
+             */
+            void            setCapacity( quint64 capacity );
+            /**
+             *  \returns    The frame rendered for this timeline frame during this
+             *              generation, or NULL.
+             *  \warning    The frame is only valid until the next call to find() or insert().
+             */
+            const Frame     *find( qint64 frame, quint32 generation );
+            void            insert( qint64 frame, quint32 generation, const Frame* output );
+            /**
+             *  \brief  Drop the frames of the other generations.
+             *
+             *  \warning    No frame returned by find() may be in use.
+             */
+            void            trim( quint32 generation );
+
+            quint64         hits() const;
+            quint64         misses() const;
+            void            dumpStats() const;
+
+        private:
+            /// \warning    m_lock has to be held.
+            void            purge( quint32 generation );
+            void            evict();
+
+        private:
+            typedef QLinkedList<qint64>     LruList;
+            struct  Entry
+            {
+                Frame*              frame;
+                /// Where this frame is in m_lru, so a hit doesn't have to look for it.
+                LruList::iterator   lruPos;
+            };
+
+            mutable QMutex          m_lock;
+            QHash<qint64, Entry>    m_frames;
+            /// The most recently used first.
+            LruList                 m_lru;
+            quint32                 m_generation;
+            quint64                 m_size;
+            quint64                 m_capacity;
+            quint64                 m_hits;
+            quint64                 m_misses;
+    };
+}
+
+#endif // SCRUBCACHE_H
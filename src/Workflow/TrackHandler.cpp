@@ -22,29 +22,112 @@
 
 #include "TrackHandler.h"
 #include "TrackWorkflow.h"
+#include "Tools/mdate.h"
+#include "Tools/VlmcDebug.h"
+#include "Workflow/AudioMixer.h"
+#include "Workflow/Compositor.h"
 #include "Workflow/Types.h"
 
+#include <QCryptographicHash>
 #include <QDomDocument>
 #include <QDomElement>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 
-TrackHandler::TrackHandler( unsigned int nbTracks, Workflow::TrackType trackType ) :
+/**
+ *  Renders one track for the current frame, and stores the result and the time
+ *  it took in the TrackHandler's arrays.
+ */
+class   TrackHandler::RenderTask : public QRunnable
+{
+    public:
+        RenderTask( TrackWorkflow* track, Workflow::OutputBuffer** output,
+                    qint64* duration, QSemaphore* done ) :
+            m_track( track ),
+            m_output( output ),
+            m_duration( duration ),
+            m_done( done ),
+            m_currentFrame( 0 ),
+            m_subFrame( 0 ),
+            m_paused( false )
+        {
+            // The tasks are reused for every frame.
+            setAutoDelete( false );
+        }
+
+        void    prepare( qint64 currentFrame, qint64 subFrame, bool paused )
+        {
+            m_currentFrame = currentFrame;
+            m_subFrame = subFrame;
+            m_paused = paused;
+        }
+
+        virtual void    run()
+        {
+            qint64  begin = mdate();
+            *m_output = m_track->getOutput( m_currentFrame, m_subFrame, m_paused );
+            *m_duration = mdate() - begin;
+            m_done->release();
+        }
+
+    private:
+        TrackWorkflow*              m_track;
+        Workflow::OutputBuffer**    m_output;
+        qint64*                     m_duration;
+        QSemaphore*                 m_done;
+        qint64                      m_currentFrame;
+        qint64                      m_subFrame;
+        bool                        m_paused;
+};
+
+TrackHandler::TrackHandler( MainWorkflow* workflow, unsigned int nbTracks, Workflow::TrackType trackType ) :
         m_trackCount( nbTracks ),
         m_trackType( trackType ),
-        m_length( 0 )
+        m_length( 0 ),
+        m_frameDuration( 0 ),
+        m_outputComplete( true ),
+        m_compositor( NULL ),
+        m_audioMixer( NULL )
 {
     m_tracks = new Toggleable<TrackWorkflow*>[nbTracks];
+    m_renderTasks = new RenderTask*[nbTracks];
+    m_outputs = new Workflow::OutputBuffer*[nbTracks];
+    m_renderDurations = new qint64[nbTracks];
+    m_renderDone = new QSemaphore;
+    m_renderPool = new QThreadPool( this );
+    // Most of the time is spent waiting for the decoders, not computing.
+    m_renderPool->setMaxThreadCount( nbTracks );
+    if ( trackType == Workflow::VideoTrack )
+        m_compositor = new Workflow::Compositor;
+    else
+        m_audioMixer = new Workflow::AudioMixer( nbTracks );
     for ( unsigned int i = 0; i < nbTracks; ++i )
     {
-        m_tracks[i].setPtr( new TrackWorkflow( trackType, i ) );
+        m_tracks[i].setPtr( new TrackWorkflow( workflow, trackType, i ) );
         connect( m_tracks[i], SIGNAL( lengthChanged( qint64 ) ),
                  this, SLOT( lengthUpdated(qint64) ) );
+        m_renderTasks[i] = new RenderTask( m_tracks[i], &m_outputs[i],
+                                           &m_renderDurations[i], m_renderDone );
+        m_outputs[i] = NULL;
+        m_renderDurations[i] = -1;
     }
 }
 
 TrackHandler::~TrackHandler()
 {
+    m_renderPool->waitForDone();
     for (unsigned int i = 0; i < m_trackCount; ++i)
+    {
+        delete m_renderTasks[i];
         delete m_tracks[i];
+    }
+    delete m_compositor;
+    delete m_audioMixer;
+    delete m_renderDone;
+    delete[] m_renderDurations;
+    delete[] m_outputs;
+    delete[] m_renderTasks;
     delete[] m_tracks;
 }
 
@@ -52,6 +135,7 @@ void
 TrackHandler::startRender( quint32 width, quint32 height, double fps )
 {
     m_endReached = false;
+    m_frameDuration = 1000000 / fps;
     if ( m_length == 0 )
         m_endReached = true;
     else
@@ -72,22 +156,68 @@ TrackHandler::getLength() const
 Workflow::OutputBuffer*
 TrackHandler::getOutput( qint64 currentFrame, qint64 subFrame, bool paused )
 {
-    bool        validTrack = false;
+    RenderTask* inlineTask = NULL;
+    int         nbDispatched = 0;
 
     for ( int i = m_trackCount - 1; i >= 0; --i )
     {
+        m_outputs[i] = NULL;
+        m_renderDurations[i] = -1;
         if ( m_tracks[i].activated() == false || m_tracks[i]->hasNoMoreFrameToRender( currentFrame ) )
             continue ;
-        validTrack = true;
-        Workflow::OutputBuffer  *ret = m_tracks[i]->getOutput( currentFrame, subFrame, paused );
-        if ( ret == NULL )
-            continue ;
+        m_renderTasks[i]->prepare( currentFrame, subFrame, paused );
+        // Keep the first track for ourselves, there's no point in waiting idle.
+        if ( inlineTask == NULL )
+            inlineTask = m_renderTasks[i];
         else
-            return ret;
+        {
+            m_renderPool->start( m_renderTasks[i] );
+            ++nbDispatched;
+        }
     }
-    if ( validTrack == false )
+    if ( inlineTask == NULL )
+    {
         allTracksEnded();
-    return NULL;
+        return NULL;
+    }
+    inlineTask->run();
+    m_renderDone->acquire( nbDispatched + 1 );
+
+    int         slowest = -1;
+    m_outputComplete = true;
+    for ( int i = m_trackCount - 1; i >= 0; --i )
+    {
+        if ( slowest < 0 || m_renderDurations[i] > m_renderDurations[slowest] )
+            slowest = i;
+        if ( m_renderDurations[i] >= 0 && m_tracks[i]->isOutputComplete() == false )
+            m_outputComplete = false;
+    }
+    if ( m_frameDuration > 0 && m_renderDurations[slowest] > m_frameDuration )
+        vlmcDebug() << "Frame" << currentFrame << "was held by track" << slowest
+                    << "for" << m_renderDurations[slowest] << "us";
+
+    if ( m_trackType == Workflow::VideoTrack )
+    {
+        m_compositor->begin();
+        for ( int i = m_trackCount - 1; i >= 0; --i )
+        {
+            // Stop as soon as a track hides everything below it.
+            if ( m_outputs[i] != NULL &&
+                 m_compositor->addLayer( static_cast<Workflow::Frame*>( m_outputs[i] ),
+                                         m_tracks[i]->opacity() ) == false )
+                break ;
+        }
+        return m_compositor->composite();
+    }
+    m_audioMixer->begin();
+    for ( int i = m_trackCount - 1; i >= 0; --i )
+    {
+        // A muted track may still have a few samples waiting, don't let them through.
+        m_audioMixer->addTrack( i, static_cast<Workflow::AudioSample*>( m_outputs[i] ),
+                                m_tracks[i].activated() == true ? m_tracks[i]->gain() : 0.0,
+                                m_tracks[i]->pan() );
+    }
+    return m_audioMixer->mix();
 }
 
 qint64
@@ -103,6 +233,8 @@ TrackHandler::stop()
 {
     for (unsigned int i = 0; i < m_trackCount; ++i)
         m_tracks[i]->stop();
+    if ( m_audioMixer != NULL )
+        m_audioMixer->reset();
 }
 
 void
@@ -164,6 +296,12 @@ TrackHandler::save( QXmlStreamWriter& project ) const
             project.writeStartElement( "track" );
             project.writeAttribute( "type", QString::number( (int)m_trackType ) );
             project.writeAttribute( "id", QString::number( i ) );
+            if ( m_tracks[i]->opacity() != 1.0 )
+                project.writeAttribute( "opacity", QString::number( m_tracks[i]->opacity() ) );
+            if ( m_tracks[i]->gain() != 1.0 )
+                project.writeAttribute( "gain", QString::number( m_tracks[i]->gain() ) );
+            if ( m_tracks[i]->pan() != 0.0 )
+                project.writeAttribute( "pan", QString::number( m_tracks[i]->pan() ) );
             m_tracks[i]->save( project );
             m_tracks[i]->saveFilters( project );
             project.writeEndElement();
@@ -171,6 +309,16 @@ TrackHandler::save( QXmlStreamWriter& project ) const
     }
 }
 
+void
+TrackHandler::hashRange( QCryptographicHash& hash, qint64 begin, qint64 end ) const
+{
+    for ( unsigned int i = 0; i < m_trackCount; ++i )
+    {
+        if ( m_tracks[i].activated() == true )
+            m_tracks[i]->hashRange( hash, begin, end );
+    }
+}
+
 void
 TrackHandler::renderOneFrame()
 {
@@ -238,3 +386,30 @@ TrackHandler::track( quint32 trackId )
 {
     return m_tracks[trackId];
 }
+
+qint64
+TrackHandler::renderDuration( quint32 trackId ) const
+{
+    Q_ASSERT( trackId < m_trackCount );
+
+    return m_renderDurations[trackId];
+}
+
+bool
+TrackHandler::isOutputComplete() const
+{
+    return m_outputComplete;
+}
+
+bool
+TrackHandler::preroll( qint64 frame, quint32 nbFrames, QList<ClipWorkflow*>& pending )
+{
+    bool    ready = true;
+    for ( unsigned int i = 0; i < m_trackCount; ++i )
+    {
+        if ( m_tracks[i].activated() == true &&
+             m_tracks[i]->preroll( frame, nbFrames, pending ) == false )
+            ready = false;
+    }
+    return ready;
+}
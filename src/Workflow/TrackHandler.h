@@ -29,13 +29,23 @@
 #include "MainWorkflow.h"
 
 class   ClipHelper;
+class   ClipWorkflow;
 class   TrackWorkflow;
+namespace   Workflow
+{
+    class   AudioMixer;
+    class   Compositor;
+}
+
+class   QCryptographicHash;
+class   QSemaphore;
+class   QThreadPool;
 
 class   TrackHandler : public QObject
 {
     Q_OBJECT
     public:
-        TrackHandler( unsigned int nbTracks, Workflow::TrackType trackType );
+        TrackHandler( MainWorkflow* workflow, unsigned int nbTracks, Workflow::TrackType trackType );
         ~TrackHandler();
 
         /**
@@ -45,6 +55,12 @@ class   TrackHandler : public QObject
         qint64                  getLength() const;
         void                    startRender( quint32 width, quint32 height, double fps );
         /**
+         *  \brief      Render the current frame of every active track.
+         *
+         *  All tracks are rendered concurrently, as each of them may have to wait
+         *  for its clips to be decoded. This returns once every track is done.
+         *  Video tracks are then blended together, the highest track being on top,
+         *  and audio tracks are mixed down.
          *  \param      currentFrame    The current rendering frame (ie the video frame, in all case)
          *  \param      subFrame        The type-dependent frame. IE, for a video track,
          *                              it's the same as currentFrame, but for an audio
@@ -63,6 +79,10 @@ class   TrackHandler : public QObject
         bool                    endIsReached() const;
 
         void                    save( QXmlStreamWriter& project ) const;
+        /**
+         *  \brief  Add what the enabled tracks render between begin and end to a hash.
+         */
+        void                    hashRange( QCryptographicHash& hash, qint64 begin, qint64 end ) const;
 
         /**
          *  \brief      Will configure the track workflow so they render only one frame
@@ -91,7 +111,28 @@ class   TrackHandler : public QObject
 
         TrackWorkflow           *track( quint32 trackId );
 
+        /**
+         *  \brief  Returns the time spent rendering the given track for the last
+         *          frame, in microseconds, or -1 if it wasn't rendered.
+         */
+        qint64                  renderDuration( quint32 trackId ) const;
+        /**
+         *  \returns    false if a clip which should have been rendered for the last
+         *              frame wasn't ready.
+         */
+        bool                    isOutputComplete() const;
+        /**
+         *  \brief  Start the clips active at frame on the enabled tracks, and look
+         *          for the ones which didn't compute nbFrames frames yet.
+         *
+         *  \sa     TrackWorkflow::preroll()
+         */
+        bool                    preroll( qint64 frame, quint32 nbFrames,
+                                         QList<ClipWorkflow*>& pending );
+
     private:
+        class   RenderTask;
+
         void                    allTracksEnded();
 
     private:
@@ -101,6 +142,18 @@ class   TrackHandler : public QObject
         qint64                          m_length;
         unsigned int                    m_highestTrackNumber;
         bool                            m_endReached;
+        /// The tracks are rendered on this pool, one thread per track at most.
+        QThreadPool*                    m_renderPool;
+        RenderTask**                    m_renderTasks;
+        QSemaphore*                     m_renderDone;
+        Workflow::OutputBuffer**        m_outputs;
+        qint64*                         m_renderDurations;
+        qint64                          m_frameDuration;
+        bool                            m_outputComplete;
+        /// Only used by video tracks
+        Workflow::Compositor*           m_compositor;
+        /// Only used by audio tracks
+        Workflow::AudioMixer*           m_audioMixer;
 
     private slots:
         void                            lengthUpdated( qint64 newLength );
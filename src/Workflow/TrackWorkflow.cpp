@@ -25,10 +25,13 @@
 
 #include "Project/Project.h"
 #include "Media/Clip.h"
+#include "Settings/Settings.h"
 #include "ClipHelper.h"
 #include "AudioClipWorkflow.h"
 #include "EffectsEngine/EffectInstance.h"
 #include "EffectsEngine/EffectHelper.h"
+#include "FrameBudget.h"
+#include "FramePool.h"
 #include "ImageClipWorkflow.h"
 #include "Backend/ISource.h"
 #include "MainWorkflow.h"
@@ -36,22 +39,45 @@
 #include "Types.h"
 #include "VideoClipWorkflow.h"
 #include "vlmc.h"
+#include "Tools/mdate.h"
 #include "Tools/VlmcDebug.h"
 
+#include <QCryptographicHash>
 #include <QDomDocument>
 #include <QDomElement>
 #include <QMutex>
 #include <QReadWriteLock>
+#include <QSet>
 
-TrackWorkflow::TrackWorkflow( Workflow::TrackType type, quint32 trackId  ) :
+const unsigned int  TrackWorkflow::DefaultPreloadWindow;
+const qint64        TrackWorkflow::MaxPreloadDuration;
+
+/// How much media may be skipped to keep a renderer running, in microseconds.
+static const qint64     MaxHandOffGap = 1000000;
+/// How long a full speed render waits for its clips to start, in milliseconds.
+static const qint64     FullSpeedStartTimeout = 10000;
+/// A clip may be done starting right before we wait for it, so we check again this often.
+static const unsigned long  ClipStartPollDelay = 20;
+
+TrackWorkflow::TrackWorkflow( MainWorkflow* workflow, Workflow::TrackType type, quint32 trackId  ) :
         m_length( 0 ),
+        m_workflow( workflow ),
         m_trackType( type ),
         m_lastFrame( 0 ),
-        m_trackId( trackId )
+        m_fps( 30.0 ),
+        m_preloadMargin( 0 ),
+        m_maxPreloadWindow( DefaultPreloadWindow ),
+        m_fullSpeedRender( false ),
+        m_outputComplete( true ),
+        m_trackId( trackId ),
+        m_opacity( 1.0 ),
+        m_gain( 1.0 ),
+        m_pan( 0.0 )
 {
     m_renderOneFrameMutex = new QMutex;
     m_clipsLock = new QReadWriteLock;
     m_mixerBuffer = new Workflow::Frame;
+    m_clipIndexDirty.fetchAndStoreRelaxed( 1 );
 
     connect( this, SIGNAL( effectAdded( EffectHelper*, qint64 ) ),
              this, SLOT( __effectAdded( EffectHelper*, qint64) ) );
@@ -72,6 +98,8 @@ TrackWorkflow::~TrackWorkflow()
         delete it.value();
         it = m_clips.erase( it );
     }
+    m_clipsByUuid.clear();
+    delete m_mixerBuffer;
     delete m_clipsLock;
     delete m_renderOneFrameMutex;
 }
@@ -83,12 +111,12 @@ TrackWorkflow::addClip( ClipHelper* ch, qint64 start )
     if ( m_trackType == Workflow::VideoTrack )
     {
         if ( ch->clip()->getMedia()->fileType() == Media::Video )
-            cw = new VideoClipWorkflow( ch );
+            cw = new VideoClipWorkflow( ch, m_workflow );
         else
-            cw = new ImageClipWorkflow( ch );
+            cw = new ImageClipWorkflow( ch, m_workflow );
     }
     else
-        cw = new AudioClipWorkflow( ch );
+        cw = new AudioClipWorkflow( ch, m_workflow );
     ch->setClipWorkflow( cw );
     addClip( cw, start );
 }
@@ -97,7 +125,7 @@ void
 TrackWorkflow::addClip( ClipWorkflow* cw, qint64 start )
 {
     QWriteLocker    lock( m_clipsLock );
-    m_clips.insert( start, cw );
+    insertClip( start, cw );
     connect( cw, SIGNAL( effectAdded( EffectHelper*, qint64 ) ),
              this, SLOT( __effectAdded( EffectHelper*, qint64 ) ) );
     connect( cw, SIGNAL( effectMoved( EffectHelper*, qint64 ) ),
@@ -109,10 +137,32 @@ TrackWorkflow::addClip( ClipWorkflow* cw, qint64 start )
              this, SLOT( clipWorkflowFailure( ClipWorkflow* ) ), Qt::QueuedConnection );
     connect( cw->getClipHelper(), SIGNAL( destroyed( QUuid ) ),
              this, SLOT( clipDestroyed( QUuid ) ) );
+    connect( cw->getClipHelper(), SIGNAL( lengthUpdated() ),
+             this, SLOT( clipLengthUpdated() ) );
+    m_clipIndexDirty.fetchAndStoreRelaxed( 1 );
     emit clipAdded( this, cw->getClipHelper(), start );
     computeLength();
 }
 
+//Must be called from a thread safe method (m_clipsLock locked)
+void
+TrackWorkflow::insertClip( qint64 start, ClipWorkflow *cw )
+{
+    //Inserting at an already used position replaces the previous clip.
+    QMap<qint64, ClipWorkflow*>::iterator   it = m_clips.find( start );
+    if ( it != m_clips.end() )
+        m_clipsByUuid.remove( it.value()->getClipHelper()->uuid() );
+    m_clipsByUuid.insert( cw->getClipHelper()->uuid(), m_clips.insert( start, cw ) );
+}
+
+//Must be called from a thread safe method (m_clipsLock locked)
+void
+TrackWorkflow::eraseClip( QMap<qint64, ClipWorkflow*>::iterator it )
+{
+    m_clipsByUuid.remove( it.value()->getClipHelper()->uuid() );
+    m_clips.erase( it );
+}
+
 //Must be called from a thread safe method (m_clipsLock locked)
 void
 TrackWorkflow::computeLength()
@@ -145,31 +195,19 @@ TrackWorkflow::getLength() const
 qint64
 TrackWorkflow::getClipPosition( const QUuid& uuid ) const
 {
-    QMap<qint64, ClipWorkflow*>::const_iterator     it = m_clips.begin();
-    QMap<qint64, ClipWorkflow*>::const_iterator     end = m_clips.end();
-
-    while ( it != end )
-    {
-        if ( it.value()->getClipHelper()->uuid() == uuid )
-            return it.key();
-        ++it;
-    }
-    return -1;
+    ClipsByUuid::const_iterator     it = m_clipsByUuid.find( uuid );
+    if ( it == m_clipsByUuid.end() )
+        return -1;
+    return it.value().key();
 }
 
 ClipHelper*
 TrackWorkflow::getClipHelper( const QUuid& uuid )
 {
-    QMap<qint64, ClipWorkflow*>::const_iterator     it = m_clips.begin();
-    QMap<qint64, ClipWorkflow*>::const_iterator     end = m_clips.end();
-
-    while ( it != end )
-    {
-        if ( it.value()->getClipHelper()->uuid() == uuid )
-            return it.value()->getClipHelper();
-        ++it;
-    }
-    return NULL;
+    ClipsByUuid::const_iterator     it = m_clipsByUuid.find( uuid );
+    if ( it == m_clipsByUuid.end() )
+        return NULL;
+    return it.value().value()->getClipHelper();
 }
 
 Workflow::OutputBuffer*
@@ -184,29 +222,23 @@ TrackWorkflow::renderClip( ClipWorkflow* cw, qint64 currentFrame,
                                          ClipWorkflow::Pop : ClipWorkflow::Get );
 
     ClipWorkflow::State state = cw->getState();
-    if ( state == ClipWorkflow::Rendering ||
-         state == ClipWorkflow::Paused ||
-         state == ClipWorkflow::PauseRequired ||
-         state == ClipWorkflow::UnpauseRequired )
+    if ( state == ClipWorkflow::Rendering )
     {
-        if ( cw->isResyncRequired() == true || needRepositioning == true )
+        //The playhead kept moving while the clip was starting.
+        //We check for a difference greater than one to avoid false positive when starting.
+        const qint64    initialPosition = cw->takeInitialPosition();
+        const bool      late = ( initialPosition >= 0 &&
+                                 qAbs( currentFrame - start - initialPosition ) > 1 );
+        if ( cw->isResyncRequired() == true || needRepositioning == true || late == true )
             adjustClipTime( currentFrame, start, cw );
         return cw->getOutput( mode, currentFrame - start );
     }
     else if ( state == ClipWorkflow::Stopped || state == ClipWorkflow::Initializing )
     {
+        //The clip starts in the background, at the current position. Until it's
+        //ready, this track renders nothing, which shows black or the tracks below.
         if ( state == ClipWorkflow::Stopped )
-            cw->initialize();
-        //If the init failed, don't even try to call getOutput.
-        if ( cw->waitForCompleteInit() == false )
-            return NULL;
-        //We check for a difference greater than one to avoid false positive when starting.
-        if ( (  qAbs(start - currentFrame) > 1 ) || cw->getClipHelper()->begin() != 0 )
-        {
-            //Clip was not started at its real begining: adjust the position
-            adjustClipTime( currentFrame, start, cw );
-        }
-        return cw->getOutput( mode, currentFrame - start );
+            cw->initialize( currentFrame - start );
     }
     else if ( state == ClipWorkflow::EndReached ||
               state == ClipWorkflow::Error )
@@ -221,6 +253,24 @@ TrackWorkflow::renderClip( ClipWorkflow* cw, qint64 currentFrame,
     return NULL;
 }
 
+bool
+TrackWorkflow::startActiveClips( qint64 currentFrame )
+{
+    bool    started = true;
+    foreach ( const Workflow::ClipIndex::Entry& entry, m_activeClips )
+    {
+        ClipWorkflow*               cw = entry.clipWorkflow;
+        const ClipWorkflow::State   state = cw->getState();
+        if ( cw->isMuted() == true )
+            continue ;
+        if ( state == ClipWorkflow::Stopped )
+            cw->initialize( currentFrame - entry.start );
+        if ( state == ClipWorkflow::Stopped || state == ClipWorkflow::Initializing )
+            started = false;
+    }
+    return started;
+}
+
 void
 TrackWorkflow::preloadClip( ClipWorkflow* cw )
 {
@@ -228,6 +278,72 @@ TrackWorkflow::preloadClip( ClipWorkflow* cw )
         cw->initialize();
 }
 
+qint64
+TrackWorkflow::preloadWindow( ClipWorkflow* cw ) const
+{
+    //The frames go by faster than the startup latency accounts for.
+    if ( m_fullSpeedRender == true )
+        return m_maxPreloadWindow;
+    ClipHelper*     helper = cw->getClipHelper();
+    Media*          media = helper->clip()->getMedia();
+    qint64          latency = media->startupLatency();
+    if ( latency < 0 )
+        return DefaultPreloadWindow;
+    //A clip which doesn't start at the beginning of its media also has to seek.
+    if ( helper->begin() != 0 )
+        latency += qMax<qint64>( media->seekLatency(), 0 );
+    const qint64    window = ( latency + m_preloadMargin ) * m_fps / 1000000 + 1;
+    return qMin( window, m_maxPreloadWindow );
+}
+
+bool
+TrackWorkflow::shouldPreload( ClipWorkflow* cw, qint64 distance ) const
+{
+    //Once started, a clip keeps running until it's over.
+    if ( cw->getState() != ClipWorkflow::Stopped )
+        return true;
+    if ( distance >= preloadWindow( cw ) )
+        return false;
+    //Preloading further than usual is only done if the frames fit in memory.
+    if ( distance < DefaultPreloadWindow || m_trackType != Workflow::VideoTrack )
+        return true;
+    return m_workflow->frameBudget()->tryReserve(
+                Workflow::FrameBudget::PreloadQueueDepth *
+                Workflow::Frame::Size( m_width, m_height, Workflow::I420 ) );
+}
+
+int
+TrackWorkflow::handOffSource( const Workflow::ClipIndex::Entry& next, qint64& skipDuration ) const
+{
+    ClipWorkflow*   cw = next.clipWorkflow;
+    Media*          media = cw->clip()->getMedia();
+    if ( cw->isMuted() == true ||
+         ( media->fileType() != Media::Video && media->fileType() != Media::Audio ) )
+        return -1;
+    for ( int i = 0; i < m_activeClips.size(); ++i )
+    {
+        const Workflow::ClipIndex::Entry&   entry = m_activeClips[i];
+        ClipWorkflow*                       previous = entry.clipWorkflow;
+        if ( entry.end != next.start || previous == cw || previous->isMuted() == true ||
+             previous->clip()->getMedia() != media ||
+             previous->metaObject() != cw->metaObject() )
+            continue ;
+        const ClipWorkflow::State   state = previous->getState();
+        if ( state != ClipWorkflow::Rendering )
+            continue ;
+        const qint64    gap = cw->getClipHelper()->begin() - previous->getClipHelper()->end();
+        if ( gap < 0 )
+            continue ;
+        skipDuration = (qint64)( gap * 1000000 / media->source()->fps() );
+        //While previewing, the media is decoded at the playback pace, so skipping
+        //anything would stall the track.
+        if ( skipDuration > ( m_fullSpeedRender == true ? MaxHandOffGap : 0 ) )
+            continue ;
+        return i;
+    }
+    return -1;
+}
+
 void
 TrackWorkflow::stopClipWorkflow( ClipWorkflow* cw )
 {
@@ -254,6 +370,12 @@ TrackWorkflow::hasNoMoreFrameToRender( qint64 currentFrame ) const
     return ( cw->getClipHelper()->length() + it.key() < currentFrame );
 }
 
+bool
+TrackWorkflow::isOutputComplete() const
+{
+    return m_outputComplete;
+}
+
 void
 TrackWorkflow::stop()
 {
@@ -274,8 +396,6 @@ TrackWorkflow::getOutput( qint64 currentFrame, qint64 subFrame, bool paused )
 {
     QReadLocker     lock( m_clipsLock );
 
-    QMap<qint64, ClipWorkflow*>::iterator       it = m_clips.begin();
-    QMap<qint64, ClipWorkflow*>::iterator       end = m_clips.end();
     bool                                        needRepositioning;
     Workflow::OutputBuffer                      *ret = NULL;
     Workflow::Frame                             *frames[EffectsEngine::MaxFramesForMixer];
@@ -305,29 +425,108 @@ TrackWorkflow::getOutput( qint64 currentFrame, qint64 subFrame, bool paused )
             needRepositioning = ( abs( subFrame - m_lastFrame ) > 1 ) ? true : false;
     }
     memset( frames, 0, sizeof(*frames) * EffectsEngine::MaxFramesForMixer );
-    while ( it != end )
+    const qint64    startDeadline = mdate() + FullSpeedStartTimeout * 1000;
+    while ( true )
     {
-        qint64          start = it.key();
-        ClipWorkflow*   cw = it.value();
-        //Is the clip supposed to render now?
-        if ( start <= currentFrame && currentFrame <= start + cw->getClipHelper()->length() )
+        if ( m_clipIndexDirty.fetchAndStoreAcquire( 0 ) != 0 )
+            m_clipIndex.rebuild( m_clips );
+        m_clipIndex.active( currentFrame, m_activeClips );
+        m_clipIndex.starting( currentFrame, currentFrame + m_maxPreloadWindow, m_preloadingClips );
+        qint64  skipDuration;
+        //A clip continuing the media of the previous one takes its renderer over,
+        //instead of starting and seeking its own.
+        for ( int i = 0; i < m_activeClips.size(); ++i )
         {
-            ret = renderClip( cw, currentFrame, start, needRepositioning,
-                              renderOneFrame, paused );
-            if ( m_trackType == Workflow::VideoTrack )
-            {
-                frames[frameId] = static_cast<Workflow::Frame*>( ret );
-                ++frameId;
-            }
+            ClipWorkflow*   cw = m_activeClips[i].clipWorkflow;
+            if ( cw->getState() != ClipWorkflow::Stopped )
+                continue ;
+            const int       source = handOffSource( m_activeClips[i], skipDuration );
+            if ( source < 0 || m_activeClips[source].clipWorkflow->handOff( cw, skipDuration ) == false )
+                continue ;
+            vlmcDebug() << "Track" << m_trackId << "handed the renderer of clip"
+                        << m_activeClips[source].clipWorkflow->getClipHelper()->uuid() << "over to clip"
+                        << cw->getClipHelper()->uuid() << "skipping" << skipDuration / 1000 << "ms";
+            //The previous clip is over, and stopped already.
+            m_activeClips.remove( source );
+            if ( source < i )
+                --i;
         }
-        //Is it about to be rendered?
-        else if ( start > currentFrame &&
-                start - currentFrame < TrackWorkflow::nbFrameBeforePreload )
-            preloadClip( cw );
-        //Is it supposed to be stopped?
-        else
-            stopClipWorkflow( cw );
-        ++it;
+        int     nbPreloading = 0;
+        for ( int i = 0; i < m_preloadingClips.size(); ++i )
+        {
+            const Workflow::ClipIndex::Entry&   entry = m_preloadingClips[i];
+            //It will be handed the renderer of the clip being rendered.
+            if ( entry.clipWorkflow->getState() == ClipWorkflow::Stopped &&
+                 handOffSource( entry, skipDuration ) >= 0 )
+                continue ;
+            if ( shouldPreload( entry.clipWorkflow, entry.start - currentFrame ) == true )
+                m_preloadingClips[nbPreloading++] = entry;
+        }
+        m_preloadingClips.resize( nbPreloading );
+
+        //Only the clips we started earlier may have to be stopped.
+        QSet<ClipWorkflow*>     running;
+        foreach ( const Workflow::ClipIndex::Entry& entry, m_activeClips )
+            running.insert( entry.clipWorkflow );
+        foreach ( const Workflow::ClipIndex::Entry& entry, m_preloadingClips )
+            running.insert( entry.clipWorkflow );
+        foreach ( ClipWorkflow* cw, m_runningClips )
+        {
+            if ( running.contains( cw ) == false )
+                stopClipWorkflow( cw );
+        }
+        m_runningClips = running;
+
+        //An export can't skip frames. The clips are started ahead by the preload, but
+        //one may still be starting, which we wait for without holding on to the clips.
+        if ( m_fullSpeedRender == false || startActiveClips( currentFrame ) == true )
+            break ;
+        const qint64    remaining = ( startDeadline - mdate() ) / 1000;
+        if ( remaining <= 0 )
+        {
+            vlmcWarning() << "Track" << m_trackId << "renders frame" << currentFrame
+                          << "without the clips which didn't start in time";
+            break ;
+        }
+        //The clips may be edited meanwhile, so everything gets looked up again.
+        m_workflow->waitForClipStart( m_clipsLock, qMin<qint64>( remaining, ClipStartPollDelay ) );
+    }
+
+    m_outputComplete = true;
+    foreach ( const Workflow::ClipIndex::Entry& entry, m_activeClips )
+    {
+        ClipWorkflow*   cw = entry.clipWorkflow;
+        cw->setPlayheadDistance( 0 );
+        //Report how early the clip was ready when the playhead reaches it.
+        const bool      isCut = ( currentFrame == entry.start && paused == false &&
+                                  cw->isMuted() == false );
+        const qint64    cutDate = isCut == true ? mdate() : 0;
+        ret = renderClip( cw, currentFrame, entry.start, needRepositioning,
+                          renderOneFrame, paused );
+        if ( ret == NULL && cw->isMuted() == false )
+            m_outputComplete = false;
+        if ( isCut == true )
+        {
+            //Negative when the first frame only came while we were waiting for it.
+            const qint64    readyDate = cw->readyDate();
+            if ( readyDate != 0 )
+                vlmcDebug() << "Track" << m_trackId << "cut to clip" << cw->getClipHelper()->uuid()
+                            << "ready margin:" << ( cutDate - readyDate ) / 1000 << "ms, target:"
+                            << m_preloadMargin / 1000 << "ms";
+            else
+                vlmcDebug() << "Track" << m_trackId << "cut to clip" << cw->getClipHelper()->uuid()
+                            << "which isn't ready yet, target margin:" << m_preloadMargin / 1000 << "ms";
+        }
+        if ( m_trackType == Workflow::VideoTrack && frameId < EffectsEngine::MaxFramesForMixer )
+        {
+            frames[frameId] = static_cast<Workflow::Frame*>( ret );
+            ++frameId;
+        }
+    }
+    foreach ( const Workflow::ClipIndex::Entry& entry, m_preloadingClips )
+    {
+        entry.clipWorkflow->setPlayheadDistance( entry.start - currentFrame );
+        preloadClip( entry.clipWorkflow );
     }
     //Handle mixers:
     if ( m_trackType == Workflow::VideoTrack )
@@ -335,10 +534,15 @@ TrackWorkflow::getOutput( qint64 currentFrame, qint64 subFrame, bool paused )
         EffectHelper*   mixer = getMixer( currentFrame );
         if ( mixer != NULL && frames[0] != NULL ) //There's no point using the mixer if there's no frame rendered.
         {
+            //The previous mix may still be referenced downstream.
+            if ( m_mixerBuffer->isShared() == true )
+                m_mixerBuffer->setBuffer( Workflow::FramePool::getInstance()->get( m_mixerBuffer->size() ) );
+            else //Drop the conversions of the previous mix.
+                m_mixerBuffer->setLayout( m_mixerBuffer->size() );
             //FIXME: We don't handle mixer3 yet.
             mixer->effectInstance()->process( currentFrame * 1000.0 / m_fps,
-                                    frames[0]->buffer(),
-                                    frames[1] != NULL ? frames[1]->buffer() : Project::getInstance()->workflow()->blackOutput()->buffer(),
+                                    frames[0]->rgbaBuffer(),
+                                    frames[1] != NULL ? frames[1]->rgbaBuffer() : m_workflow->blackOutput()->buffer(),
                                     NULL, m_mixerBuffer->buffer() );
             m_mixerBuffer->ptsDiff = frames[0]->ptsDiff;
             ret = m_mixerBuffer;
@@ -346,7 +550,7 @@ TrackWorkflow::getOutput( qint64 currentFrame, qint64 subFrame, bool paused )
         else //If there's no mixer, just use the first frame, ignore the rest. It will be cleaned by the responsible ClipWorkflow.
             ret = frames[0];
         //Now handle filters :
-        quint32     *newFrame = applyFilters( ret != NULL ? static_cast<const Workflow::Frame*>( ret ) : Project::getInstance()->workflow()->blackOutput(),
+        quint32     *newFrame = applyFilters( ret != NULL ? static_cast<const Workflow::Frame*>( ret ) : m_workflow->blackOutput(),
                                                 currentFrame, currentFrame * 1000.0 / m_fps );
         if ( newFrame != NULL )
         {
@@ -368,23 +572,16 @@ TrackWorkflow::moveClip( const QUuid& id, qint64 startingFrame )
 {
     QWriteLocker    lock( m_clipsLock );
 
-    QMap<qint64, ClipWorkflow*>::iterator       it = m_clips.begin();
-    QMap<qint64, ClipWorkflow*>::iterator       end = m_clips.end();
-
-    while ( it != end )
-    {
-        if ( it.value()->getClipHelper()->uuid() == id )
-        {
-            ClipWorkflow* cw = it.value();
-            m_clips.erase( it );
-            m_clips[startingFrame] = cw;
-            cw->requireResync();
-            computeLength();
-            emit clipMoved( this, cw->getClipHelper()->uuid(), startingFrame );
-            return ;
-        }
-        ++it;
-    }
+    ClipsByUuid::iterator       it = m_clipsByUuid.find( id );
+    if ( it == m_clipsByUuid.end() )
+        return ;
+    ClipWorkflow* cw = it.value().value();
+    eraseClip( it.value() );
+    insertClip( startingFrame, cw );
+    m_clipIndexDirty.fetchAndStoreRelaxed( 1 );
+    cw->requireResync();
+    computeLength();
+    emit clipMoved( this, cw->getClipHelper()->uuid(), startingFrame );
 }
 
 void
@@ -392,25 +589,26 @@ TrackWorkflow::clipDestroyed( const QUuid& id )
 {
     QWriteLocker    lock( m_clipsLock );
 
-    QMap<qint64, ClipWorkflow*>::iterator       it = m_clips.begin();
-    QMap<qint64, ClipWorkflow*>::iterator       end = m_clips.end();
+    ClipsByUuid::iterator       it = m_clipsByUuid.find( id );
+    if ( it == m_clipsByUuid.end() )
+        return ;
+    ClipWorkflow*   cw = it.value().value();
+    eraseClip( it.value() );
+    m_runningClips.remove( cw );
+    m_clipIndexDirty.fetchAndStoreRelaxed( 1 );
+    stopClipWorkflow( cw );
+    computeLength();
+    cw->disconnect();
+    cw->getClipHelper()->disconnect( this );
+    emit clipRemoved( this, id );
+    cw->deleteLater();
+}
 
-    while ( it != end )
-    {
-        if ( it.value()->getClipHelper()->uuid() == id )
-        {
-            ClipWorkflow*   cw = it.value();
-            m_clips.erase( it );
-            stopClipWorkflow( cw );
-            computeLength();
-            cw->disconnect();
-            cw->getClipHelper()->disconnect( this );
-            emit clipRemoved( this, id );
-            cw->deleteLater();
-            return ;
-        }
-        ++it;
-    }
+void
+TrackWorkflow::clipLengthUpdated()
+{
+    // The index will be rebuilt before the next frame.
+    m_clipIndexDirty.fetchAndStoreRelaxed( 1 );
 }
 
 void TrackWorkflow::clipWorkflowFailure(ClipWorkflow *cw)
@@ -423,27 +621,21 @@ TrackWorkflow::removeClip( const QUuid& id )
 {
     QWriteLocker    lock( m_clipsLock );
 
-    QMap<qint64, ClipWorkflow*>::iterator       it = m_clips.begin();
-    QMap<qint64, ClipWorkflow*>::iterator       end = m_clips.end();
-
-    while ( it != end )
-    {
-        if ( it.value()->getClipHelper()->uuid() == id )
-        {
-            ClipWorkflow*   cw = it.value();
-            Clip*           clip = cw->clip();
-            m_clips.erase( it );
-            stopClipWorkflow( cw );
-            computeLength();
-            cw->disconnect();
-            cw->getClipHelper()->disconnect( this );
-            emit clipRemoved( this, cw->getClipHelper()->uuid() );
-            cw->deleteLater();
-            return clip;
-        }
-        ++it;
-    }
-    return NULL;
+    ClipsByUuid::iterator       it = m_clipsByUuid.find( id );
+    if ( it == m_clipsByUuid.end() )
+        return NULL;
+    ClipWorkflow*   cw = it.value().value();
+    Clip*           clip = cw->clip();
+    eraseClip( it.value() );
+    m_runningClips.remove( cw );
+    m_clipIndexDirty.fetchAndStoreRelaxed( 1 );
+    stopClipWorkflow( cw );
+    computeLength();
+    cw->disconnect();
+    cw->getClipHelper()->disconnect( this );
+    emit clipRemoved( this, cw->getClipHelper()->uuid() );
+    cw->deleteLater();
+    return clip;
 }
 
 ClipWorkflow*
@@ -451,24 +643,18 @@ TrackWorkflow::removeClipWorkflow( const QUuid& id )
 {
     QWriteLocker    lock( m_clipsLock );
 
-    QMap<qint64, ClipWorkflow*>::iterator       it = m_clips.begin();
-    QMap<qint64, ClipWorkflow*>::iterator       end = m_clips.end();
-
-    while ( it != end )
-    {
-        if ( it.value()->getClipHelper()->uuid() == id )
-        {
-            ClipWorkflow*   cw = it.value();
-            cw->disconnect();
-            m_clips.erase( it );
-            computeLength();
-            cw->getClipHelper()->disconnect( this );
-            emit clipRemoved( this, cw->getClipHelper()->uuid() );
-            return cw;
-        }
-        ++it;
-    }
-    return NULL;
+    ClipsByUuid::iterator       it = m_clipsByUuid.find( id );
+    if ( it == m_clipsByUuid.end() )
+        return NULL;
+    ClipWorkflow*   cw = it.value().value();
+    cw->disconnect();
+    eraseClip( it.value() );
+    m_runningClips.remove( cw );
+    m_clipIndexDirty.fetchAndStoreRelaxed( 1 );
+    computeLength();
+    cw->getClipHelper()->disconnect( this );
+    emit clipRemoved( this, cw->getClipHelper()->uuid() );
+    return cw;
 }
 
 void
@@ -490,6 +676,31 @@ TrackWorkflow::save( QXmlStreamWriter& project ) const
     project.writeEndElement();
 }
 
+void
+TrackWorkflow::hashRange( QCryptographicHash& hash, qint64 begin, qint64 end ) const
+{
+    QReadLocker     lock( m_clipsLock );
+
+    bool            empty = true;
+    QMap<qint64, ClipWorkflow*>::const_iterator     it = m_clips.begin();
+    QMap<qint64, ClipWorkflow*>::const_iterator     ite = m_clips.end();
+    for ( ; it != ite && it.key() <= end; ++it )
+    {
+        ClipWorkflow*   cw = it.value();
+        ClipHelper*     ch = cw->getClipHelper();
+        if ( it.key() + ch->length() < begin )
+            continue ;
+        hash.addData( QString( "clip %1 %2 %3 %4 %5" ).arg( it.key() ).arg( ch->clip()->fullId() )
+                      .arg( ch->begin() ).arg( ch->end() ).arg( cw->isMuted() ).toUtf8() );
+        cw->hashEffects( hash );
+        empty = false;
+    }
+    if ( empty == true )
+        return ;
+    hash.addData( QString( "track %1 %2" ).arg( m_trackId ).arg( m_opacity ).toUtf8() );
+    hashEffects( hash );
+}
+
 void
 TrackWorkflow::clear()
 {
@@ -504,6 +715,9 @@ TrackWorkflow::clear()
         delete cw;
     }
     m_clips.clear();
+    m_clipsByUuid.clear();
+    m_runningClips.clear();
+    m_clipIndexDirty.fetchAndStoreRelaxed( 1 );
     m_length = 0;
 }
 
@@ -527,6 +741,7 @@ TrackWorkflow::renderOneFrame()
 void
 TrackWorkflow::setFullSpeedRender( bool val )
 {
+    m_fullSpeedRender = val;
     foreach ( ClipWorkflow* cw, m_clips.values() )
     {
         cw->setFullSpeedRender( val );
@@ -538,17 +753,11 @@ TrackWorkflow::muteClip( const QUuid &uuid )
 {
     QWriteLocker    lock( m_clipsLock );
 
-    QMap<qint64, ClipWorkflow*>::iterator       it = m_clips.begin();
-    QMap<qint64, ClipWorkflow*>::iterator       end = m_clips.end();
-
-    while ( it != end )
+    ClipsByUuid::iterator       it = m_clipsByUuid.find( uuid );
+    if ( it != m_clipsByUuid.end() )
     {
-        if ( it.value()->getClipHelper()->uuid() == uuid )
-        {
-            it.value()->mute();
-            return ;
-        }
-        ++it;
+        it.value().value()->mute();
+        return ;
     }
     vlmcWarning() << "Failed to mute clip" << uuid << "it probably doesn't exist "
             "in this track";
@@ -559,17 +768,11 @@ TrackWorkflow::unmuteClip( const QUuid &uuid )
 {
     QWriteLocker    lock( m_clipsLock );
 
-    QMap<qint64, ClipWorkflow*>::iterator       it = m_clips.begin();
-    QMap<qint64, ClipWorkflow*>::iterator       end = m_clips.end();
-
-    while ( it != end )
+    ClipsByUuid::iterator       it = m_clipsByUuid.find( uuid );
+    if ( it != m_clipsByUuid.end() )
     {
-        if ( it.value()->getClipHelper()->uuid() == uuid )
-        {
-            it.value()->unmute();
-            return ;
-        }
-        ++it;
+        it.value().value()->unmute();
+        return ;
     }
     vlmcWarning() << "Failed to unmute clip" << uuid << "it probably doesn't exist "
             "in this track";
@@ -584,6 +787,8 @@ TrackWorkflow::initRender( quint32 width, quint32 height, double fps )
     m_fps = fps;
     m_width = width;
     m_height = height;
+    m_preloadMargin = (qint64)VLMC_PROJECT_GET_UINT( "video/PreloadMargin" ) * 1000;
+    m_maxPreloadWindow = qMax<qint64>( MaxPreloadDuration * fps / 1000000, DefaultPreloadWindow );
     m_isRendering = true;
     QMap<qint64, ClipWorkflow*>::iterator       it = m_clips.begin();
     QMap<qint64, ClipWorkflow*>::iterator       end = m_clips.end();
@@ -591,8 +796,11 @@ TrackWorkflow::initRender( quint32 width, quint32 height, double fps )
     {
         qint64          start = it.key();
         ClipWorkflow*   cw = it.value();
-        if ( start < TrackWorkflow::nbFrameBeforePreload )
+        if ( start < preloadWindow( cw ) )
+        {
             preloadClip( cw );
+            m_runningClips.insert( cw );
+        }
         ++it;
     }
     initFilters();
@@ -636,6 +844,31 @@ TrackWorkflow::stopFrameComputing()
     }
 }
 
+bool
+TrackWorkflow::preroll( qint64 frame, quint32 nbFrames, QList<ClipWorkflow*>& pending )
+{
+    QReadLocker     lock( m_clipsLock );
+    bool            ready = true;
+
+    QMap<qint64, ClipWorkflow*>::const_iterator     it = m_clips.begin();
+    QMap<qint64, ClipWorkflow*>::const_iterator     end = m_clips.end();
+    for ( ; it != end && it.key() <= frame; ++it )
+    {
+        ClipWorkflow*   cw = it.value();
+        if ( it.key() + cw->getClipHelper()->length() < frame || cw->isMuted() == true )
+            continue ;
+        //Started where the render will ask for it, so that it isn't repositioned.
+        if ( cw->getState() == ClipWorkflow::Stopped )
+            cw->initialize( frame - it.key() );
+        if ( cw->isPrerolled( nbFrames ) == false )
+        {
+            pending.append( cw );
+            ready = false;
+        }
+    }
+    return ready;
+}
+
 quint32
 TrackWorkflow::trackId() const
 {
@@ -701,3 +934,39 @@ TrackWorkflow::effectType() const
 {
     return TrackEffectUser;
 }
+
+void
+TrackWorkflow::setOpacity( double opacity )
+{
+    m_opacity = qBound( 0.0, opacity, 1.0 );
+}
+
+double
+TrackWorkflow::opacity() const
+{
+    return m_opacity;
+}
+
+void
+TrackWorkflow::setGain( double gain )
+{
+    m_gain = qMax( 0.0, gain );
+}
+
+double
+TrackWorkflow::gain() const
+{
+    return m_gain;
+}
+
+void
+TrackWorkflow::setPan( double pan )
+{
+    m_pan = qBound( -1.0, pan, 1.0 );
+}
+
+double
+TrackWorkflow::pan() const
+{
+    return m_pan;
+}
@@ -24,15 +24,21 @@
 #define TRACKWORKFLOW_H
 
 #include "EffectsEngine/EffectUser.h"
+#include "Workflow/ClipIndex.h"
 #include "Types.h"
 
+#include <QAtomicInt>
+#include <QHash>
 #include <QObject>
 #include <QMap>
+#include <QSet>
+#include <QUuid>
 #include <QXmlStreamWriter>
 
 class   Clip;
 class   ClipHelper;
 class   ClipWorkflow;
+class   MainWorkflow;
 namespace   Workflow
 {
     class   Helper;
@@ -42,6 +48,7 @@ class   QDomElement;
 class   QDomElement;
 template <typename T>
 class   QList;
+class   QCryptographicHash;
 class   QMutex;
 class   QReadWriteLock;
 class   QWaitCondition;
@@ -51,7 +58,7 @@ class   TrackWorkflow : public EffectUser
     Q_OBJECT
 
     public:
-        TrackWorkflow( Workflow::TrackType type, quint32 trackId );
+        TrackWorkflow( MainWorkflow* workflow, Workflow::TrackType type, quint32 trackId );
         ~TrackWorkflow();
 
         Workflow::OutputBuffer                  *getOutput( qint64 currentFrame,
@@ -66,10 +73,19 @@ class   TrackWorkflow : public EffectUser
         qint64                                  getClipPosition( const QUuid& uuid ) const;
         ClipHelper                              *getClipHelper( const QUuid& uuid );
 
-        //FIXME: this won't be reliable as soon as we change the fps from the configuration
-        static const unsigned int               nbFrameBeforePreload = 60;
+        /// How many frames ahead a clip is preloaded when its media latency is unknown.
+        static const unsigned int               DefaultPreloadWindow = 60;
+        /// A clip is never preloaded more than this ahead, in microseconds.
+        static const qint64                     MaxPreloadDuration = 10000000;
 
         void                                    save( QXmlStreamWriter& project ) const;
+        /**
+         *  \brief  Add what this track renders between begin and end to a hash.
+         *
+         *  Nothing is added if no clip overlaps this range.
+         */
+        void                                    hashRange( QCryptographicHash& hash,
+                                                           qint64 begin, qint64 end ) const;
         void                                    clear();
 
         void                                    renderOneFrame();
@@ -95,6 +111,20 @@ class   TrackWorkflow : public EffectUser
 
         void                                    stopFrameComputing();
         bool                                    hasNoMoreFrameToRender( qint64 currentFrame ) const;
+        /**
+         *  \returns    false if a clip which should have been rendered for the last
+         *              frame wasn't ready.
+         */
+        bool                                    isOutputComplete() const;
+        /**
+         *  \brief  Start the clips active at frame, and look for the ones which didn't
+         *          compute nbFrames frames yet.
+         *
+         *  \param  pending     The clips which aren't ready are appended to it.
+         *  \returns    true if every clip active at frame is ready.
+         */
+        bool                                    preroll( qint64 frame, quint32 nbFrames,
+                                                         QList<ClipWorkflow*>& pending );
         quint32                                 trackId() const;
         Workflow::TrackType                     type() const;
         //FIXME: this is not thread safe if the list gets modified (but it can't be const, as it is intended to be modified...)
@@ -102,19 +132,80 @@ class   TrackWorkflow : public EffectUser
         EffectsEngine::EffectList               *mixers();
         virtual qint64                          length() const;
         virtual Type                            effectType() const;
+        /**
+         *  \brief  Set how much of the tracks below shows through this one.
+         *
+         *  \param  opacity     From 0 (invisible) to 1 (opaque, the default).
+         */
+        void                                    setOpacity( double opacity );
+        double                                  opacity() const;
+        /**
+         *  \brief  Set the linear gain applied to an audio track. Defaults to 1.
+         */
+        void                                    setGain( double gain );
+        double                                  gain() const;
+        /**
+         *  \brief  Set the stereo balance of an audio track.
+         *
+         *  \param  pan     From -1 (left) to 1 (right). Defaults to 0.
+         */
+        void                                    setPan( double pan );
+        double                                  pan() const;
 
     private:
+        typedef QHash<QUuid, QMap<qint64, ClipWorkflow*>::iterator>     ClipsByUuid;
+
+        void                                    insertClip( qint64 start, ClipWorkflow* cw );
+        void                                    eraseClip( QMap<qint64, ClipWorkflow*>::iterator it );
         void                                    computeLength();
         Workflow::OutputBuffer                  *renderClip( ClipWorkflow* cw, qint64 currentFrame,
                                                             qint64 start, bool needRepositioning,
                                                             bool renderOneFrame, bool paused );
+        /**
+         *  \brief  Start the active clips which aren't running yet.
+         *  \returns    true if all the active clips are done starting.
+         */
+        bool                                    startActiveClips( qint64 currentFrame );
         void                                    preloadClip( ClipWorkflow* cw );
+        /**
+         *  \returns    How many frames before its beginning a clip has to be
+         *              preloaded for it to be ready with the configured margin.
+         */
+        qint64                                  preloadWindow( ClipWorkflow* cw ) const;
+        /**
+         *  \brief  Tell whether an upcoming clip should be running by now.
+         */
+        bool                                    shouldPreload( ClipWorkflow* cw, qint64 distance ) const;
+        /**
+         *  \brief  Look for an active clip which can hand its renderer over to the next one.
+         *
+         *  This is a clip ending where the next one starts, which renders the same
+         *  media, up to where the next one begins or shortly before.
+         *  \param  skipDuration    Set to the duration of the media between both clips,
+         *                          in microseconds.
+         *  \returns    The index of that clip in m_activeClips, or -1.
+         */
+        int                                     handOffSource( const Workflow::ClipIndex::Entry& next,
+                                                               qint64& skipDuration ) const;
         void                                    stopClipWorkflow( ClipWorkflow* cw );
         void                                    adjustClipTime( qint64 currentFrame, qint64 start, ClipWorkflow* cw );
 
 
     private:
         QMap<qint64, ClipWorkflow*>             m_clips;
+        /**
+         *  Maps each ClipHelper uuid to its position in m_clips.
+         *  m_clips must not be copied, as detaching it would invalidate these iterators.
+         */
+        ClipsByUuid                             m_clipsByUuid;
+        /// Rebuilt from m_clips by the render thread when it's flagged as dirty.
+        Workflow::ClipIndex                     m_clipIndex;
+        QAtomicInt                              m_clipIndexDirty;
+        /// Kept around to avoid reallocating them for every frame.
+        QVector<Workflow::ClipIndex::Entry>     m_activeClips;
+        QVector<Workflow::ClipIndex::Entry>     m_preloadingClips;
+        /// The clips which were rendering or preloading at the previous frame.
+        QSet<ClipWorkflow*>                     m_runningClips;
 
         /**
          *  \brief      The track length in frames.
@@ -126,17 +217,27 @@ class   TrackWorkflow : public EffectUser
 
         QReadWriteLock*                         m_clipsLock;
 
+        MainWorkflow*                           m_workflow;
         const Workflow::TrackType               m_trackType;
         qint64                                  m_lastFrame;
         Workflow::Frame                         *m_mixerBuffer;
         double                                  m_fps;
+        /// How long before its beginning a clip should be ready, in microseconds.
+        qint64                                  m_preloadMargin;
+        qint64                                  m_maxPreloadWindow;
+        bool                                    m_fullSpeedRender;
+        bool                                    m_outputComplete;
         const quint32                           m_trackId;
+        double                                  m_opacity;
+        double                                  m_gain;
+        double                                  m_pan;
 
     private slots:
         void                __effectAdded( EffectHelper*, qint64 );
         void                __effectRemoved( const QUuid& );
         void                __effectMoved( EffectHelper*, qint64 );
         void                clipDestroyed( const QUuid &uuid );
+        void                clipLengthUpdated();
         void                clipWorkflowFailure( ClipWorkflow* cw );
 
     signals:
@@ -21,6 +21,8 @@
  *****************************************************************************/
 
 #include "Workflow/Types.h"
+#include "Workflow/FramePool.h"
+#include "Workflow/PixelConverter.h"
 
 using namespace Workflow;
 
@@ -31,38 +33,56 @@ Frame::Frame() :
         ptsDiff( 0 ),
         m_width( 0 ),
         m_height( 0 ),
+        m_chroma( RV32 ),
         m_buffer( 0 ),
         m_size( 0 ),
-        m_nbPixels( 0 )
+        m_nbPixels( 0 ),
+        m_pitch( 0 ),
+        m_nbLines( 0 ),
+        m_rgbaBuffer( NULL ),
+        m_yuvBuffer( NULL ),
+        m_opaque( -1 )
 {
 }
 
-Frame::Frame( quint32 width, quint32 height ) :
+Frame::Frame( quint32 width, quint32 height, Chroma chroma ) :
         OutputBuffer( VideoTrack ),
         ptsDiff( 0 ),
         m_width( width ),
-        m_height( height )
+        m_height( height ),
+        m_chroma( chroma ),
+        m_rgbaBuffer( NULL ),
+        m_yuvBuffer( NULL ),
+        m_opaque( -1 )
 {
     m_nbPixels = width * height;
-    m_size = m_nbPixels * Depth;
-    m_buffer = new quint32[m_nbPixels];
+    setPackedLayout();
+    m_buffer = FramePool::getInstance()->get( m_size );
 }
 
-Frame::Frame(quint32 width, quint32 height, size_t forcedSize) :
+Frame::Frame( const Frame& other ) :
     OutputBuffer( VideoTrack ),
-    ptsDiff( 0 ),
-    m_width( width ),
-    m_height( height )
+    ptsDiff( other.ptsDiff ),
+    m_width( other.m_width ),
+    m_height( other.m_height ),
+    m_chroma( other.m_chroma ),
+    m_buffer( other.m_buffer ),
+    m_size( other.m_size ),
+    m_nbPixels( other.m_nbPixels ),
+    m_pitch( other.m_pitch ),
+    m_nbLines( other.m_nbLines ),
+    m_rgbaBuffer( NULL ),
+    m_yuvBuffer( NULL ),
+    m_opaque( other.m_opaque )
 {
-    m_nbPixels = width * height;
-    m_size = forcedSize;
-    Q_ASSERT(forcedSize % 4 == 0);
-    m_buffer = new quint32[forcedSize / 4];
+    if ( m_buffer != NULL )
+        FramePool::getInstance()->ref( m_buffer );
 }
 
 Frame::~Frame()
 {
-    delete[] m_buffer;
+    dropConvertedBuffers();
+    FramePool::getInstance()->release( m_buffer );
 }
 
 quint32*
@@ -76,6 +96,160 @@ const quint32 *Frame::buffer() const
     return m_buffer;
 }
 
+const quint32*
+Frame::rgbaBuffer() const
+{
+    if ( m_buffer == NULL || ( m_chroma == RV32 && isPacked() == true ) )
+        return m_buffer;
+    if ( m_rgbaBuffer == NULL )
+    {
+        const quint32   lineSize = m_width * Depth;
+        m_rgbaBuffer = FramePool::getInstance()->get( Size( m_width, m_height, RV32 ) );
+        if ( m_chroma == RV32 )
+        {
+            const quint8*   src = plane( 0 );
+            quint8*         dst = reinterpret_cast<quint8*>( m_rgbaBuffer );
+            for ( quint32 i = 0; i < m_height; ++i )
+            {
+                memcpy( dst, src, lineSize );
+                src += m_pitch;
+                dst += lineSize;
+            }
+        }
+        else
+        {
+            PixelConverter::I420ToRV32( plane( 0 ), pitch( 0 ), plane( 1 ), plane( 2 ), pitch( 1 ),
+                                        m_rgbaBuffer, lineSize, m_width, m_height );
+        }
+    }
+    return m_rgbaBuffer;
+}
+
+const quint8*
+Frame::yuvBuffer() const
+{
+    if ( m_buffer == NULL || ( m_chroma == I420 && isPacked() == true ) )
+        return reinterpret_cast<const quint8*>( m_buffer );
+    if ( m_yuvBuffer == NULL )
+    {
+        const quint32   chromaWidth = ( m_width + 1 ) / 2;
+        const quint32   chromaHeight = ( m_height + 1 ) / 2;
+        m_yuvBuffer = FramePool::getInstance()->get( Size( m_width, m_height, I420 ) );
+        quint8*         y = reinterpret_cast<quint8*>( m_yuvBuffer );
+        quint8*         u = y + m_width * m_height;
+        quint8*         v = u + chromaWidth * chromaHeight;
+        if ( m_chroma == I420 )
+        {
+            quint8*         dst[3] = { y, u, v };
+            for ( quint32 p = 0; p < 3; ++p )
+            {
+                const quint32   lineSize = p == 0 ? m_width : chromaWidth;
+                const quint32   nbLines = p == 0 ? m_height : chromaHeight;
+                const quint8*   src = plane( p );
+                for ( quint32 i = 0; i < nbLines; ++i )
+                {
+                    memcpy( dst[p], src, lineSize );
+                    src += pitch( p );
+                    dst[p] += lineSize;
+                }
+            }
+        }
+        else
+        {
+            PixelConverter::RV32ToI420( m_buffer, m_pitch, y, m_width, u, v, chromaWidth,
+                                        m_width, m_height );
+        }
+    }
+    return reinterpret_cast<const quint8*>( m_yuvBuffer );
+}
+
+bool
+Frame::isOpaque() const
+{
+    if ( m_chroma == I420 )
+        return true;
+    if ( m_buffer == NULL )
+        return false;
+    if ( m_opaque < 0 )
+        m_opaque = PixelConverter::IsOpaque( reinterpret_cast<const quint32*>( plane( 0 ) ),
+                                             pitch( 0 ), m_width, m_height ) == true ? 1 : 0;
+    return m_opaque == 1;
+}
+
+quint32
+Frame::nbPlanes() const
+{
+    return m_chroma == I420 ? 3 : 1;
+}
+
+quint8*
+Frame::plane( quint32 index )
+{
+    return const_cast<quint8*>( static_cast<const Frame*>( this )->plane( index ) );
+}
+
+const quint8*
+Frame::plane( quint32 index ) const
+{
+    Q_ASSERT( index < nbPlanes() );
+    const quint8*   base = reinterpret_cast<const quint8*>( m_buffer );
+    if ( index == 0 )
+        return base;
+    const size_t    lumaSize = (size_t)m_pitch * m_nbLines;
+    const size_t    chromaSize = (size_t)pitch( 1 ) * ( ( m_nbLines + 1 ) / 2 );
+    return base + lumaSize + ( index - 1 ) * chromaSize;
+}
+
+quint32
+Frame::pitch( quint32 index ) const
+{
+    if ( index == 0 )
+        return m_pitch;
+    return ( m_pitch + 1 ) / 2;
+}
+
+void
+Frame::setLayout( size_t size )
+{
+    dropConvertedBuffers();
+    m_size = size;
+    const quint32   lineSize = m_chroma == RV32 ? m_width * Depth : m_width;
+    if ( m_height != 0 && size > LayoutSize( m_chroma, lineSize, m_height ) )
+    {
+        // Different layouts may lead to the same size. Try the largest line
+        // alignment first, as it gives the tightest pitch.
+        static const quint32    lineAlignments[] = { 32, 16, 2, 1 };
+        for ( unsigned int i = 0; i < sizeof( lineAlignments ) / sizeof( lineAlignments[0] ); ++i )
+        {
+            const quint32   a = lineAlignments[i];
+            const quint32   nbLines = ( m_height + a - 1 ) / a * a;
+            // For I420, size is roughly pitch * nbLines * 3 / 2
+            const quint32   guess = m_chroma == RV32 ? size / nbLines : size * 2 / ( 3 * nbLines );
+            for ( quint32 pitch = guess > 0 ? guess - 1 : 0; pitch <= guess + 1; ++pitch )
+            {
+                if ( pitch < lineSize || ( m_chroma == RV32 && pitch % Depth != 0 ) )
+                    continue ;
+                if ( LayoutSize( m_chroma, pitch, nbLines ) == size )
+                {
+                    m_pitch = pitch;
+                    m_nbLines = nbLines;
+                    return ;
+                }
+            }
+        }
+    }
+    // No padding, or only at the end of the picture.
+    m_pitch = lineSize;
+    m_nbLines = m_height;
+}
+
+bool
+Frame::isPacked() const
+{
+    const quint32   lineSize = m_chroma == RV32 ? m_width * Depth : m_width;
+    return m_pitch == lineSize && m_nbLines == m_height;
+}
+
 quint32
 Frame::width() const
 {
@@ -88,6 +262,12 @@ Frame::height() const
     return m_height;
 }
 
+Chroma
+Frame::chroma() const
+{
+    return m_chroma;
+}
+
 size_t Frame::size() const
 {
     return m_size;
@@ -99,16 +279,46 @@ Frame::nbPixels() const
     return m_nbPixels;
 }
 
-size_t Frame::Size(quint32 width, quint32 height)
+size_t Frame::Size( quint32 width, quint32 height, Chroma chroma )
 {
-    return width * height * Depth;
+    if ( chroma == RV32 )
+        return LayoutSize( chroma, width * Depth, height );
+    return LayoutSize( chroma, width, height );
+}
+
+size_t
+Frame::LayoutSize( Chroma chroma, quint32 pitch, quint32 nbLines )
+{
+    const size_t    size = (size_t)pitch * nbLines;
+    if ( chroma == RV32 )
+        return size;
+    return size + 2 * (size_t)( ( pitch + 1 ) / 2 ) * ( ( nbLines + 1 ) / 2 );
+}
+
+void
+Frame::setPackedLayout()
+{
+    m_pitch = m_chroma == RV32 ? m_width * Depth : m_width;
+    m_nbLines = m_height;
+    m_size = Size( m_width, m_height, m_chroma );
 }
 
 void
 Frame::setBuffer( quint32 *buff )
 {
-    delete[] m_buffer;
+    dropConvertedBuffers();
+    FramePool::getInstance()->release( m_buffer );
     m_buffer = buff;
+    m_chroma = RV32;
+    setPackedLayout();
+}
+
+bool
+Frame::isShared() const
+{
+    if ( m_buffer == NULL )
+        return false;
+    return FramePool::getInstance()->isShared( m_buffer );
 }
 
 void
@@ -116,19 +326,36 @@ Frame::resize( quint32 width, quint32 height )
 {
     if ( width != m_width || height != m_height )
     {
-        delete[] m_buffer;
+        dropConvertedBuffers();
+        FramePool::getInstance()->release( m_buffer );
         m_width = width;
         m_height = height;
         m_nbPixels = width * height;
-        m_size = m_nbPixels * Depth;
-        m_buffer = new quint32[m_nbPixels];
+        setPackedLayout();
+        m_buffer = FramePool::getInstance()->get( m_size );
     }
 }
 
-void Frame::resize(size_t size)
+void
+Frame::reserve( size_t size, Chroma chroma )
 {
-    if ( size == m_size )
+    dropConvertedBuffers();
+    m_chroma = chroma;
+    m_size = size;
+    //Someone downstream may still hold the current buffer, don't overwrite it.
+    if ( m_buffer != NULL && isShared() == false &&
+         FramePool::getInstance()->bufferSize( m_buffer ) >= size )
         return ;
-    delete[] m_buffer;
-    m_buffer = new quint32[size / sizeof(quint32)];
+    FramePool::getInstance()->release( m_buffer );
+    m_buffer = FramePool::getInstance()->get( size );
+}
+
+void
+Frame::dropConvertedBuffers()
+{
+    FramePool::getInstance()->release( m_rgbaBuffer );
+    FramePool::getInstance()->release( m_yuvBuffer );
+    m_rgbaBuffer = NULL;
+    m_yuvBuffer = NULL;
+    m_opaque = -1;
 }
@@ -30,6 +30,15 @@ namespace   Workflow
     // This is constrained by frei0r
     const quint32   Depth = 4;
 
+    /**
+     *  \enum   Represents the video frames pixel formats.
+     */
+    enum    Chroma
+    {
+        I420, ///< Planar YUV 4:2:0. This is what we decode to, and give to imem.
+        RV32, ///< Packed 32 bits pixels, Depth bytes each. This is what frei0r works with.
+    };
+
     /**
      *  \enum   Represents the potential Track types.
      */
@@ -51,14 +60,74 @@ namespace   Workflow
     {
         public:
             explicit Frame();
-            Frame( quint32 width, quint32 height );
-            Frame( quint32 width, quint32 height, size_t forcedSize );
+            Frame( quint32 width, quint32 height, Chroma chroma = RV32 );
+            /**
+             *  \brief     Creates a frame sharing other's buffer.
+             *
+             *  No pixel is copied, the buffer's reference count is incremented instead.
+             */
+            Frame( const Frame& other );
             ~Frame();
             quint32         width() const;
             quint32         height() const;
+            Chroma          chroma() const;
             quint32         *buffer();
             const quint32   *buffer() const;
+            /**
+             *  \returns   The frame as packed RV32 pixels.
+             *
+             *  This is what frei0r filters and mixers expect. If the frame is already
+             *  packed RV32, this is buffer(). Otherwise, the frame is converted on the
+             *  first call, and the result kept until the frame content changes.
+             */
+            const quint32   *rgbaBuffer() const;
+            /**
+             *  \returns   The frame as packed I420 planes, as imem expects it.
+             *
+             *  Same as rgbaBuffer(), the conversion only happens when required.
+             */
+            const quint8    *yuvBuffer() const;
+            /**
+             *  \returns   true if every pixel is fully opaque, which I420 frames are.
+             *
+             *  Same as the conversions, this is only computed once per frame content.
+             */
+            bool            isOpaque() const;
+            quint32         nbPlanes() const;
+            quint8          *plane( quint32 index );
+            const quint8    *plane( quint32 index ) const;
+            /**
+             *  \returns   The number of bytes between the beginning of two lines.
+             */
+            quint32         pitch( quint32 index = 0 ) const;
+            /**
+             *  \brief     Guess how the current buffer content is laid out.
+             *
+             *  Decoders may pad the lines, and the number of lines, to their liking.
+             *  The padding is assumed to be at the end of the lines (with the chroma
+             *  planes pitches being half the luma one) and possibly at the end of each
+             *  plane, for line counts aligned on 2, 16 or 32.
+             *  \param     size    The number of bytes the decoder wrote.
+             */
+            void            setLayout( size_t size );
+            /**
+             *  \returns   true if there is no padding between the lines or the planes.
+             */
+            bool            isPacked() const;
+            /**
+             *  \brief     Replace the frame buffer.
+             *
+             *  The previous buffer is released to the FramePool, and the frame takes
+             *  ownership of the new one, which must come from the FramePool as well.
+             *  The new buffer is packed RV32, as this is what effects output.
+             */
             void            setBuffer( quint32 *buff );
+            /**
+             *  \returns   true if the buffer is referenced by another frame or stage.
+             *
+             *  A shared buffer must not be written into.
+             */
+            bool            isShared() const;
             /**
              *  \brief      Resize the buffer.
              *
@@ -66,16 +135,19 @@ namespace   Workflow
              */
             void            resize( quint32 width, quint32 height );
             /**
-              * \brief      Resize the buffer
+              * \brief      Prepare the frame to receive size bytes of chroma pixels.
               *
-              * This will allocate a new buffer and drop the old one.
+              * A new buffer is only allocated when the current one is too small, or
+              * still referenced elsewhere.
+              * Either way, the content is to be considered lost, and the layout
+              * must be set again once the buffer has been filled.
               * \param      size    The size, in bytes.
               */
-            void            resize( size_t size );
+            void            reserve( size_t size, Chroma chroma );
             /**
-             *  \returns    The frame size in octets
+             *  \returns    The frame size in octets, padding included.
              *
-             *  This is equal to width * height * Depth
+             *  This is equal to Size( width, height, chroma ) for a packed frame.
              */
             size_t          size() const;
             /**
@@ -94,17 +166,34 @@ namespace   Workflow
 
         public:
             /**
-             * @brief Size  Computes the size, in bytes, a frame with given dimension would use.
+             * @brief Size  Computes the size, in bytes, a packed frame with given
+             *              dimension and chroma would use.
              */
-            static size_t Size( quint32 width, quint32 height );
+            static size_t Size( quint32 width, quint32 height, Chroma chroma );
+
+        private:
+            Frame&      operator=( const Frame& );
+            void        setPackedLayout();
+            void        dropConvertedBuffers();
+            static size_t   LayoutSize( Chroma chroma, quint32 pitch, quint32 nbLines );
 
         private:
             quint32     m_width;
             quint32     m_height;
+            Chroma      m_chroma;
             // frei0r uses 32bits only pixels, and expects its buffers as uint32
+            // This buffer is borrowed from the FramePool
             quint32     *m_buffer;
             size_t      m_size;
             quint32     m_nbPixels;
+            // Luma (or RV32) plane layout. Chroma planes use half of it.
+            quint32     m_pitch;
+            quint32     m_nbLines;
+            // Lazily computed conversions of m_buffer
+            mutable quint32 *m_rgbaBuffer;
+            mutable quint32 *m_yuvBuffer;
+            /// -1 until isOpaque() scans the frame content.
+            mutable int     m_opaque;
     };
     class  AudioSample : public OutputBuffer
     {
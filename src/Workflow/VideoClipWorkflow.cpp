@@ -36,45 +36,71 @@
 #include <QMutexLocker>
 #include <QReadWriteLock>
 #include <QStringBuilder>
-#include <QWaitCondition>
 
-VideoClipWorkflow::VideoClipWorkflow( ClipHelper *ch ) :
-        ClipWorkflow( ch ),
-        m_lastReturnedBuffer( NULL )
+/// How long the decoder waits for some room before checking if it's still needed, in ms.
+static const unsigned long  RoomWaitDelay = 100;
+
+VideoClipWorkflow::VideoClipWorkflow( ClipHelper *ch, MainWorkflow* workflow ) :
+        ClipWorkflow( ch, workflow ),
+        m_computedBuffers( nbBuffers ),
+        m_availableBuffers( nbBuffers ),
+        m_decodingBuffer( NULL ),
+        m_lastReturnedBuffer( NULL ),
+        m_frameDuration( 0 )
 {
     m_effectsLock = new QReadWriteLock();
+    m_maxQueueDepth = nbBuffers;
 }
 
 VideoClipWorkflow::~VideoClipWorkflow()
 {
     stop();
+    waitForInitTask();
+    releasePrealocated();
 }
 
 void
 VideoClipWorkflow::releasePrealocated()
 {
-    while ( m_availableBuffers.isEmpty() == false )
-        delete m_availableBuffers.dequeue();
-    while ( m_computedBuffers.isEmpty() == false )
-        delete m_computedBuffers.dequeue();
+    QMutexLocker    lockDecode( m_decodeLock );
+    QMutexLocker    lock( m_renderLock );
+    Workflow::Frame *frame;
+
+    //Deleting the frames will return their buffers to the FramePool, so other clips
+    //can use them while we're stopped.
+    while ( m_availableBuffers.pop( frame ) == true )
+        delete frame;
+    while ( m_computedBuffers.pop( frame ) == true )
+        delete frame;
+    delete m_decodingBuffer;
+    m_decodingBuffer = NULL;
+    delete m_lastReturnedBuffer;
+    m_lastReturnedBuffer = NULL;
+}
+
+void
+VideoClipWorkflow::recycle( Workflow::Frame *frame )
+{
+    if ( m_availableBuffers.push( frame ) == false )
+        delete frame;
 }
 
 void
 VideoClipWorkflow::preallocate()
 {
-    quint32     newWidth = Project::getInstance()->workflow()->getWidth();
-    quint32     newHeight = Project::getInstance()->workflow()->getHeight();
+    quint32     newWidth = m_workflow->getWidth();
+    quint32     newHeight = m_workflow->getHeight();
     if ( newWidth != m_width || newHeight != m_height )
     {
         m_width = newWidth;
         m_height = newHeight;
-        while ( m_availableBuffers.isEmpty() == false )
-            delete m_availableBuffers.dequeue();
-        for ( unsigned int i = 0; i < VideoClipWorkflow::nbBuffers; ++i )
-        {
-            m_availableBuffers.enqueue( new Workflow::Frame( newWidth, newHeight ) );
-        }
+        releasePrealocated();
     }
+    QMutexLocker    lock( m_renderLock );
+    quint32         nbFrames = m_availableBuffers.count() + m_computedBuffers.count();
+    //More frames will be allocated on demand if the FrameBudget allows it.
+    for ( ; nbFrames < getMaxComputedBuffers(); ++nbFrames )
+        recycle( new Workflow::Frame( m_width, m_height, Workflow::I420 ) );
 }
 
 void
@@ -82,11 +108,15 @@ VideoClipWorkflow::initializeInternals()
 {
     initFilters();
     m_renderer->setName( qPrintable( QString("VideoClipWorkflow " % m_clipHelper->uuid().toString() ) ) );
+    //Our buffers are bounded, the decoder waits for the workflow to consume them.
+    m_renderer->setMemoryOutputBlocking( true );
     m_renderer->enableVideoOutputToMemory( this, &lock, &unlock, m_fullSpeedRender );
     m_renderer->setOutputWidth( m_width );
     m_renderer->setOutputHeight( m_height );
-    m_renderer->setOutputFps( (float)VLMC_PROJECT_GET_DOUBLE( "video/VLMCOutputFPS" ) );
-    m_renderer->setOutputVideoCodec( "RV32" );
+    const double    fps = VLMC_PROJECT_GET_DOUBLE( "video/VLMCOutputFPS" );
+    m_frameDuration = fps > 0.0 ? (qint64)( 1000000 / fps ) : 0;
+    m_renderer->setOutputFps( (float)fps );
+    m_renderer->setOutputVideoCodec( "I420" );
 }
 
 Workflow::OutputBuffer*
@@ -96,26 +126,32 @@ VideoClipWorkflow::getOutput( ClipWorkflow::GetMode mode, qint64 currentFrame )
 
     if ( m_lastReturnedBuffer != NULL )
     {
-        m_availableBuffers.enqueue( m_lastReturnedBuffer );
+        //Our queue depth may have been reduced, don't keep more frames than required.
+        if ( m_availableBuffers.count() + m_computedBuffers.count() >= getMaxComputedBuffers() )
+            delete m_lastReturnedBuffer;
+        else
+            recycle( m_lastReturnedBuffer );
         m_lastReturnedBuffer = NULL;
     }
     if ( shouldRender() == false )
         return NULL;
-    if ( getNbComputedBuffers() == 0 )
+    if ( m_computedBuffers.isEmpty() == true )
     {
-        if ( m_renderWaitCond->wait( m_renderLock, 50 ) == false )
+        m_starved = true;
+        if ( m_computedBuffers.waitForData( 50 ) == false )
         {
             vlmcWarning() << "Clip workflow" << m_clipHelper->uuid() << "Timed out while waiting for a frame";
             errorEncountered();
             return NULL;
         }
-        if ( shouldRender() == false )
+        //We may have been woken up because we're stopping.
+        if ( shouldRender() == false || m_computedBuffers.isEmpty() == true )
             return NULL;
     }
     Workflow::Frame         *buff = NULL;
     if ( mode == ClipWorkflow::Pop )
     {
-        buff = m_computedBuffers.dequeue();
+        m_computedBuffers.pop( buff );
         m_lastReturnedBuffer = buff;
     }
     else
@@ -126,7 +162,6 @@ VideoClipWorkflow::getOutput( ClipWorkflow::GetMode mode, qint64 currentFrame )
     if ( newFrame != NULL )
         buff->setBuffer( newFrame );
 
-    postGetOutput();
     return buff;
 }
 
@@ -135,24 +170,28 @@ VideoClipWorkflow::lock( void *data, uint8_t** p_buffer, size_t size )
 {
     VideoClipWorkflow* cw = reinterpret_cast<VideoClipWorkflow*>( data );
 
-    //Mind the fact that frame size in bytes might not be width * height * bpp
-    Workflow::Frame*    frame = NULL;
-
-    cw->m_renderLock->lock();
-    if ( cw->m_availableBuffers.isEmpty() == true )
-    {
-        if ( Workflow::Frame::Size( cw->m_width, cw->m_height ) == size )
-            frame = new Workflow::Frame( cw->m_width, cw->m_height );
-        else
-            frame = new Workflow::Frame( cw->m_width, cw->m_height, size );
-    }
-    else
+    //Block until the workflow consumed enough frames, this is what paces the renderer.
+    //The seeks and stops can go through meanwhile.
+    bool                waited = false;
+    while ( cw->shouldRender() == true &&
+            cw->m_computedBuffers.count() >= cw->getMaxComputedBuffers() )
     {
-        frame = cw->m_availableBuffers.dequeue();
-        if ( frame->size() != size )
-            frame->resize( size );
+        cw->m_computedBuffers.waitForRoom( cw->getMaxComputedBuffers(), RoomWaitDelay );
+        waited = true;
     }
-    cw->m_computedBuffers.enqueue( frame );
+    //Mind the fact that frame size in bytes might not be width * height * bpp
+    //as lines may be padded. The frame layout is set once we know the actual size in unlock()
+    //The consumer never takes this lock to output a frame, only to change what we're doing.
+    cw->m_decodeLock->lock();
+    //Waiting isn't decoding.
+    if ( waited == true )
+        cw->m_lastDecodeDate = mdate();
+    //A frame which got dropped is reused as is.
+    Workflow::Frame*    frame = cw->m_decodingBuffer;
+    if ( frame == NULL && cw->m_availableBuffers.pop( frame ) == false )
+        frame = new Workflow::Frame( cw->m_width, cw->m_height, Workflow::I420 );
+    frame->reserve( size, Workflow::I420 );
+    cw->m_decodingBuffer = frame;
     *p_buffer = (uint8_t*)frame->buffer();
 }
 
@@ -164,16 +203,27 @@ VideoClipWorkflow::unlock( void *data, uint8_t *buffer, int width,
     Q_UNUSED( width );
     Q_UNUSED( height );
     Q_UNUSED( bpp );
-    Q_UNUSED( size );
 
     VideoClipWorkflow* cw = reinterpret_cast<VideoClipWorkflow*>( data );
 
     cw->computePtsDiff( pts );
-    Workflow::Frame     *frame = cw->m_computedBuffers.last();
+    Workflow::Frame     *frame = cw->m_decodingBuffer;
+    if ( cw->m_skipDuration > 0 )
+    {
+        //We were asked to start further, after a seek or a handoff.
+        cw->m_skipDuration -= cw->m_frameDuration;
+        cw->m_decodeLock->unlock();
+        return ;
+    }
+    //width & height may include the decoder alignment, so stick to what we asked for.
+    frame->setLayout( size );
     frame->ptsDiff = cw->m_currentPts - cw->m_previousPts;
     cw->commonUnlock();
-    cw->m_renderWaitCond->wakeAll();
-    cw->m_renderLock->unlock();
+    cw->m_decodingBuffer = NULL;
+    //Only we fill this queue, and we waited for some room before decoding.
+    if ( cw->m_computedBuffers.push( frame ) == false )
+        delete frame;
+    cw->m_decodeLock->unlock();
 }
 
 quint32
@@ -182,17 +232,59 @@ VideoClipWorkflow::getNbComputedBuffers() const
     return m_computedBuffers.count();
 }
 
-quint32
-VideoClipWorkflow::getMaxComputedBuffers() const
+size_t
+VideoClipWorkflow::computedBufferSize() const
 {
-    return VideoClipWorkflow::nbBuffers;
+    return Workflow::Frame::Size( m_width, m_height, Workflow::I420 );
 }
 
 void
 VideoClipWorkflow::flushComputedBuffers()
 {
     QMutexLocker    lock( m_renderLock );
+    Workflow::Frame *frame;
+
+    while ( m_computedBuffers.pop( frame ) == true )
+        recycle( frame );
+}
+
+void
+VideoClipWorkflow::handOverBuffers( ClipWorkflow *next, qint64 skipDuration )
+{
+    VideoClipWorkflow*  cw = static_cast<VideoClipWorkflow*>( next );
+    QMutexLocker        lockDecode( m_decodeLock );
+    QMutexLocker        lock( m_renderLock );
+    Workflow::Frame     *frame;
 
-    while ( m_computedBuffers.isEmpty() == false )
-        m_availableBuffers.enqueue( m_computedBuffers.dequeue() );
+    while ( skipDuration > 0 && m_computedBuffers.pop( frame ) == true )
+    {
+        recycle( frame );
+        skipDuration -= m_frameDuration;
+    }
+    //The next clip was flushed when stopped, and its decoder waits for us.
+    while ( m_computedBuffers.pop( frame ) == true )
+    {
+        if ( cw->m_computedBuffers.push( frame ) == false )
+            delete frame;
+    }
+    if ( m_decodingBuffer != NULL )
+    {
+        cw->recycle( m_decodingBuffer );
+        m_decodingBuffer = NULL;
+    }
+    while ( m_availableBuffers.pop( frame ) == true )
+        cw->recycle( frame );
+    cw->m_skipDuration = qMax<qint64>( skipDuration, 0 );
+}
+
+bool
+VideoClipWorkflow::canUseProxy() const
+{
+    return true;
+}
+
+void
+VideoClipWorkflow::wakeBufferWaiters()
+{
+    m_computedBuffers.wake();
 }
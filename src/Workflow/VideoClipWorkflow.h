@@ -25,8 +25,7 @@
 
 #include "ClipWorkflow.h"
 #include "EffectsEngine/EffectsEngine.h"
-
-#include <QQueue>
+#include "Tools/SpscQueue.hpp"
 
 class   Clip;
 
@@ -35,16 +34,17 @@ class   VideoClipWorkflow : public ClipWorkflow
     Q_OBJECT
 
     public:
-        VideoClipWorkflow( ClipHelper* ch );
+        VideoClipWorkflow( ClipHelper* ch, MainWorkflow* workflow );
         ~VideoClipWorkflow();
         virtual Workflow::OutputBuffer  *getOutput( ClipWorkflow::GetMode mode, qint64 currentFrame );
+        virtual size_t          computedBufferSize() const;
 
-        static const quint32    nbBuffers = 3 * 30; //3 seconds with an average fps of 30
+        /// The maximum queue depth: 3 seconds with an average fps of 30
+        static const quint32    nbBuffers = 3 * 30;
 
     protected:
         virtual void            initializeInternals();
         virtual quint32         getNbComputedBuffers() const;
-        virtual quint32         getMaxComputedBuffers() const;
         virtual void            flushComputedBuffers();
         /**
          *  \brief              Pre-allocate some image buffers.
@@ -54,14 +54,26 @@ class   VideoClipWorkflow : public ClipWorkflow
          */
         virtual void            preallocate();
         virtual void            releasePrealocated();
+        virtual void            handOverBuffers( ClipWorkflow* next, qint64 skipDuration );
+        virtual bool            canUseProxy() const;
+        virtual void            wakeBufferWaiters();
 
     private:
-        QQueue<Workflow::Frame*>    m_computedBuffers;
-        QQueue<Workflow::Frame*>    m_availableBuffers;
+        /// Recycles a frame the decoder won't fill, or deletes it if we have enough.
+        void                        recycle( Workflow::Frame* frame );
+
+        /// Filled by the decoder, emptied by getOutput()
+        SpscQueue<Workflow::Frame*> m_computedBuffers;
+        /// Filled by getOutput() and the flushes, emptied by the decoder
+        SpscQueue<Workflow::Frame*> m_availableBuffers;
         static void                 lock( void* data, uint8_t** pp_ret, size_t size );
         static void                 unlock(void *data, uint8_t* buffer, int width,
                                            int height, int bpp, size_t size, int64_t pts );
+        /// The frame being decoded, between the lock and unlock callbacks.
+        Workflow::Frame             *m_decodingBuffer;
         Workflow::Frame             *m_lastReturnedBuffer;
+        /// The duration of a computed frame, in microseconds.
+        qint64                      m_frameDuration;
 };
 
 #endif // VIDEOCLIPWORKFLOW_H